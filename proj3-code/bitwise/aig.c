@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aig.h"
+#include "sat.h"
+
+#define AIG_INITIAL_NODES 1024
+
+// grow - Make room for one more element in an array. Exits if out of memory.
+static void *grow(void *array, uint32_t n, uint32_t *cap, size_t elem_size) {
+    if (n < *cap) {
+        return array;
+    }
+    *cap = *cap ? *cap * 2 : AIG_INITIAL_NODES;
+    array = realloc(array, (size_t) *cap * elem_size);
+    if (array == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    return array;
+}
+
+static uint32_t hash_gate(aig_lit_t a, aig_lit_t b) {
+    uint64_t h = ((uint64_t) a << 32 | b) * 0x9E3779B97F4A7C15ULL;
+    return h >> 32;
+}
+
+// resize_table - Rehash every gate into a table of the given size
+static void resize_table(aig_t *g, uint32_t size) {
+    free(g->table);
+    g->table = calloc(size, sizeof(uint32_t));
+    if (g->table == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    g->table_size = size;
+    for (uint32_t n = 1; n < g->n_nodes; n++) {
+        if (g->nodes[n].input >= 0) {
+            continue;
+        }
+        uint32_t i = hash_gate(g->nodes[n].fanin[0], g->nodes[n].fanin[1]) & (size - 1);
+        while (g->table[i] != 0) {
+            i = (i + 1) & (size - 1);
+        }
+        g->table[i] = n;
+    }
+}
+
+void aig_init(aig_t *g) {
+    *g = (aig_t) {};
+    g->nodes = grow(NULL, 0, &g->nodes_cap, sizeof(aig_node_t));
+    g->nodes[0] = (aig_node_t) { .input = -1 };
+    g->n_nodes = 1;
+    resize_table(g, 2 * AIG_INITIAL_NODES);
+}
+
+void aig_free(aig_t *g) {
+    free(g->nodes);
+    free(g->table);
+    free(g->inputs);
+    *g = (aig_t) {};
+}
+
+aig_lit_t aig_input(aig_t *g) {
+    g->nodes = grow(g->nodes, g->n_nodes, &g->nodes_cap, sizeof(aig_node_t));
+    g->inputs = grow(g->inputs, g->n_inputs, &g->inputs_cap, sizeof(uint32_t));
+    uint32_t n = g->n_nodes++;
+    g->nodes[n] = (aig_node_t) { .input = g->n_inputs };
+    g->inputs[g->n_inputs++] = n;
+    return n * 2;
+}
+
+aig_lit_t aig_and(aig_t *g, aig_lit_t a, aig_lit_t b) {
+    if (a > b) {
+        aig_lit_t t = a;
+        a = b;
+        b = t;
+    }
+    if (a == AIG_FALSE || a == aig_negate(b)) {
+        return AIG_FALSE;
+    }
+    if (a == AIG_TRUE || a == b) {
+        return b;
+    }
+
+    uint32_t mask = g->table_size - 1;
+    uint32_t i = hash_gate(a, b) & mask;
+    for (; g->table[i] != 0; i = (i + 1) & mask) {
+        const aig_node_t *node = &g->nodes[g->table[i]];
+        if (node->fanin[0] == a && node->fanin[1] == b) {
+            return g->table[i] * 2;
+        }
+    }
+
+    g->nodes = grow(g->nodes, g->n_nodes, &g->nodes_cap, sizeof(aig_node_t));
+    uint32_t n = g->n_nodes++;
+    g->nodes[n] = (aig_node_t) { .fanin = { a, b }, .input = -1 };
+    g->table[i] = n;
+    if (g->n_nodes * 2 > g->table_size) {
+        resize_table(g, g->table_size * 2);
+    }
+    return n * 2;
+}
+
+aig_lit_t aig_or(aig_t *g, aig_lit_t a, aig_lit_t b) {
+    return aig_negate(aig_and(g, aig_negate(a), aig_negate(b)));
+}
+
+aig_lit_t aig_xor(aig_t *g, aig_lit_t a, aig_lit_t b) {
+    return aig_or(g, aig_and(g, a, aig_negate(b)), aig_and(g, aig_negate(a), b));
+}
+
+aig_lit_t aig_ite(aig_t *g, aig_lit_t c, aig_lit_t a, aig_lit_t b) {
+    if (a == b) {
+        return a;
+    }
+    return aig_or(g, aig_and(g, c, a), aig_and(g, aig_negate(c), b));
+}
+
+void aig_word_const(aig_word_t *out, uint64_t value, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = (value >> i) & 1 ? AIG_TRUE : AIG_FALSE;
+    }
+}
+
+void aig_word_input(aig_t *g, aig_word_t *out, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_input(g);
+    }
+}
+
+void aig_word_and(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_and(g, a->bit[i], b->bit[i]);
+    }
+}
+
+void aig_word_or(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_or(g, a->bit[i], b->bit[i]);
+    }
+}
+
+void aig_word_xor(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_xor(g, a->bit[i], b->bit[i]);
+    }
+}
+
+void aig_word_not(aig_word_t *out, const aig_word_t *a, int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_negate(a->bit[i]);
+    }
+}
+
+void aig_word_ite(aig_t *g, aig_word_t *out, aig_lit_t c, const aig_word_t *a, const aig_word_t *b,
+        int width) {
+    for (int i = 0; i < width; i++) {
+        out->bit[i] = aig_ite(g, c, a->bit[i], b->bit[i]);
+    }
+}
+
+void aig_word_add(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b,
+        aig_lit_t carry_in, int width, aig_lit_t *carry_out, aig_lit_t *overflow) {
+    aig_lit_t carry = carry_in, top_carry_in = carry_in;
+    for (int i = 0; i < width; i++) {
+        aig_lit_t x = a->bit[i], y = b->bit[i];
+        aig_lit_t half = aig_xor(g, x, y);
+        top_carry_in = carry;
+        out->bit[i] = aig_xor(g, half, carry);
+        carry = aig_or(g, aig_and(g, x, y), aig_and(g, carry, half));
+    }
+    if (carry_out != NULL) {
+        *carry_out = carry;
+    }
+    if (overflow != NULL) {
+        *overflow = aig_xor(g, carry, top_carry_in);
+    }
+}
+
+void aig_word_sub(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width) {
+    aig_word_t not_b;
+    aig_word_not(&not_b, b, width);
+    aig_word_add(g, out, a, &not_b, AIG_TRUE, width, NULL, NULL);
+}
+
+aig_lit_t aig_word_eq(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width) {
+    aig_lit_t eq = AIG_TRUE;
+    for (int i = 0; i < width; i++) {
+        eq = aig_and(g, eq, aig_negate(aig_xor(g, a->bit[i], b->bit[i])));
+    }
+    return eq;
+}
+
+aig_lit_t aig_word_is_zero(aig_t *g, const aig_word_t *a, int width) {
+    aig_lit_t zero = AIG_TRUE;
+    for (int i = 0; i < width; i++) {
+        zero = aig_and(g, zero, aig_negate(a->bit[i]));
+    }
+    return zero;
+}
+
+aig_lit_t aig_word_eq_const(aig_t *g, const aig_word_t *a, uint64_t value, int width) {
+    aig_word_t c;
+    aig_word_const(&c, value, width);
+    return aig_word_eq(g, a, &c, width);
+}
+
+aig_lit_t aig_word_ult(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width) {
+    aig_word_t diff, not_b;
+    aig_lit_t carry;
+    aig_word_not(&not_b, b, width);
+    aig_word_add(g, &diff, a, &not_b, AIG_TRUE, width, &carry, NULL);
+    return aig_negate(carry);
+}
+
+aig_lit_t aig_word_slt(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width) {
+    aig_word_t diff, not_b;
+    aig_lit_t overflow;
+    aig_word_not(&not_b, b, width);
+    aig_word_add(g, &diff, a, &not_b, AIG_TRUE, width, NULL, &overflow);
+    return aig_xor(g, diff.bit[width - 1], overflow);
+}
+
+void aig_word_shl(aig_word_t *out, const aig_word_t *a, int count, int width) {
+    aig_word_t r;
+    for (int i = 0; i < width; i++) {
+        r.bit[i] = i >= count ? a->bit[i - count] : AIG_FALSE;
+    }
+    memcpy(out->bit, r.bit, width * sizeof(aig_lit_t));
+}
+
+void aig_word_shr(aig_word_t *out, const aig_word_t *a, int count, int width) {
+    aig_word_t r;
+    for (int i = 0; i < width; i++) {
+        r.bit[i] = i + count < width ? a->bit[i + count] : AIG_FALSE;
+    }
+    memcpy(out->bit, r.bit, width * sizeof(aig_lit_t));
+}
+
+void aig_word_sar(aig_word_t *out, const aig_word_t *a, int count, int width) {
+    aig_word_t r;
+    for (int i = 0; i < width; i++) {
+        r.bit[i] = i + count < width ? a->bit[i + count] : a->bit[width - 1];
+    }
+    memcpy(out->bit, r.bit, width * sizeof(aig_lit_t));
+}
+
+void aig_simulate(const aig_t *g, const uint64_t *inputs, uint64_t *values) {
+    values[0] = 0;
+    for (uint32_t n = 1; n < g->n_nodes; n++) {
+        const aig_node_t *node = &g->nodes[n];
+        if (node->input >= 0) {
+            values[n] = inputs[node->input];
+        } else {
+            values[n] = aig_sim_lit(values, node->fanin[0]) & aig_sim_lit(values, node->fanin[1]);
+        }
+    }
+}
+
+enum aig_sat_result aig_sat(const aig_t *g, aig_lit_t lit, long conflict_limit, uint8_t *model) {
+    if (model != NULL) {
+        memset(model, 0, g->n_inputs);
+    }
+    if (lit == AIG_FALSE) {
+        return AIG_UNSAT;
+    }
+    if (lit == AIG_TRUE) {
+        return AIG_SAT;
+    }
+
+    // Fanins always come before the gate, so one pass down marks the cone
+    uint32_t root = aig_node(lit);
+    uint8_t *in_cone = calloc(root + 1, 1);
+    if (in_cone == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    in_cone[root] = 1;
+    for (uint32_t n = root; n > 0; n--) {
+        const aig_node_t *node = &g->nodes[n];
+        if (in_cone[n] && node->input < 0) {
+            in_cone[aig_node(node->fanin[0])] = 1;
+            in_cone[aig_node(node->fanin[1])] = 1;
+        }
+    }
+
+    // Tseitin encoding: variable n is node n, so literals carry over as is
+    sat_t *s = sat_new(root + 1);
+    sat_lit_t unit = AIG_TRUE;
+    sat_add_clause(s, &unit, 1);
+    for (uint32_t n = 1; n <= root; n++) {
+        const aig_node_t *node = &g->nodes[n];
+        if (!in_cone[n] || node->input >= 0) {
+            continue;
+        }
+        sat_lit_t out = n * 2, a = node->fanin[0], b = node->fanin[1];
+        sat_lit_t c1[2] = { sat_negate(out), a };
+        sat_lit_t c2[2] = { sat_negate(out), b };
+        sat_lit_t c3[3] = { out, sat_negate(a), sat_negate(b) };
+        sat_add_clause(s, c1, 2);
+        sat_add_clause(s, c2, 2);
+        sat_add_clause(s, c3, 3);
+    }
+    unit = lit;
+    sat_add_clause(s, &unit, 1);
+
+    enum aig_sat_result result;
+    switch (sat_solve(s, conflict_limit)) {
+        case SAT_SATISFIABLE:
+            result = AIG_SAT;
+            for (uint32_t i = 0; model != NULL && i < g->n_inputs; i++) {
+                uint32_t n = g->inputs[i];
+                model[i] = n <= root && in_cone[n] && sat_value(s, n);
+            }
+            break;
+        case SAT_UNSATISFIABLE:
+            result = AIG_UNSAT;
+            break;
+        default:
+            result = AIG_UNKNOWN;
+    }
+    sat_delete(s);
+    free(in_cone);
+    return result;
+}
@@ -0,0 +1,97 @@
+#ifndef AIG_H
+#define AIG_H
+
+#include <stdint.h>
+
+// And-inverter graphs: boolean circuits built from two-input AND gates and
+// negated edges, with structural hashing so that identical gates are shared
+// and constants fold away as the circuit is built. Words of up to 64 bits
+// are arrays of literals, least significant bit first.
+
+// A literal is a node number times two, plus one if negated. Node 0 is the
+// constant false.
+typedef uint32_t aig_lit_t;
+
+#define AIG_FALSE 0u
+#define AIG_TRUE 1u
+#define aig_negate(lit) ((lit) ^ 1u)
+#define aig_node(lit) ((lit) >> 1)
+
+typedef struct {
+    aig_lit_t fanin[2];         // Both AIG_FALSE for inputs
+    int32_t input;              // Input number, or -1 for gates
+} aig_node_t;
+
+typedef struct {
+    aig_node_t *nodes;
+    uint32_t n_nodes, nodes_cap;
+    uint32_t *table;            // Hash table of gates, by node number (0 if empty)
+    uint32_t table_size;
+    uint32_t *inputs;           // Node of each input
+    uint32_t n_inputs, inputs_cap;
+} aig_t;
+
+typedef struct {
+    aig_lit_t bit[64];
+} aig_word_t;
+
+// Results of aig_sat()
+enum aig_sat_result { AIG_UNKNOWN, AIG_SAT, AIG_UNSAT };
+
+void aig_init(aig_t *g);
+void aig_free(aig_t *g);
+
+aig_lit_t aig_input(aig_t *g);
+aig_lit_t aig_and(aig_t *g, aig_lit_t a, aig_lit_t b);
+aig_lit_t aig_or(aig_t *g, aig_lit_t a, aig_lit_t b);
+aig_lit_t aig_xor(aig_t *g, aig_lit_t a, aig_lit_t b);
+aig_lit_t aig_ite(aig_t *g, aig_lit_t c, aig_lit_t a, aig_lit_t b);
+
+// Word-level operations on the low width bits. Outputs may alias inputs.
+void aig_word_const(aig_word_t *out, uint64_t value, int width);
+void aig_word_input(aig_t *g, aig_word_t *out, int width);
+void aig_word_and(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width);
+void aig_word_or(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width);
+void aig_word_xor(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width);
+void aig_word_not(aig_word_t *out, const aig_word_t *a, int width);
+void aig_word_ite(aig_t *g, aig_word_t *out, aig_lit_t c, const aig_word_t *a, const aig_word_t *b,
+        int width);
+
+// out = a + b + carry_in. Sets *carry_out to the carry out of the top bit
+// and *overflow to signed overflow, either of which may be NULL.
+void aig_word_add(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b,
+        aig_lit_t carry_in, int width, aig_lit_t *carry_out, aig_lit_t *overflow);
+void aig_word_sub(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *b, int width);
+
+aig_lit_t aig_word_eq(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width);
+aig_lit_t aig_word_is_zero(aig_t *g, const aig_word_t *a, int width);
+aig_lit_t aig_word_eq_const(aig_t *g, const aig_word_t *a, uint64_t value, int width);
+aig_lit_t aig_word_ult(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width);
+aig_lit_t aig_word_slt(aig_t *g, const aig_word_t *a, const aig_word_t *b, int width);
+
+// Shifts by a constant. Counts of width or more shift everything out.
+void aig_word_shl(aig_word_t *out, const aig_word_t *a, int count, int width);
+void aig_word_shr(aig_word_t *out, const aig_word_t *a, int count, int width);
+void aig_word_sar(aig_word_t *out, const aig_word_t *a, int count, int width);
+
+/*
+ * Simulate the circuit on 64 input vectors at once. inputs[i] holds input
+ * i's value in each of the vectors, one per bit, and values must have room
+ * for n_nodes entries.
+ */
+void aig_simulate(const aig_t *g, const uint64_t *inputs, uint64_t *values);
+
+// Value of lit in each simulated vector
+static inline uint64_t aig_sim_lit(const uint64_t *values, aig_lit_t lit) {
+    uint64_t v = values[aig_node(lit)];
+    return lit & 1 ? ~v : v;
+}
+
+/*
+ * Decide whether lit can be true, giving up after conflict_limit conflicts
+ * (no limit if negative). On AIG_SAT, model (if not NULL) receives a value
+ * for every input, 0 for those that lit doesn't depend on.
+ */
+enum aig_sat_result aig_sat(const aig_t *g, aig_lit_t lit, long conflict_limit, uint8_t *model);
+
+#endif // AIG_H
@@ -0,0 +1,147 @@
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+// Readings taken back to back to find the cost of measuring
+#define CALIBRATION_ROUNDS 10000
+
+bench_state_t bench_state = { .mask = ~0ULL };
+
+// open_counter - Count a hardware event in user mode for this process and map
+// its control page. Returns the page, or NULL if rdpmc can't read the counter.
+static struct perf_event_mmap_page *open_counter(uint64_t config, int group_fd, int *fd_out) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.pinned = group_fd == -1;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct perf_event_mmap_page *page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (!page->cap_user_rdpmc || page->index == 0) {
+        munmap(page, sysconf(_SC_PAGESIZE));
+        close(fd);
+        return NULL;
+    }
+    *fd_out = fd;
+    return page;
+}
+
+// calibrate - Find the smallest count between two readings with nothing in between
+static void calibrate(void) {
+    uint64_t min_cycles = UINT64_MAX;
+    uint64_t min_instrs = UINT64_MAX;
+    for (int i = 0; i < CALIBRATION_ROUNDS; i++) {
+        bench_count_t start, end;
+        bench_read(&start);
+        bench_read(&end);
+        uint64_t cycles = (end.cycles - start.cycles) & bench_state.mask;
+        uint64_t instrs = (end.instrs - start.instrs) & bench_state.mask;
+        if (start.seq == end.seq && cycles < min_cycles) {
+            min_cycles = cycles;
+        }
+        if (start.seq == end.seq && instrs < min_instrs) {
+            min_instrs = instrs;
+        }
+    }
+    bench_state.cycles_overhead = min_cycles != UINT64_MAX ? min_cycles : 0;
+    bench_state.instrs_overhead = min_instrs != UINT64_MAX ? min_instrs : 0;
+}
+
+void bench_init(void) {
+    int cycles_fd = -1;
+    int instrs_fd = -1;
+    struct perf_event_mmap_page *cycles = open_counter(PERF_COUNT_HW_CPU_CYCLES, -1, &cycles_fd);
+    struct perf_event_mmap_page *instrs = NULL;
+    if (cycles != NULL) {
+        // Same group, so both are always scheduled together
+        instrs = open_counter(PERF_COUNT_HW_INSTRUCTIONS, cycles_fd, &instrs_fd);
+    }
+
+    if (instrs != NULL) {
+        bench_state.use_pmc = 1;
+        bench_state.cycles_pmc = cycles->index - 1;
+        bench_state.instrs_pmc = instrs->index - 1;
+        bench_state.mask = (1ULL << cycles->pmc_width) - 1;
+        bench_state.cycles_lock = &cycles->lock;
+        bench_state.instrs_lock = &instrs->lock;
+    } else if (cycles != NULL) {
+        // Fall back to the TSC for both rather than mixing sources
+        munmap(cycles, sysconf(_SC_PAGESIZE));
+        close(cycles_fd);
+    }
+    calibrate();
+}
+
+// percentile - Smallest bin at or below which at least q of the counts fall
+static uint64_t percentile(const uint64_t *bins, uint64_t n, double q) {
+    uint64_t target = (uint64_t) (q * n);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (uint64_t i = 0; i < BENCH_BINS; i++) {
+        seen += bins[i];
+        if (seen >= target) {
+            return i;
+        }
+    }
+    return BENCH_BINS;
+}
+
+static void print_stats(FILE *out, const uint64_t *bins, uint64_t n) {
+    double qs[] = {0.0, 0.5, 0.99};
+    for (int i = 0; i < 3; i++) {
+        uint64_t value = percentile(bins, n, qs[i]);
+        if (value == BENCH_BINS) {
+            fprintf(out, " >%5d", BENCH_BINS - 1);
+        } else {
+            fprintf(out, " %6llu", (unsigned long long) value);
+        }
+    }
+}
+
+void bench_print(FILE *out, const char *const names[], bench_hist_t hists[][2], int n_funcs) {
+    fprintf(out, "\nPer-call %s, after subtracting %llu for measurement (min p50 p99):\n",
+            bench_state.use_pmc ? "cycles and instructions retired in user mode" :
+            "reference cycles (TSC, no instruction counts available)",
+            (unsigned long long) bench_state.cycles_overhead);
+    fprintf(out, "%-16s %10s   %-20s   %-20s", "Function", "Calls", "bits.s cycles", "oracle cycles");
+    if (bench_state.use_pmc) {
+        fprintf(out, "   %-20s   %-20s", "bits.s instrs", "oracle instrs");
+    }
+    fprintf(out, "\n");
+
+    for (int i = 0; i < n_funcs; i++) {
+        bench_hist_t *student = &hists[i][0];
+        bench_hist_t *oracle = &hists[i][1];
+        if (student->n == 0) {
+            continue;
+        }
+        fprintf(out, "%-16s %10llu  ", names[i], (unsigned long long) student->n);
+        print_stats(out, student->cycles, student->n);
+        fprintf(out, "  ");
+        print_stats(out, oracle->cycles, oracle->n);
+        if (bench_state.use_pmc) {
+            fprintf(out, "  ");
+            print_stats(out, student->instrs, student->n);
+            fprintf(out, "  ");
+            print_stats(out, oracle->instrs, oracle->n);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <x86intrin.h>
+
+// Per-call cycle and instruction counts for btest's benchmark mode (-B).
+// Counts come from hardware performance counters read directly with rdpmc,
+// or from the time stamp counter (reference cycles only) where those aren't
+// available to user code.
+
+// Counts from 0 up to BENCH_BINS - 1 are kept exactly, larger ones share a bin
+#define BENCH_BINS 4096
+
+typedef struct {
+    uint64_t n;                         // Calls measured
+    uint64_t cycles[BENCH_BINS + 1];
+    uint64_t instrs[BENCH_BINS + 1];
+} bench_hist_t;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t instrs;
+    uint32_t seq;       // Changes if the counters were rescheduled in between
+} bench_count_t;
+
+typedef struct {
+    int use_pmc;                // Reading performance counters, not the TSC?
+    uint32_t cycles_pmc;        // rdpmc index for each counter
+    uint32_t instrs_pmc;
+    uint64_t mask;              // Counters are only pmc_width bits wide
+    volatile uint32_t *cycles_lock;
+    volatile uint32_t *instrs_lock;
+    uint64_t cycles_overhead;   // Cost of the measurement itself
+    uint64_t instrs_overhead;
+} bench_state_t;
+
+extern bench_state_t bench_state;
+
+// Set up counters for the calling process, falling back to the TSC
+void bench_init(void);
+
+// Print a table of min/p50/p99 per call for each function's code and its oracle
+void bench_print(FILE *out, const char *const names[], bench_hist_t hists[][2], int n_funcs);
+
+static inline uint64_t bench_rdpmc(uint32_t counter) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return lo | (uint64_t) hi << 32;
+}
+
+// bench_read - Take a reading, fenced so it isn't reordered with the code measured
+static inline void bench_read(bench_count_t *count) {
+    _mm_lfence();
+    if (bench_state.use_pmc) {
+        count->seq = *bench_state.cycles_lock + *bench_state.instrs_lock;
+        count->cycles = bench_rdpmc(bench_state.cycles_pmc);
+        count->instrs = bench_rdpmc(bench_state.instrs_pmc);
+    } else {
+        count->seq = 0;
+        count->cycles = __rdtsc();
+        count->instrs = 0;
+    }
+    _mm_lfence();
+}
+
+static inline uint64_t bench_bin(uint64_t delta, uint64_t overhead) {
+    delta = delta > overhead ? delta - overhead : 0;
+    return delta < BENCH_BINS ? delta : BENCH_BINS;
+}
+
+// bench_record - Add the counts between two readings to a histogram
+static inline void bench_record(bench_hist_t *hist, const bench_count_t *start, const bench_count_t *end) {
+    if (start->seq != end->seq) {
+        return;
+    }
+    hist->cycles[bench_bin((end->cycles - start->cycles) & bench_state.mask,
+            bench_state.cycles_overhead)]++;
+    hist->instrs[bench_bin((end->instrs - start->instrs) & bench_state.mask,
+            bench_state.instrs_overhead)]++;
+    hist->n++;
+}
+
+// Measure one call (or any other statement) into hist
+#define BENCH_CALL(hist, call) \
+    do { \
+        bench_count_t bench_start_, bench_end_; \
+        bench_read(&bench_start_); \
+        call; \
+        bench_read(&bench_end_); \
+        bench_record((hist), &bench_start_, &bench_end_); \
+    } while (0)
+
+#endif // BENCH_H
@@ -0,0 +1,817 @@
+/*
+ * bgrade - Grade a whole class's submissions in one long-running process.
+ *
+ * Submissions are read from a queue, one path per line: a directory holding
+ * bits.s (at the top, in bitwise/ or in proj3-code/bitwise/) or a zip archive
+ * made by the top-level "make zip". Each bits.s first goes through cc_check,
+ * and one that breaks the calling convention gets no credit, as it would from
+ * check_bitwise. Otherwise it's run in the emulator (see emu.h), so nothing
+ * is built per submission and a broken submission can't take the others down
+ * with it. A bits.s using instructions the emulator doesn't cover is instead
+ * built and tested natively by btest, in a scratch copy of the harness.
+ *
+ * Every function's test cases are the same ones btest uses (testgen.h), and
+ * their expected outputs are computed or mapped from the golden files once,
+ * for all submissions. Testing is split into jobs of up to JOB_CASES cases of
+ * one function of one submission. Each worker thread has its own deque of
+ * jobs: a new submission's jobs go on one worker's deque, the owner takes
+ * jobs from the bottom, and a worker that runs dry steals from the top of
+ * another's, so that the workers stay busy while submissions finish at
+ * different rates. Results are written as NDJSON records (see report.h)
+ * as soon as the last job of a submission is done.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dl_protocol.h"
+#include "emu.h"
+#include "golden.h"
+#include "report.h"
+#include "rng.h"
+#include "testgen.h"
+#include "utils.h"
+
+/* Test cases per job. Large enough to make scheduling overhead negligible,
+   small enough that the largest functions split across every worker. */
+#define JOB_CASES (1 << 16)
+
+
+/* Where bits.s may be in a submission directory or archive */
+static const char *const bits_paths[] = {
+    "bits.s",
+    "bitwise/bits.s",
+    "proj3-code/bitwise/bits.s",
+};
+#define N_BITS_PATHS (sizeof(bits_paths) / sizeof(bits_paths[0]))
+
+/* Directory bgrade was built in, with cc_check, bits_impl.h and the
+   harness sources that native runs are built from */
+static char harness_dir[PATH_MAX];
+
+/* Progress of testing one function of a submission */
+typedef struct {
+    uint64_t fail_index;        /* case number of the earliest failure, UINT64_MAX if none */
+    enum test_outcome outcome;
+    function_result_t result;
+    function_stats_t stats;
+    uint64_t first_start_ns;    /* when its first job started, 0 if none has */
+} func_state_t;
+
+typedef struct {
+    char *path;
+    emu_program_t emu;
+    int entries[NUM_PUZZLES];
+    pthread_mutex_t lock;
+    unsigned remaining;         /* jobs not yet finished */
+    uint64_t start_ns;
+    func_state_t funcs[NUM_PUZZLES];
+} submission_t;
+
+typedef struct {
+    submission_t *sub;
+    enum function_id func;
+    uint64_t start;
+    unsigned count;
+} job_t;
+
+/* A worker's jobs, jobs[head] to jobs[head + n - 1] modulo cap. The owner
+   pushes and pops at the bottom (the end), thieves steal from the top. */
+typedef struct {
+    pthread_mutex_t lock;
+    job_t *jobs;
+    unsigned cap;
+    unsigned head;
+    unsigned n;
+} deque_t;
+
+typedef struct {
+    pthread_t thread;
+    unsigned index;
+    deque_t deque;
+    int *elems;                 /* one job's cases, laid out as in a batch */
+    int *expected;              /* their expected outputs, without golden data */
+} worker_t;
+
+static worker_t *workers;
+static unsigned n_workers;
+
+/* Jobs queued on any deque, and whether the queue has been read to the end */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t n_queued;
+static int closing;
+
+/* Submissions being tested, limited so the queue isn't read far ahead */
+static unsigned n_in_flight;
+static unsigned max_in_flight;
+static unsigned n_graded;
+
+/* Every function's test cases and expected outputs, shared by all submissions */
+static test_vectors_t vectors[NUM_PUZZLES];
+static golden_t golden[NUM_PUZZLES];
+
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set by SIGINT or SIGTERM: stop reading the queue, finish what's queued */
+static volatile sig_atomic_t stopping;
+
+static void handle_stop(int signo) {
+    stopping = 1;
+}
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-h] [-G <dir>] [-j <threads>] [<queue>]\n", cmd);
+    printf("Grades as check_bitwise would, with these differences:\n");
+    printf("  - bits.s is emulated when it can be, and times out after %d instructions per\n",
+        EMU_FUEL_DEFAULT);
+    printf("    call rather than btest's CPU seconds per batch, so code that only just\n");
+    printf("    finishes in time (or only just doesn't) may score differently\n");
+    printf("  - bits.s the emulator can't run is built and run natively by btest, one\n");
+    printf("    submission at a time, while the emulated ones carry on\n");
+    printf("  - Errors after a function's first failure aren't counted when emulated\n");
+    printf("  -G <dir>  Cache expected outputs in dir, shared with btest -G (default: off).\n");
+    printf("            It must not be writable by students.\n");
+    printf("  -h        Print this message\n");
+    printf("  -j <n>    Run n worker threads (default: one per core)\n");
+    printf("  <queue>   File of submission paths, one per line (default standard input).\n");
+    printf("            A FIFO is read as writers come and go until SIGINT or SIGTERM.\n");
+    exit(1);
+}
+
+// monotonic_ns - Wall clock time for measuring how long grading takes
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// thread_cpu_ns - CPU time used by the calling thread
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// deque_push - Add a job at the bottom of a deque. Returns 0, or -1 if out of memory.
+static int deque_push(deque_t *d, const job_t *job) {
+    pthread_mutex_lock(&d->lock);
+    if (d->n == d->cap) {
+        unsigned cap = d->cap > 0 ? 2 * d->cap : 256;
+        job_t *jobs = malloc(cap * sizeof(job_t));
+        if (jobs == NULL) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (unsigned i = 0; i < d->n; i++) {
+            jobs[i] = d->jobs[(d->head + i) % d->cap];
+        }
+        free(d->jobs);
+        d->jobs = jobs;
+        d->cap = cap;
+        d->head = 0;
+    }
+    d->jobs[(d->head + d->n) % d->cap] = *job;
+    d->n++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+// deque_take - Remove a job from the bottom (owner) or the top (thief) of a
+// deque. Returns 1 if there was one.
+static int deque_take(deque_t *d, job_t *job, int steal) {
+    int taken = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->n > 0) {
+        if (steal) {
+            *job = d->jobs[d->head];
+            d->head = (d->head + 1) % d->cap;
+        } else {
+            *job = d->jobs[(d->head + d->n - 1) % d->cap];
+        }
+        d->n--;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return taken;
+}
+
+// next_job - Take a job from the worker's own deque, or steal one, waiting
+// until there is one. Returns 0 once every submission has been queued and
+// there is nothing left to take.
+static int next_job(worker_t *w, job_t *job) {
+    while (1) {
+        int found = deque_take(&w->deque, job, 0);
+        for (unsigned i = 1; !found && i < n_workers; i++) {
+            found = deque_take(&workers[(w->index + i) % n_workers].deque, job, 1);
+        }
+        pthread_mutex_lock(&pool_lock);
+        if (found) {
+            n_queued--;
+            pthread_mutex_unlock(&pool_lock);
+            return 1;
+        }
+        while (n_queued == 0 && !closing) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+        if (n_queued == 0 && closing) {
+            pthread_mutex_unlock(&pool_lock);
+            return 0;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+// report_graded - Write a finished submission's records and free it
+static void report_graded(submission_t *sub) {
+    unsigned earned = 0, possible = 0;
+    pthread_mutex_lock(&output_lock);
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        func_state_t *fs = &sub->funcs[id];
+        unsigned rating = getFuncRating(id);
+        report_record_t record = {
+            .submission = sub->path,
+            .name = getFuncName(id),
+            .rating = rating,
+            .score = fs->outcome == SUCCESS ? rating : 0,
+            .outcome = fs->outcome,
+            .num_args = getNumArgs(id),
+            .result = &fs->result,
+            // The emulator pins crashes to the case that caused them
+            .has_call = 1,
+            // Cases after the first failure are skipped, so errors aren't counted
+            .errors_unknown = 1,
+            .stats = &fs->stats,
+        };
+        report_function(stdout, REPORT_JSON, id + 1, &record);
+        earned += record.score;
+        possible += rating;
+    }
+    report_submission(stdout, sub->path, NULL, NUM_PUZZLES, earned, possible,
+        monotonic_ns() - sub->start_ns);
+    pthread_mutex_unlock(&output_lock);
+
+    emu_free(&sub->emu);
+    free(sub->path);
+    free(sub);
+
+    pthread_mutex_lock(&pool_lock);
+    n_in_flight--;
+    n_graded++;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// record_failure - Keep a failure if it's the earliest of its function so far.
+// Call with the submission's lock held.
+static void record_failure(func_state_t *fs, uint64_t index, enum test_outcome outcome,
+        const function_result_t *result) {
+    if (index < fs->fail_index) {
+        fs->fail_index = index;
+        fs->outcome = outcome;
+        fs->result = *result;
+    }
+}
+
+// run_job - Test one job's cases and record how they went
+static void run_job(worker_t *w, const job_t *job) {
+    submission_t *sub = job->sub;
+    func_state_t *fs = &sub->funcs[job->func];
+    const test_vectors_t *vec = &vectors[job->func];
+    unsigned num_args = vec->num_args;
+    unsigned stride = num_args + 1;
+    uint64_t start_ns = monotonic_ns();
+    uint64_t cpu_start = thread_cpu_ns();
+
+    // Cases after an earlier failure can't change the result
+    pthread_mutex_lock(&sub->lock);
+    int skip = job->start > fs->fail_index;
+    if (fs->first_start_ns == 0) {
+        fs->first_start_ns = start_ns;
+    }
+    pthread_mutex_unlock(&sub->lock);
+
+    unsigned n_run = 0;
+    function_result_t result = { .function_id = job->func };
+    enum test_outcome outcome = SUCCESS;
+    uint64_t fail_index = UINT64_MAX;
+    if (!skip) {
+        testgen_fill(vec, w->elems, job->start, job->count);
+        const int *expected = golden[job->func].expected;
+        if (expected != NULL) {
+            expected += job->start;
+        } else {
+            testgen_expected(vec, w->elems, job->count, w->expected);
+            expected = w->expected;
+        }
+
+        unsigned stopped_at;
+        emu_status_t status = emu_run_batch(&sub->emu, sub->entries[job->func], num_args, w->elems,
+            stride, job->count, EMU_FUEL_DEFAULT, &stopped_at);
+        n_run = status == EMU_RETURNED ? job->count : stopped_at + 1;
+
+        const int *results = w->elems + batch_result_offset(num_args);
+        for (unsigned i = 0; i < stopped_at; i++) {
+            if (results[i * stride] != expected[i]) {
+                outcome = FAILURE;
+                fail_index = job->start + i;
+                result.actual_output = results[i * stride];
+                break;
+            }
+        }
+        if (outcome == SUCCESS && status != EMU_RETURNED) {
+            outcome = status == EMU_OUT_OF_FUEL ? TIMEOUT : SEGFAULT;
+            fail_index = job->start + stopped_at;
+        }
+        if (outcome != SUCCESS) {
+            const int *elem = w->elems + (fail_index - job->start) * stride;
+            result.arg1 = num_args > 0 ? elem[0] : 0;
+            result.arg2 = num_args == 2 ? elem[1] : 0;
+            result.expected_output = expected[fail_index - job->start];
+        }
+    }
+
+    pthread_mutex_lock(&sub->lock);
+    if (outcome != SUCCESS) {
+        record_failure(fs, fail_index, outcome, &result);
+    }
+    fs->stats.n_tests += n_run;
+    fs->stats.cpu_ns += thread_cpu_ns() - cpu_start;
+    fs->stats.wall_ns = monotonic_ns() - fs->first_start_ns;
+    int done = --sub->remaining == 0;
+    pthread_mutex_unlock(&sub->lock);
+
+    if (done) {
+        report_graded(sub);
+    }
+}
+
+static void *run_worker(void *arg) {
+    worker_t *w = arg;
+    job_t job;
+    while (next_job(w, &job)) {
+        run_job(w, &job);
+    }
+    return NULL;
+}
+
+// run_command - Run a program in dir (NULL for this one) with its standard
+// error discarded, and collect its standard output. Returns the malloc'd
+// text, or NULL if it couldn't be run, and sets *status to its exit code.
+static char *run_command(char *const argv[], const char *dir, int *status) {
+    int fds[2];
+    *status = -1;
+    if (pipe(fds) == -1) {
+        return NULL;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd != -1) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        if (dir == NULL || chdir(dir) == 0) {
+            execvp(argv[0], argv);
+        }
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid == -1) {
+        close(fds[0]);
+        return NULL;
+    }
+
+    size_t len = 0, cap = 4096;
+    char *text = malloc(cap);
+    ssize_t n;
+    while (text != NULL && (n = read(fds[0], text + len, cap - len - 1)) > 0) {
+        len += n;
+        if (len + 1 == cap) {
+            char *bigger = realloc(text, 2 * cap);
+            if (bigger == NULL) {
+                free(text);
+            }
+            text = bigger;
+            cap *= 2;
+        }
+    }
+    close(fds[0]);
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    *status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+    if (text == NULL || *status == 127) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+// unzip_member - Extract one member of a zip archive into memory. Returns the
+// malloc'd text, or NULL if unzip fails or the member isn't there.
+static char *unzip_member(const char *archive, const char *member) {
+    char *argv[] = { "unzip", "-p", (char *) archive, (char *) member, NULL };
+    int status;
+    char *text = run_command(argv, NULL, &status);
+    if (text != NULL && (status != 0 || text[0] == '\0')) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+// read_file - Read a whole file into memory. Returns the malloc'd text, or NULL.
+static char *read_file(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return NULL;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char *text = size >= 0 ? malloc(size + 1) : NULL;
+    if (text != NULL && fread(text, 1, size, in) != (size_t) size) {
+        free(text);
+        text = NULL;
+    }
+    fclose(in);
+    if (text != NULL) {
+        text[size] = '\0';
+    }
+    return text;
+}
+
+// load_bits - Find and read a submission's bits.s. Returns the malloc'd text,
+// or NULL if the submission doesn't have one.
+static char *load_bits(const char *path) {
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        return NULL;
+    }
+    for (unsigned i = 0; i < N_BITS_PATHS; i++) {
+        char *text;
+        if (S_ISDIR(st.st_mode)) {
+            char file[4096];
+            snprintf(file, sizeof(file), "%s/%s", path, bits_paths[i]);
+            text = read_file(file);
+        } else {
+            text = unzip_member(path, bits_paths[i]);
+        }
+        if (text != NULL) {
+            return text;
+        }
+    }
+    return NULL;
+}
+
+// make_scratch - Create a scratch directory holding source as bits.s, with
+// the path written to dir. Returns 0 on success.
+static int make_scratch(const char *source, char *dir, size_t size) {
+    snprintf(dir, size, "/tmp/bgrade.XXXXXX");
+    if (mkdtemp(dir) == NULL) {
+        return -1;
+    }
+    char file[PATH_MAX + 16];
+    snprintf(file, sizeof(file), "%s/bits.s", dir);
+    FILE *out = fopen(file, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    int ok = fputs(source, out) != EOF;
+    return fclose(out) == 0 && ok ? 0 : -1;
+}
+
+// remove_scratch - Remove a scratch directory and everything in it
+static void remove_scratch(const char *dir) {
+    char *argv[] = { "rm", "-rf", (char *) dir, NULL };
+    int status;
+    free(run_command(argv, NULL, &status));
+}
+
+// check_abi - Run cc_check on the bits.s in dir, as check_bitwise does.
+// Returns NULL if it passes, or why not in error.
+static const char *check_abi(const char *dir, char *error, size_t size) {
+    char cc_check[PATH_MAX + 16], header[PATH_MAX + 16];
+    snprintf(cc_check, sizeof(cc_check), "%s/cc_check", harness_dir);
+    snprintf(header, sizeof(header), "%s/bits_impl.h", harness_dir);
+    char *argv[] = { cc_check, "-i", header, "bits.s", NULL };
+    int status;
+    char *out = run_command(argv, dir, &status);
+    if (out == NULL) {
+        return "cc_check couldn't be run";
+    }
+    // check_bitwise gives no credit if cc_check prints anything
+    const char *ret = NULL;
+    if (out[0] != '\0') {
+        snprintf(error, size, "calling convention check failed: %.*s", (int) strcspn(out, "\n"), out);
+        ret = error;
+    }
+    free(out);
+    return ret;
+}
+
+// link_harness - Link the harness sources into dir, next to its bits.s, so
+// that btest can be built there. Returns 0 on success.
+static int link_harness(const char *dir) {
+    DIR *d = opendir(harness_dir);
+    if (d == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    struct dirent *entry;
+    while (ret == 0 && (entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        int is_source = len > 2 && name[len - 2] == '.' && (name[len - 1] == 'c' || name[len - 1] == 'h');
+        if (!is_source && strcmp(name, "Makefile") != 0 && strcmp(name, "bits_source.s") != 0) {
+            continue;
+        }
+        char target[PATH_MAX + 256], link[PATH_MAX + 256];
+        snprintf(target, sizeof(target), "%s/%s", harness_dir, name);
+        snprintf(link, sizeof(link), "%s/%s", dir, name);
+        ret = symlink(target, link);
+    }
+    closedir(d);
+    return ret;
+}
+
+// grade_natively - Build btest with the bits.s in dir and run it, writing its
+// records as bgrade's. Returns NULL on success, or why it couldn't be graded.
+static const char *grade_natively(const char *path, const char *dir, uint64_t start_ns) {
+    if (link_harness(dir) == -1) {
+        return "couldn't set up a native build";
+    }
+    char *make_argv[] = { "make", "-s", "btest", "btest_server", NULL };
+    int status;
+    free(run_command(make_argv, dir, &status));
+    if (status != 0) {
+        return "bits.s doesn't build";
+    }
+    char *btest_argv[] = { "./btest", "-O", "json", NULL };
+    char *out = run_command(btest_argv, dir, &status);
+    if (out == NULL) {
+        return "btest couldn't be run";
+    }
+
+    // Records are btest's, with the submission added; its totals become the summary
+    const char *error = "btest gave no total";
+    pthread_mutex_lock(&output_lock);
+    for (char *line = strtok(out, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        unsigned earned, possible, n_functions;
+        if (sscanf(line, "{\"total_points\":%u,\"possible_points\":%u,\"functions\":%u}",
+                &earned, &possible, &n_functions) == 3) {
+            report_submission(stdout, path, NULL, n_functions, earned, possible,
+                monotonic_ns() - start_ns);
+            error = NULL;
+        } else if (line[0] == '{' && error != NULL) {
+            report_relabel(stdout, path, line);
+        }
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&output_lock);
+    free(out);
+    return error;
+}
+
+// queue_submission - Load a submission and queue its jobs on one worker's
+// deque, or grade it natively if the emulator can't run it
+static void queue_submission(const char *path, unsigned worker) {
+    const char *error = NULL;
+    char error_buf[256], dir[PATH_MAX];
+    int native = 0;
+    uint64_t start_ns = monotonic_ns();
+    submission_t *sub = calloc(1, sizeof(submission_t));
+    char *source = load_bits(path);
+    if (sub == NULL || (sub->path = strdup(path)) == NULL) {
+        error = "out of memory";
+    } else if (source == NULL) {
+        error = "no bits.s found";
+    } else if (make_scratch(source, dir, sizeof(dir)) == -1) {
+        error = "couldn't write bits.s to a scratch directory";
+    } else if ((error = check_abi(dir, error_buf, sizeof(error_buf))) == NULL) {
+        native = emu_load(&sub->emu, source, path) == -1;
+        if (native) {
+            error = grade_natively(path, dir, start_ns);
+        }
+    }
+    if (source != NULL) {
+        remove_scratch(dir);
+    }
+    free(source);
+    if (native && error == NULL) {
+        free(sub->path);
+        free(sub);
+        pthread_mutex_lock(&pool_lock);
+        n_graded++;
+        pthread_mutex_unlock(&pool_lock);
+        return;
+    }
+    if (error != NULL) {
+        pthread_mutex_lock(&output_lock);
+        report_submission(stdout, path, error, 0, 0, 0, 0);
+        pthread_mutex_unlock(&output_lock);
+        if (sub != NULL) {
+            free(sub->path);
+        }
+        free(sub);
+        return;
+    }
+
+    pthread_mutex_init(&sub->lock, NULL);
+    sub->start_ns = start_ns;
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        sub->entries[id] = emu_entry(&sub->emu, getFuncName(id));
+        sub->funcs[id] = (func_state_t) { .fail_index = UINT64_MAX, .outcome = SUCCESS };
+        sub->remaining += (vectors[id].total_cases + JOB_CASES - 1) / JOB_CASES;
+    }
+
+    // Workers can take jobs as soon as they are pushed, but can't count them
+    // off n_queued until all of them have been counted in
+    pthread_mutex_lock(&pool_lock);
+    n_in_flight++;
+    // Jobs are pushed last first, so the owner, taking from the bottom, runs
+    // each function's cases in order and can skip those after a failure.
+    // Thieves take from the top, the work furthest from the owner's.
+    unsigned n_jobs = 0;
+    for (int id = NUM_PUZZLES - 1; id >= 0; id--) {
+        uint64_t n_chunks = (vectors[id].total_cases + JOB_CASES - 1) / JOB_CASES;
+        for (uint64_t chunk = n_chunks; chunk-- > 0; ) {
+            uint64_t start = chunk * JOB_CASES;
+            uint64_t left = vectors[id].total_cases - start;
+            job_t job = {
+                .sub = sub,
+                .func = id,
+                .start = start,
+                .count = left < JOB_CASES ? left : JOB_CASES,
+            };
+            if (deque_push(&workers[worker].deque, &job) == -1) {
+                perror("malloc");
+                exit(1);
+            }
+            n_jobs++;
+        }
+    }
+    n_queued += n_jobs;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// read_queue - Queue each submission listed in in, spreading them over the
+// workers' deques. Returns the number of submissions read.
+static unsigned read_queue(FILE *in) {
+    static unsigned next_worker = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    unsigned n = 0;
+    while (!stopping && (len = getline(&line, &cap, in)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        pthread_mutex_lock(&pool_lock);
+        while (n_in_flight >= max_in_flight) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+        pthread_mutex_unlock(&pool_lock);
+        queue_submission(line, next_worker);
+        next_worker = (next_worker + 1) % n_workers;
+        n++;
+    }
+    free(line);
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    const char *golden_dir = NULL;
+    long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    n_workers = n_cores > 0 ? n_cores : 1;
+
+    char c;
+    while ((c = getopt(argc, argv, "hG:j:")) != -1) {
+        switch (c) {
+            case 'G':
+                golden_dir = strcmp(optarg, "-") == 0 ? NULL : optarg;
+                break;
+            case 'j':
+                if (atoi(optarg) < 1) {
+                    usage(argv[0]);
+                }
+                n_workers = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1) {
+        usage(argv[0]);
+    }
+    const char *queue_path = optind < argc ? argv[optind] : NULL;
+    max_in_flight = 2 * n_workers;
+
+    // cc_check and the harness sources are beside this program
+    ssize_t len = readlink("/proc/self/exe", harness_dir, sizeof(harness_dir) - 1);
+    if (len == -1) {
+        perror("/proc/self/exe");
+        return 1;
+    }
+    harness_dir[len] = '\0';
+    *strrchr(harness_dir, '/') = '\0';
+
+    // Without SA_RESTART, a signal also interrupts waiting for a FIFO's writer
+    struct sigaction sigact = { .sa_handler = handle_stop };
+    sigemptyset(&sigact.sa_mask);
+    if (sigaction(SIGINT, &sigact, NULL) == -1 || sigaction(SIGTERM, &sigact, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+
+    // Test cases and expected outputs are the same for every submission
+    testgen_options_t opts = { .seed = RNG_SEED_DEFAULT };
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        testgen_init(&vectors[id], id, &opts);
+        golden_open(&golden[id], golden_dir, getFuncName(id), testgen_golden_key(&vectors[id]),
+            vectors[id].total_cases, testgen_fill_golden, &vectors[id]);
+    }
+
+    workers = calloc(n_workers, sizeof(worker_t));
+    if (workers == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (unsigned i = 0; i < n_workers; i++) {
+        worker_t *w = &workers[i];
+        w->index = i;
+        pthread_mutex_init(&w->deque.lock, NULL);
+        w->elems = malloc((JOB_CASES * MAX_CASE_INTS + 1) * sizeof(int));
+        w->expected = malloc(JOB_CASES * sizeof(int));
+        if (w->elems == NULL || w->expected == NULL) {
+            perror("malloc");
+            return 1;
+        }
+    }
+    for (unsigned i = 0; i < n_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+            fprintf(stderr, "bgrade: Failed to start worker thread\n");
+            return 1;
+        }
+    }
+
+    uint64_t start_ns = monotonic_ns();
+    int exit_status = 0;
+    if (queue_path == NULL) {
+        read_queue(stdin);
+    } else {
+        struct stat st;
+        int is_fifo = stat(queue_path, &st) == 0 && S_ISFIFO(st.st_mode);
+        do {
+            // Opening a FIFO waits for a writer, until a signal arrives
+            FILE *in = fopen(queue_path, "r");
+            if (in == NULL) {
+                if (errno != EINTR) {
+                    perror(queue_path);
+                    exit_status = 1;
+                }
+                break;
+            }
+            read_queue(in);
+            fclose(in);
+        } while (is_fifo && !stopping);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    closing = 1;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    for (unsigned i = 0; i < n_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    double secs = (monotonic_ns() - start_ns) / 1e9;
+    fprintf(stderr, "bgrade: Graded %u submission%s in %.1f secs with %u worker%s (%.1f per minute)\n",
+        n_graded, n_graded == 1 ? "" : "s", secs, n_workers, n_workers == 1 ? "" : "s",
+        secs > 0 ? n_graded * 60 / secs : 0);
+
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        golden_close(&golden[id]);
+    }
+    return exit_status;
+}
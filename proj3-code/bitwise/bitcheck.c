@@ -0,0 +1,1098 @@
+/*
+ * bitcheck - Prove the functions in bits.s equal to circuits for the
+ * reference versions in bits_test.c over every input, or find an input where
+ * they differ.
+ *
+ * Each function is executed symbolically: register values are circuits over
+ * the bits of the arguments (and of whatever the registers held on entry),
+ * and every conditional jump that can go both ways splits the path. The
+ * return values of all the paths are merged and compared with a circuit for
+ * the reference implementation, and a SAT solver decides whether any input
+ * in range makes them differ.
+ *
+ * The reference circuits are not derived from bits_test.c: they are
+ * transcribed from it by hand, in oracle_circuit(), and must be kept in step
+ * with it. Each is compared with bits_test.c on 4096 inputs before it's used,
+ * which catches most slips but proves nothing, so a proof only says bits.s
+ * equals the transcription.
+ */
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aig.h"
+#include "bits_test.h"
+#include "dl_protocol.h"
+#include "rng.h"
+#include "utils.h"
+#include "x86_parse.h"
+
+/* Instructions a single path may execute before it's reported as not returning */
+#define FUEL_DEFAULT 10000
+
+/* Paths waiting to be explored at once, and values pushed on the stack */
+#define MAX_PATHS 4096
+#define MAX_STACK 64
+
+/* Conflicts the solver may take per query before giving up */
+#define CONFLICT_LIMIT 2000000
+
+/* Inputs the reference circuits are checked on: blocks of 64, simulated together */
+#define ORACLE_CHECK_BLOCKS 64
+
+/* Failing paths remembered per function, to say why a counterexample fails */
+#define MAX_PATH_ERRORS 64
+
+enum flag { FLAG_CF, FLAG_ZF, FLAG_SF, FLAG_OF, NUM_FLAGS };
+
+/* Machine state along one path */
+typedef struct {
+    int pc;
+    unsigned steps;
+    aig_lit_t cond;                     /* inputs that take this path */
+    aig_word_t regs[X86_NUM_REGS];
+    uint8_t defined[X86_NUM_REGS];      /* bytes written since entry (or arguments) */
+    aig_lit_t flags[NUM_FLAGS];
+    int flags_defined;
+    aig_word_t stack[MAX_STACK];
+    uint8_t stack_defined[MAX_STACK];
+    int depth;
+} sym_state_t;
+
+typedef struct {
+    aig_lit_t cond;
+    int line;
+    char message[96];
+} path_error_t;
+
+/* Everything known about the function being checked */
+typedef struct {
+    aig_t g;
+    enum function_id func;
+    unsigned num_args;
+    const char *func_name;
+    aig_word_t args[2];
+    aig_word_t initial[X86_NUM_REGS];   /* register values on entry */
+    int warned[X86_NUM_REGS];           /* reads before writes already reported */
+    int warned_flags;
+    aig_lit_t returned;                 /* inputs for which some path returns */
+    aig_word_t result;                  /* %eax on return, for those inputs */
+    path_error_t errors[MAX_PATH_ERRORS];
+    unsigned n_errors;
+    aig_lit_t failed;                   /* inputs for which some path goes wrong */
+    int aborted;                        /* couldn't be checked */
+
+    /* Simulation vectors for quick satisfiability checks, kept up to date
+       as nodes are added */
+    uint64_t *sim_inputs;
+    uint64_t *sim_values;
+    uint32_t n_simulated, sim_cap;
+} check_t;
+
+static unsigned fuel = FUEL_DEFAULT;
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-h] [-f <name>] [-F <fuel>] [<file>]\n", cmd);
+    printf("  -f <name> Check only the named function\n");
+    printf("  -F <n>    Give up on paths that run more than n instructions (default %d)\n",
+        FUEL_DEFAULT);
+    printf("  -h        Print this message\n");
+    printf("  <file>    Assembly to check (default bits.s)\n");
+    printf("Functions are proved equal to reference circuits transcribed by hand from\n");
+    printf("bits_test.c, which are only checked against bits_test.c on %d inputs each.\n",
+        ORACLE_CHECK_BLOCKS * 64);
+    exit(1);
+}
+
+// warn_undefined - Report the first read of a register before the function wrote it
+static void warn_undefined(check_t *ck, const x86_insn_t *insn, enum x86_reg reg, int width, int high8) {
+    if (ck->warned[reg]) {
+        return;
+    }
+    ck->warned[reg] = 1;
+    printf("WARNING: %s reads %%%s at line %d before writing it\n", ck->func_name,
+        x86_reg_name(reg, width, high8), insn->line);
+}
+
+// read_reg - Value of the low width bytes of a register, or %ah..%bh
+static void read_reg(check_t *ck, const sym_state_t *st, const x86_insn_t *insn,
+        enum x86_reg reg, int width, int high8, aig_word_t *out) {
+    uint8_t needed = high8 ? 0x02 : (uint8_t) ((1u << width) - 1);
+    if ((st->defined[reg] & needed) != needed) {
+        warn_undefined(ck, insn, reg, width, high8);
+    }
+    int shift = high8 ? 8 : 0;
+    for (int i = 0; i < 8 * width; i++) {
+        out->bit[i] = st->regs[reg].bit[i + shift];
+    }
+}
+
+// write_reg - Store into a register the way the hardware does: 32-bit writes
+// clear the upper half, 8 and 16-bit writes leave the rest alone
+static void write_reg(sym_state_t *st, enum x86_reg reg, int width, int high8, const aig_word_t *value) {
+    if (high8) {
+        for (int i = 0; i < 8; i++) {
+            st->regs[reg].bit[i + 8] = value->bit[i];
+        }
+        st->defined[reg] |= 0x02;
+        return;
+    }
+    for (int i = 0; i < 8 * width; i++) {
+        st->regs[reg].bit[i] = value->bit[i];
+    }
+    if (width == 4) {
+        for (int i = 32; i < 64; i++) {
+            st->regs[reg].bit[i] = AIG_FALSE;
+        }
+        st->defined[reg] = 0xff;
+    } else {
+        st->defined[reg] |= (uint8_t) ((1u << width) - 1);
+    }
+}
+
+// read_operand - Value of a register or immediate operand. Returns -1 for
+// memory operands, which aren't modeled.
+static int read_operand(check_t *ck, const sym_state_t *st, const x86_insn_t *insn,
+        const x86_operand_t *opnd, int width, aig_word_t *out) {
+    switch (opnd->kind) {
+        case OPND_REG:
+            read_reg(ck, st, insn, opnd->reg, width, opnd->high8, out);
+            return 0;
+        case OPND_IMM:
+            aig_word_const(out, opnd->imm, 8 * width);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// read_flag - Value of a flag, warning if nothing has set it yet
+static aig_lit_t read_flag(check_t *ck, const sym_state_t *st, const x86_insn_t *insn, enum flag f) {
+    if (!(st->flags_defined & (1 << f)) && !ck->warned_flags) {
+        ck->warned_flags = 1;
+        printf("WARNING: %s uses flags at line %d before setting them\n", ck->func_name, insn->line);
+    }
+    return st->flags[f];
+}
+
+// condition - Whether a condition code holds
+static aig_lit_t condition(check_t *ck, const sym_state_t *st, const x86_insn_t *insn) {
+    aig_t *g = &ck->g;
+    enum x86_cond cc = insn->cond;
+    aig_lit_t cf = AIG_FALSE, zf = AIG_FALSE, sf = AIG_FALSE, of = AIG_FALSE;
+    switch (cc) {
+        case CC_B: case CC_AE:
+            cf = read_flag(ck, st, insn, FLAG_CF);
+            break;
+        case CC_E: case CC_NE:
+            zf = read_flag(ck, st, insn, FLAG_ZF);
+            break;
+        case CC_BE: case CC_A:
+            cf = read_flag(ck, st, insn, FLAG_CF);
+            zf = read_flag(ck, st, insn, FLAG_ZF);
+            break;
+        case CC_S: case CC_NS:
+            sf = read_flag(ck, st, insn, FLAG_SF);
+            break;
+        case CC_O: case CC_NO:
+            of = read_flag(ck, st, insn, FLAG_OF);
+            break;
+        case CC_L: case CC_GE:
+            sf = read_flag(ck, st, insn, FLAG_SF);
+            of = read_flag(ck, st, insn, FLAG_OF);
+            break;
+        case CC_LE: case CC_G:
+            zf = read_flag(ck, st, insn, FLAG_ZF);
+            sf = read_flag(ck, st, insn, FLAG_SF);
+            of = read_flag(ck, st, insn, FLAG_OF);
+            break;
+    }
+    switch (cc) {
+        case CC_O: return of;
+        case CC_NO: return aig_negate(of);
+        case CC_B: return cf;
+        case CC_AE: return aig_negate(cf);
+        case CC_E: return zf;
+        case CC_NE: return aig_negate(zf);
+        case CC_BE: return aig_or(g, cf, zf);
+        case CC_A: return aig_negate(aig_or(g, cf, zf));
+        case CC_S: return sf;
+        case CC_NS: return aig_negate(sf);
+        case CC_L: return aig_xor(g, sf, of);
+        case CC_GE: return aig_negate(aig_xor(g, sf, of));
+        case CC_LE: return aig_or(g, zf, aig_xor(g, sf, of));
+        case CC_G: return aig_negate(aig_or(g, zf, aig_xor(g, sf, of)));
+    }
+    return AIG_FALSE;
+}
+
+// set_result_flags - Set ZF and SF from a result, and CF and OF as given
+static void set_result_flags(check_t *ck, sym_state_t *st, const aig_word_t *res, int bits,
+        aig_lit_t cf, aig_lit_t of) {
+    st->flags[FLAG_CF] = cf;
+    st->flags[FLAG_OF] = of;
+    st->flags[FLAG_ZF] = aig_word_is_zero(&ck->g, res, bits);
+    st->flags[FLAG_SF] = res->bit[bits - 1];
+    st->flags_defined = (1 << NUM_FLAGS) - 1;
+}
+
+// shift_by - Shift a by a constant count as op does, with the flags it sets.
+// count must be at least 1.
+static void shift_by(aig_t *g, enum x86_op op, const aig_word_t *a, int count, int bits,
+        aig_word_t *res, aig_lit_t *cf, aig_lit_t *of) {
+    switch (op) {
+        case OP_SHL:
+            aig_word_shl(res, a, count, bits);
+            *cf = count <= bits ? a->bit[bits - count] : AIG_FALSE;
+            *of = aig_xor(g, res->bit[bits - 1], *cf);
+            break;
+        case OP_SHR:
+            aig_word_shr(res, a, count, bits);
+            *cf = count <= bits ? a->bit[count - 1] : AIG_FALSE;
+            *of = a->bit[bits - 1];
+            break;
+        default:
+            aig_word_sar(res, a, count, bits);
+            *cf = count <= bits ? a->bit[count - 1] : a->bit[bits - 1];
+            *of = AIG_FALSE;
+            break;
+    }
+}
+
+// exec_shift - Shift by an immediate or by %cl. A count of zero (after masking)
+// leaves the flags alone; a count in %cl is handled by trying every value.
+static void exec_shift(check_t *ck, sym_state_t *st, const x86_insn_t *insn, const aig_word_t *a,
+        aig_word_t *res) {
+    aig_t *g = &ck->g;
+    int bits = 8 * insn->width;
+    int mask = insn->width == 8 ? 63 : 31;
+    const x86_operand_t *count_opnd = &insn->operands[0];
+    aig_word_t shifted;
+    aig_lit_t cf, of;
+
+    if (count_opnd->kind == OPND_IMM) {
+        int count = count_opnd->imm & mask;
+        if (count == 0) {
+            *res = *a;
+            return;
+        }
+        shift_by(g, insn->op, a, count, bits, res, &cf, &of);
+        set_result_flags(ck, st, res, bits, cf, of);
+        return;
+    }
+
+    aig_word_t cl;
+    read_reg(ck, st, insn, REG_RCX, 1, 0, &cl);
+    aig_lit_t flags[NUM_FLAGS];
+    memcpy(flags, st->flags, sizeof(flags));
+    int was_defined = st->flags_defined;
+    *res = *a;
+    for (int count = 1; count <= mask; count++) {
+        aig_lit_t is_count = aig_word_eq_const(g, &cl, count, mask == 63 ? 6 : 5);
+        shift_by(g, insn->op, a, count, bits, &shifted, &cf, &of);
+        aig_word_ite(g, res, is_count, &shifted, res, bits);
+        aig_lit_t zf = aig_word_is_zero(g, &shifted, bits);
+        flags[FLAG_CF] = aig_ite(g, is_count, cf, flags[FLAG_CF]);
+        flags[FLAG_OF] = aig_ite(g, is_count, of, flags[FLAG_OF]);
+        flags[FLAG_ZF] = aig_ite(g, is_count, zf, flags[FLAG_ZF]);
+        flags[FLAG_SF] = aig_ite(g, is_count, shifted.bit[bits - 1], flags[FLAG_SF]);
+    }
+    memcpy(st->flags, flags, sizeof(flags));
+    st->flags_defined = was_defined | ((1 << NUM_FLAGS) - 1);
+}
+
+// exec_insn - Execute an instruction other than a jump or ret. Returns NULL,
+// or a reason the function can't be checked.
+static const char *exec_insn(check_t *ck, sym_state_t *st, const x86_insn_t *insn) {
+    aig_t *g = &ck->g;
+    int width = insn->width;
+    int bits = 8 * width;
+    const x86_operand_t *src = &insn->operands[0];
+    const x86_operand_t *dst = &insn->operands[insn->n_operands - 1];
+    aig_word_t a, b, res;
+    aig_lit_t cf, of;
+
+    switch (insn->op) {
+        case OP_MOV:
+            if (read_operand(ck, st, insn, src, width, &a) != 0) {
+                return "unsupported source";
+            }
+            write_reg(st, dst->reg, width, dst->high8, &a);
+            return NULL;
+
+        case OP_MOVZ:
+        case OP_MOVS: {
+            int src_bits = 8 * insn->src_width;
+            read_reg(ck, st, insn, src->reg, insn->src_width, src->high8, &a);
+            for (int i = src_bits; i < bits; i++) {
+                a.bit[i] = insn->op == OP_MOVS ? a.bit[src_bits - 1] : AIG_FALSE;
+            }
+            write_reg(st, dst->reg, width, dst->high8, &a);
+            return NULL;
+        }
+
+        case OP_LEA:
+            /* The low bits of an address only depend on the low bits of the
+               registers, so only width bytes of them are read */
+            aig_word_const(&res, src->imm, bits);
+            if (src->base != REG_NONE) {
+                read_reg(ck, st, insn, src->base, width, 0, &a);
+                aig_word_add(g, &res, &res, &a, AIG_FALSE, bits, NULL, NULL);
+            }
+            if (src->index != REG_NONE) {
+                read_reg(ck, st, insn, src->index, width, 0, &a);
+                aig_word_shl(&a, &a, __builtin_ctz(src->scale), bits);
+                aig_word_add(g, &res, &res, &a, AIG_FALSE, bits, NULL, NULL);
+            }
+            write_reg(st, dst->reg, width, dst->high8, &res);
+            return NULL;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_CMP:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_TEST:
+            /* xor and sub of a register with itself give zero whatever it held */
+            if ((insn->op == OP_XOR || insn->op == OP_SUB) && src->kind == OPND_REG &&
+                    src->reg == dst->reg && src->high8 == dst->high8) {
+                aig_word_const(&res, 0, bits);
+                write_reg(st, dst->reg, width, dst->high8, &res);
+                set_result_flags(ck, st, &res, bits, AIG_FALSE, AIG_FALSE);
+                return NULL;
+            }
+            if (read_operand(ck, st, insn, src, width, &b) != 0 ||
+                    read_operand(ck, st, insn, dst, width, &a) != 0) {
+                return "unsupported operand";
+            }
+            switch (insn->op) {
+                case OP_ADD:
+                    aig_word_add(g, &res, &a, &b, AIG_FALSE, bits, &cf, &of);
+                    break;
+                case OP_SUB:
+                case OP_CMP:
+                    aig_word_not(&b, &b, bits);
+                    aig_word_add(g, &res, &a, &b, AIG_TRUE, bits, &cf, &of);
+                    cf = aig_negate(cf);
+                    break;
+                case OP_AND:
+                case OP_TEST:
+                    aig_word_and(g, &res, &a, &b, bits);
+                    cf = of = AIG_FALSE;
+                    break;
+                case OP_OR:
+                    aig_word_or(g, &res, &a, &b, bits);
+                    cf = of = AIG_FALSE;
+                    break;
+                default:
+                    aig_word_xor(g, &res, &a, &b, bits);
+                    cf = of = AIG_FALSE;
+                    break;
+            }
+            set_result_flags(ck, st, &res, bits, cf, of);
+            if (insn->op != OP_CMP && insn->op != OP_TEST) {
+                write_reg(st, dst->reg, width, dst->high8, &res);
+            }
+            return NULL;
+
+        case OP_NOT:
+            read_reg(ck, st, insn, dst->reg, width, dst->high8, &a);
+            aig_word_not(&res, &a, bits);
+            write_reg(st, dst->reg, width, dst->high8, &res);
+            return NULL;
+
+        case OP_NEG:
+            read_reg(ck, st, insn, dst->reg, width, dst->high8, &a);
+            aig_word_const(&b, 0, bits);
+            aig_word_not(&a, &a, bits);
+            aig_word_add(g, &res, &b, &a, AIG_TRUE, bits, &cf, &of);
+            set_result_flags(ck, st, &res, bits, aig_negate(cf), of);
+            write_reg(st, dst->reg, width, dst->high8, &res);
+            return NULL;
+
+        case OP_INC:
+        case OP_DEC: {
+            /* Like add and sub of 1, but the carry flag is left alone */
+            aig_lit_t old_cf = st->flags[FLAG_CF];
+            int old_defined = st->flags_defined;
+            read_reg(ck, st, insn, dst->reg, width, dst->high8, &a);
+            aig_word_const(&b, insn->op == OP_INC ? 1 : UINT64_MAX, bits);
+            aig_word_add(g, &res, &a, &b, AIG_FALSE, bits, NULL, &of);
+            set_result_flags(ck, st, &res, bits, old_cf, of);
+            st->flags_defined = (old_defined & (1 << FLAG_CF)) | ~(1 << FLAG_CF);
+            write_reg(st, dst->reg, width, dst->high8, &res);
+            return NULL;
+        }
+
+        case OP_SHL:
+        case OP_SHR:
+        case OP_SAR:
+            read_reg(ck, st, insn, dst->reg, width, dst->high8, &a);
+            exec_shift(ck, st, insn, &a, &res);
+            write_reg(st, dst->reg, width, dst->high8, &res);
+            return NULL;
+
+        case OP_SETCC:
+            aig_word_const(&res, 0, 8);
+            res.bit[0] = condition(ck, st, insn);
+            write_reg(st, dst->reg, 1, dst->high8, &res);
+            return NULL;
+
+        case OP_CMOVCC: {
+            aig_lit_t c = condition(ck, st, insn);
+            read_reg(ck, st, insn, src->reg, width, 0, &b);
+            read_reg(ck, st, insn, dst->reg, width, 0, &a);
+            aig_word_ite(g, &res, c, &b, &a, bits);
+            write_reg(st, dst->reg, width, 0, &res);
+            return NULL;
+        }
+
+        case OP_PUSH:
+            if (st->depth == MAX_STACK) {
+                return "too many values pushed";
+            }
+            /* Saving a register that hasn't been written is fine, so definedness
+               travels with the value */
+            if (src->kind == OPND_REG) {
+                st->stack[st->depth] = st->regs[src->reg];
+                st->stack_defined[st->depth] = st->defined[src->reg];
+            } else {
+                aig_word_const(&st->stack[st->depth], src->imm, 64);
+                st->stack_defined[st->depth] = 0xff;
+            }
+            st->depth++;
+            return NULL;
+
+        case OP_POP:
+            /* Checked by the caller */
+            st->depth--;
+            st->regs[dst->reg] = st->stack[st->depth];
+            st->defined[dst->reg] = st->stack_defined[st->depth];
+            return NULL;
+
+        case OP_NOP:
+            return NULL;
+
+        default:
+            return "unsupported instruction";
+    }
+}
+
+// simulate_new - Bring the simulation vectors up to date with the circuit
+static void simulate_new(check_t *ck) {
+    const aig_t *g = &ck->g;
+    if (g->n_nodes > ck->sim_cap) {
+        ck->sim_cap = g->n_nodes * 2;
+        ck->sim_values = realloc(ck->sim_values, ck->sim_cap * sizeof(uint64_t));
+        if (ck->sim_values == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    for (uint32_t n = ck->n_simulated; n < g->n_nodes; n++) {
+        const aig_node_t *node = &g->nodes[n];
+        if (n == 0) {
+            ck->sim_values[n] = 0;
+        } else if (node->input >= 0) {
+            ck->sim_values[n] = ck->sim_inputs[node->input];
+        } else {
+            ck->sim_values[n] = aig_sim_lit(ck->sim_values, node->fanin[0]) &
+                aig_sim_lit(ck->sim_values, node->fanin[1]);
+        }
+    }
+    ck->n_simulated = g->n_nodes;
+}
+
+// feasible - Can lit be true? Simulation answers most of these without the solver.
+// Returns 1 if so, 0 if not, -1 if the solver gave up.
+static int feasible(check_t *ck, aig_lit_t lit) {
+    simulate_new(ck);
+    if (aig_sim_lit(ck->sim_values, lit) != 0) {
+        return 1;
+    }
+    switch (aig_sat(&ck->g, lit, CONFLICT_LIMIT, NULL)) {
+        case AIG_SAT: return 1;
+        case AIG_UNSAT: return 0;
+        default: return -1;
+    }
+}
+
+// path_error - Record that the inputs taking a path make the function go wrong
+static void path_error(check_t *ck, const sym_state_t *st, int line, const char *message) {
+    ck->failed = aig_or(&ck->g, ck->failed, st->cond);
+    if (ck->n_errors < MAX_PATH_ERRORS) {
+        path_error_t *e = &ck->errors[ck->n_errors++];
+        e->cond = st->cond;
+        e->line = line;
+        snprintf(e->message, sizeof(e->message), "%s", message);
+    }
+}
+
+// accesses_memory - Does an instruction have a memory operand?
+static int accesses_memory(const x86_insn_t *insn) {
+    for (unsigned i = 0; i < insn->n_operands; i++) {
+        if (insn->operands[i].kind == OPND_MEM) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// explore - Run every feasible path from the function's entry point
+static void explore(check_t *ck, const x86_program_t *prog, const sym_state_t *entry) {
+    sym_state_t *pending = malloc(MAX_PATHS * sizeof(sym_state_t));
+    if (pending == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    unsigned n_pending = 0;
+    pending[n_pending++] = *entry;
+
+    while (n_pending > 0 && !ck->aborted) {
+        sym_state_t st = pending[--n_pending];
+        for (;;) {
+            if (st.pc < 0 || (unsigned) st.pc >= prog->n_insns) {
+                path_error(ck, &st, prog->n_insns ? prog->insns[prog->n_insns - 1].line : 0,
+                    "runs past the end of the file");
+                break;
+            }
+            const x86_insn_t *insn = &prog->insns[st.pc];
+            if (st.steps++ >= fuel) {
+                char message[96];
+                snprintf(message, sizeof(message), "doesn't return within %u instructions", fuel);
+                path_error(ck, &st, insn->line, message);
+                break;
+            }
+
+            if (insn->op == OP_RET) {
+                if (st.depth != 0) {
+                    path_error(ck, &st, insn->line, "returns without popping what it pushed");
+                    break;
+                }
+                aig_word_t eax;
+                read_reg(ck, &st, insn, REG_RAX, 4, 0, &eax);
+                aig_word_ite(&ck->g, &ck->result, st.cond, &eax, &ck->result, 32);
+                ck->returned = aig_or(&ck->g, ck->returned, st.cond);
+                break;
+            }
+            if (insn->op == OP_POP && st.depth == 0) {
+                path_error(ck, &st, insn->line, "pops more than it pushed");
+                break;
+            }
+            if (insn->op != OP_LEA && accesses_memory(insn)) {
+                /* Memory isn't modeled, and solutions have no business using it */
+                path_error(ck, &st, insn->line, "accesses memory, which bitcheck doesn't model");
+                break;
+            }
+            if (insn->op != OP_JMP && insn->op != OP_JCC) {
+                const char *error = exec_insn(ck, &st, insn);
+                if (error != NULL) {
+                    printf("%s: line %d: %s, cannot check\n", ck->func_name, insn->line, error);
+                    ck->aborted = 1;
+                    break;
+                }
+                st.pc++;
+                continue;
+            }
+
+            /* Jumps: follow whichever sides some input can take, saving the
+               taken side for later if both can */
+            aig_lit_t taken = st.cond, not_taken = AIG_FALSE;
+            int can_take = 1, can_skip = 0;
+            if (insn->op == OP_JCC) {
+                aig_lit_t c = condition(ck, &st, insn);
+                taken = aig_and(&ck->g, st.cond, c);
+                not_taken = aig_and(&ck->g, st.cond, aig_negate(c));
+                can_take = feasible(ck, taken);
+                can_skip = feasible(ck, not_taken);
+                if (can_take < 0 || can_skip < 0) {
+                    printf("%s: line %d: branch too hard to decide, cannot check\n", ck->func_name,
+                        insn->line);
+                    ck->aborted = 1;
+                    break;
+                }
+            }
+            int target = insn->operands[0].target;
+            if (can_take && target < 0) {
+                sym_state_t bad = st;
+                bad.cond = taken;
+                path_error(ck, &bad, insn->line, "jumps to an undefined label");
+            } else if (can_take && can_skip) {
+                if (n_pending == MAX_PATHS) {
+                    printf("%s: more than %d paths, cannot check\n", ck->func_name, MAX_PATHS);
+                    ck->aborted = 1;
+                    break;
+                }
+                sym_state_t *fork = &pending[n_pending++];
+                *fork = st;
+                fork->cond = taken;
+                fork->pc = target;
+            } else if (can_take) {
+                st.pc = target;
+                continue;
+            }
+            if (!can_skip) {
+                break;
+            }
+            st.cond = not_taken;
+            st.pc++;
+        }
+    }
+    free(pending);
+}
+
+// shift_right_by - Logical shift by the low 5 bits of n, as a barrel shifter
+static void shift_right_by(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *n) {
+    aig_word_t shifted;
+    *out = *a;
+    for (int k = 0; k < 5; k++) {
+        aig_word_shr(&shifted, out, 1 << k, 32);
+        aig_word_ite(g, out, n->bit[k], &shifted, out, 32);
+    }
+}
+
+// rotate_right_by - Rotate by the low 5 bits of n
+static void rotate_right_by(aig_t *g, aig_word_t *out, const aig_word_t *a, const aig_word_t *n) {
+    aig_word_t rotated;
+    *out = *a;
+    for (int k = 0; k < 5; k++) {
+        for (int i = 0; i < 32; i++) {
+            rotated.bit[i] = out->bit[(i + (1 << k)) % 32];
+        }
+        aig_word_ite(g, out, n->bit[k], &rotated, out, 32);
+    }
+}
+
+// float_double - Bit pattern of 2*f for a float that isn't NaN. Doubling is
+// exact, so it only moves the exponent, or the fraction of a denormal (which
+// carries into the exponent the way it should), or overflows to infinity.
+static void float_double(aig_t *g, aig_word_t *out, const aig_word_t *uf) {
+    aig_word_t exp, denorm, norm, inf, one_exp;
+    aig_word_const(&exp, 0, 32);
+    for (int i = 0; i < 8; i++) {
+        exp.bit[i] = uf->bit[23 + i];
+    }
+    aig_lit_t exp_zero = aig_word_is_zero(g, &exp, 8);
+    aig_lit_t exp_max = aig_word_eq_const(g, &exp, 0xff, 8);
+    aig_lit_t exp_overflows = aig_word_eq_const(g, &exp, 0xfe, 8);
+
+    aig_word_shl(&denorm, uf, 1, 31);
+    denorm.bit[31] = uf->bit[31];
+    aig_word_const(&one_exp, 1 << 23, 32);
+    aig_word_add(g, &norm, uf, &one_exp, AIG_FALSE, 32, NULL, NULL);
+    aig_word_const(&inf, 0x7f800000, 32);
+    inf.bit[31] = uf->bit[31];
+
+    aig_word_ite(g, out, exp_overflows, &inf, &norm, 32);
+    aig_word_ite(g, out, exp_max, uf, out, 32);
+    aig_word_ite(g, out, exp_zero, &denorm, out, 32);
+}
+
+// oracle_circuit - Circuit for the reference implementation of a function,
+// transcribed by hand from bits_test.c. Change it whenever bits_test.c changes.
+static void oracle_circuit(check_t *ck, aig_word_t *out) {
+    aig_t *g = &ck->g;
+    const aig_word_t *x = &ck->args[0], *y = &ck->args[1];
+    aig_word_t t;
+    aig_word_const(out, 0, 32);
+    switch (ck->func) {
+        case BIT_MATCH:
+            aig_word_xor(g, out, x, y, 32);
+            aig_word_not(out, out, 32);
+            break;
+        case EVEN_BITS:
+            aig_word_const(out, 0x55555555, 32);
+            break;
+        case ALL_ODD_BITS:
+            out->bit[0] = AIG_TRUE;
+            for (int i = 1; i < 32; i += 2) {
+                out->bit[0] = aig_and(g, out->bit[0], x->bit[i]);
+            }
+            break;
+        case FLOAT_ABS_VAL: {
+            aig_lit_t exp_max = AIG_TRUE;
+            for (int i = 23; i < 31; i++) {
+                exp_max = aig_and(g, exp_max, x->bit[i]);
+            }
+            aig_lit_t is_nan = aig_and(g, exp_max, aig_negate(aig_word_is_zero(g, x, 23)));
+            *out = *x;
+            out->bit[31] = aig_and(g, is_nan, x->bit[31]);
+            break;
+        }
+        case IMPLICATION:
+            out->bit[0] = aig_negate(aig_and(g, x->bit[0], aig_word_is_zero(g, y, 32)));
+            break;
+        case IS_NEGATIVE:
+            out->bit[0] = x->bit[31];
+            break;
+        case SIGN: {
+            aig_lit_t zero = aig_word_is_zero(g, x, 32);
+            out->bit[0] = aig_negate(zero);
+            for (int i = 1; i < 32; i++) {
+                out->bit[i] = x->bit[31];
+            }
+            break;
+        }
+        case IS_GREATER:
+            out->bit[0] = aig_word_slt(g, y, x, 32);
+            break;
+        case LOGICAL_SHIFT:
+            shift_right_by(g, out, x, y);
+            break;
+        case ROTATE_RIGHT:
+            rotate_right_by(g, out, x, y);
+            break;
+        case FLOAT_SCALE_4: {
+            aig_lit_t exp_max = AIG_TRUE;
+            for (int i = 23; i < 31; i++) {
+                exp_max = aig_and(g, exp_max, x->bit[i]);
+            }
+            aig_lit_t is_nan = aig_and(g, exp_max, aig_negate(aig_word_is_zero(g, x, 23)));
+            float_double(g, &t, x);
+            float_double(g, out, &t);
+            aig_word_ite(g, out, is_nan, x, out, 32);
+            break;
+        }
+        case GREATEST_BIT_POS: {
+            aig_lit_t higher = AIG_FALSE;
+            for (int i = 31; i >= 0; i--) {
+                out->bit[i] = aig_and(g, x->bit[i], aig_negate(higher));
+                higher = aig_or(g, higher, x->bit[i]);
+            }
+            break;
+        }
+    }
+}
+
+// reference_value - Output of the bits_test.c reference implementation
+static int reference_value(enum function_id func, int x, int y) {
+    switch (func) {
+        case BIT_MATCH: return test_bitMatch(x, y);
+        case EVEN_BITS: return test_evenBits();
+        case ALL_ODD_BITS: return test_allOddBits(x);
+        case FLOAT_ABS_VAL: return test_floatAbsVal(x);
+        case IMPLICATION: return test_implication(x, y);
+        case IS_NEGATIVE: return test_isNegative(x);
+        case SIGN: return test_sign(x);
+        case IS_GREATER: return test_isGreater(x, y);
+        case LOGICAL_SHIFT: return test_logicalShift(x, y);
+        case ROTATE_RIGHT: return test_rotateRight(x, y);
+        case FLOAT_SCALE_4: return test_floatScale4(x);
+        case GREATEST_BIT_POS: return test_greatestBitPos(x);
+    }
+    return 0;
+}
+
+// arg_range - Inputs a function is specified for. Float arguments can be any bit pattern.
+static void arg_range(enum function_id func, int arg_pos, int *min, int *max) {
+    if (func == FLOAT_ABS_VAL || func == FLOAT_SCALE_4) {
+        *min = INT32_MIN;
+        *max = INT32_MAX;
+        return;
+    }
+    *min = getFuncMinArg(func, arg_pos + 1);
+    *max = getFuncMaxArg(func, arg_pos + 1);
+}
+
+// pick_arg - The counter-th argument value used to check circuits: boundary
+// values first, then random ones, all between the argument's min and max
+static int pick_arg(enum function_id func, int arg_pos, uint64_t counter) {
+    static const int64_t boundaries[] = {
+        0, 1, -1, INT32_MIN, INT32_MIN + 1, INT32_MAX, INT32_MAX - 1, 31, 32,
+        0x7f800000, 0x7fc00000, 0x7f7fffff, 0x7f000000, 0x00800000, 0x007fffff, 0x00400000,
+        0x3f800000, 0xff800000, 0x80000001,
+    };
+    const unsigned n_boundaries = sizeof(boundaries) / sizeof(boundaries[0]);
+    int min, max;
+    arg_range(func, arg_pos, &min, &max);
+    if (counter < (uint64_t) n_boundaries * n_boundaries) {
+        int64_t v = (int32_t) boundaries[arg_pos == 0 ? counter / n_boundaries : counter % n_boundaries];
+        if (v >= min && v <= max) {
+            return v;
+        }
+    }
+    return rng_range(rng_stream(RNG_SEED_DEFAULT, func * 2 + arg_pos), counter, min, max);
+}
+
+// set_lane - Put argument values into one lane of a set of simulation inputs
+static void set_lane(const check_t *ck, uint64_t *inputs, int lane, const int *vals) {
+    for (unsigned a = 0; a < ck->num_args; a++) {
+        for (int b = 0; b < 32; b++) {
+            int32_t input = ck->g.nodes[aig_node(ck->args[a].bit[b])].input;
+            uint64_t bit = (uint64_t) 1 << lane;
+            inputs[input] = ((vals[a] >> b) & 1) ? inputs[input] | bit : inputs[input] & ~bit;
+        }
+    }
+}
+
+// lane_word - Value of a word in one lane of a simulation
+static uint32_t lane_word(const uint64_t *values, const aig_word_t *w, int lane) {
+    uint32_t v = 0;
+    for (int b = 0; b < 32; b++) {
+        v |= (uint32_t) ((aig_sim_lit(values, w->bit[b]) >> lane) & 1) << b;
+    }
+    return v;
+}
+
+// check_oracle - Compare the reference circuit with bits_test.c. Returns 0 if they agree.
+static int check_oracle(check_t *ck, const aig_word_t *oracle) {
+    uint64_t *inputs = calloc(ck->g.n_inputs, sizeof(uint64_t));
+    uint64_t *values = malloc(ck->g.n_nodes * sizeof(uint64_t));
+    if (inputs == NULL || values == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    int ret = 0;
+    for (int block = 0; block < ORACLE_CHECK_BLOCKS && ret == 0; block++) {
+        int vals[64][2] = {};
+        for (int lane = 0; lane < 64; lane++) {
+            for (unsigned a = 0; a < ck->num_args; a++) {
+                vals[lane][a] = pick_arg(ck->func, a, (uint64_t) block * 64 + lane);
+            }
+            set_lane(ck, inputs, lane, vals[lane]);
+        }
+        aig_simulate(&ck->g, inputs, values);
+        for (int lane = 0; lane < 64; lane++) {
+            int got = lane_word(values, oracle, lane);
+            int want = reference_value(ck->func, vals[lane][0], vals[lane][1]);
+            if (got != want) {
+                printf("%s: internal error: reference circuit gives 0x%x for (0x%x, 0x%x), not 0x%x\n",
+                    ck->func_name, got, vals[lane][0], vals[lane][1], want);
+                ret = -1;
+                break;
+            }
+        }
+    }
+    free(inputs);
+    free(values);
+    return ret;
+}
+
+// print_counterexample - Show the inputs in a lane of the simulation where
+// the function goes wrong, in btest's format
+static void print_counterexample(const check_t *ck, const uint64_t *values, int lane,
+        const aig_word_t *oracle) {
+    function_result_t result = { .function_id = ck->func };
+    result.arg1 = ck->num_args > 0 ? (int) lane_word(values, &ck->args[0], lane) : 0;
+    result.arg2 = ck->num_args > 1 ? (int) lane_word(values, &ck->args[1], lane) : 0;
+    result.actual_output = lane_word(values, &ck->result, lane);
+    result.expected_output = lane_word(values, oracle, lane);
+
+    printf("ERROR: Test %s(", ck->func_name);
+    if (ck->num_args > 0) {
+        printf("%d[0x%x]", result.arg1, result.arg1);
+    }
+    if (ck->num_args > 1) {
+        printf(", %d[0x%x]", result.arg2, result.arg2);
+    }
+
+    const path_error_t *error = NULL;
+    for (unsigned i = 0; i < ck->n_errors && error == NULL; i++) {
+        if ((aig_sim_lit(values, ck->errors[i].cond) >> lane) & 1) {
+            error = &ck->errors[i];
+        }
+    }
+    if (error != NULL) {
+        printf(") failed.\n  At line %d: %s\n", error->line, error->message);
+    } else {
+        printf(") failed...\n");
+        printf("...Gives %d[0x%x].  Should be %d[0x%x]\n", result.actual_output,
+            result.actual_output, result.expected_output, result.expected_output);
+    }
+
+    /* Registers it read before writing matter too */
+    for (int r = 0; r < X86_NUM_REGS; r++) {
+        if (!ck->warned[r]) {
+            continue;
+        }
+        uint64_t v = 0;
+        for (int b = 0; b < 64; b++) {
+            v |= ((aig_sim_lit(values, ck->initial[r].bit[b]) >> lane) & 1) << b;
+        }
+        printf("  with %%%s = 0x%llx on entry\n", x86_reg_name(r, 8, 0), (unsigned long long) v);
+    }
+}
+
+// check_function - Prove one function equal to its reference version. Returns
+// 0 if it is, 1 if it isn't, -1 if that couldn't be decided.
+static int check_function(const x86_program_t *prog, enum function_id func) {
+    check_t ck = {
+        .func = func,
+        .num_args = getNumArgs(func),
+        .func_name = getFuncName(func),
+    };
+    int entry = x86_find_label(prog, ck.func_name);
+    if (entry < 0) {
+        printf("%s: not defined\n", ck.func_name);
+        return 1;
+    }
+
+    aig_t *g = &ck.g;
+    aig_init(g);
+    for (unsigned a = 0; a < ck.num_args; a++) {
+        aig_word_input(g, &ck.args[a], 32);
+    }
+    for (int r = 0; r < X86_NUM_REGS; r++) {
+        aig_word_input(g, &ck.initial[r], 64);
+    }
+    static const enum x86_reg arg_regs[] = { REG_RDI, REG_RSI };
+    for (unsigned a = 0; a < ck.num_args; a++) {
+        memcpy(ck.initial[arg_regs[a]].bit, ck.args[a].bit, 32 * sizeof(aig_lit_t));
+    }
+    aig_lit_t initial_flags[NUM_FLAGS];
+    for (int f = 0; f < NUM_FLAGS; f++) {
+        initial_flags[f] = aig_input(g);
+    }
+
+    aig_word_t oracle;
+    oracle_circuit(&ck, &oracle);
+    if (check_oracle(&ck, &oracle) != 0) {
+        aig_free(g);
+        return -1;
+    }
+
+    /* Simulation lanes: arguments in range, registers random */
+    ck.sim_inputs = malloc(g->n_inputs * sizeof(uint64_t));
+    if (ck.sim_inputs == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    uint64_t stream = rng_stream(RNG_SEED_DEFAULT, NUM_PUZZLES * 2 + func);
+    for (uint32_t i = 0; i < g->n_inputs; i++) {
+        ck.sim_inputs[i] = rng_at(stream, i);
+    }
+    for (int lane = 0; lane < 64; lane++) {
+        int vals[2];
+        for (unsigned a = 0; a < ck.num_args; a++) {
+            vals[a] = pick_arg(func, a, rng_at(stream, g->n_inputs + lane) % 4096);
+        }
+        set_lane(&ck, ck.sim_inputs, lane, vals);
+    }
+
+    /* Only inputs in range count */
+    aig_lit_t in_range = AIG_TRUE;
+    double input_bits = 0;
+    for (unsigned a = 0; a < ck.num_args; a++) {
+        int min, max;
+        aig_word_t bound;
+        arg_range(func, a, &min, &max);
+        aig_word_const(&bound, min, 32);
+        in_range = aig_and(g, in_range, aig_negate(aig_word_slt(g, &ck.args[a], &bound, 32)));
+        aig_word_const(&bound, max, 32);
+        in_range = aig_and(g, in_range, aig_negate(aig_word_slt(g, &bound, &ck.args[a], 32)));
+        input_bits += log2((double) max - min + 1);
+    }
+
+    sym_state_t *st = calloc(1, sizeof(sym_state_t));
+    if (st == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    st->pc = entry;
+    st->cond = in_range;
+    memcpy(st->regs, ck.initial, sizeof(st->regs));
+    for (unsigned a = 0; a < ck.num_args; a++) {
+        st->defined[arg_regs[a]] = 0x0f;
+    }
+    st->defined[REG_RSP] = 0xff;
+    memcpy(st->flags, initial_flags, sizeof(st->flags));
+    aig_word_const(&ck.result, 0, 32);
+    ck.returned = ck.failed = AIG_FALSE;
+    explore(&ck, prog, st);
+    free(st);
+
+    int ret = -1;
+    if (!ck.aborted) {
+        aig_lit_t differs = aig_negate(aig_word_eq(g, &ck.result, &oracle, 32));
+        aig_lit_t bad = aig_or(g, ck.failed, aig_and(g, ck.returned, differs));
+
+        /* Simulation often finds a counterexample without the solver */
+        simulate_new(&ck);
+        uint64_t lanes = aig_sim_lit(ck.sim_values, bad);
+        uint8_t *model = malloc(g->n_inputs);
+        enum aig_sat_result sat = lanes ? AIG_SAT : aig_sat(g, bad, CONFLICT_LIMIT, model);
+        if (sat == AIG_UNSAT) {
+            if (ck.num_args == 0) {
+                printf("%s: equal to the reference circuit\n", ck.func_name);
+            } else {
+                printf("%s: equal to the reference circuit for all 2^%g inputs\n", ck.func_name,
+                    input_bits);
+            }
+            ret = 0;
+        } else if (sat == AIG_UNKNOWN) {
+            printf("%s: solver gave up, cannot check\n", ck.func_name);
+        } else {
+            int lane = 0;
+            if (lanes) {
+                lane = __builtin_ctzll(lanes);
+            } else {
+                /* Put the solver's model in lane 0 */
+                for (uint32_t i = 0; i < g->n_inputs; i++) {
+                    ck.sim_inputs[i] = model[i];
+                }
+                ck.n_simulated = 0;
+                simulate_new(&ck);
+            }
+            print_counterexample(&ck, ck.sim_values, lane, &oracle);
+            ret = 1;
+        }
+        free(model);
+    }
+
+    free(ck.sim_inputs);
+    free(ck.sim_values);
+    aig_free(g);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    char c;
+    const char *only_fname = NULL;
+    while ((c = getopt(argc, argv, "hf:F:")) != -1) {
+        switch (c) {
+            case 'f':
+                only_fname = optarg;
+                if (getFuncId(only_fname) == -1) {
+                    printf("%s: Unknown function name\n", only_fname);
+                    return 1;
+                }
+                break;
+            case 'F':
+                if (atoi(optarg) < 1) {
+                    usage(argv[0]);
+                }
+                fuel = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc - 1) {
+        usage(argv[0]);
+    }
+    const char *path = optind < argc ? argv[optind] : "bits.s";
+
+    x86_program_t prog;
+    if (x86_parse_file(path, &prog) != 0) {
+        return 1;
+    }
+
+    int n_checked = 0, n_equal = 0;
+    for (int func = 0; func < NUM_PUZZLES; func++) {
+        if (only_fname != NULL && strcmp(only_fname, getFuncName(func)) != 0) {
+            continue;
+        }
+        n_checked++;
+        if (check_function(&prog, func) == 0) {
+            n_equal++;
+        }
+    }
+    printf("%d of %d functions proved equal to the reference circuits\n", n_equal, n_checked);
+    x86_free(&prog);
+    return n_equal == n_checked ? 0 : 1;
+}
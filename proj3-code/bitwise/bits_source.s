@@ -0,0 +1,8 @@
+# Embeds the text of bits.s in btest, so test results can be cached
+# against the exact function bodies that were assembled into it
+	.section .rodata
+	.global bits_source
+bits_source:
+	.incbin "bits.s"
+	.byte 0
+	.section .note.GNU-stack,"",@progbits
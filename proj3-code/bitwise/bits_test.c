@@ -2,6 +2,9 @@
 
 #include <limits.h>
 #include <math.h>
+#include <stddef.h>
+
+#include "bits_test_batch.h"
 
 /* Routines used by floating point test code */
 
@@ -120,3 +123,235 @@ int test_greatestBitPos(int x) {
     }
     return mask;
 }
+
+/*
+ * Batch versions of the reference implementations, used by the server
+ * to check a whole batch of results at once. Each one gives exactly the
+ * same result as calling the scalar version above on every element. On
+ * CPUs with AVX2, eight elements are computed per step. Otherwise, or
+ * for whatever is left over, the scalar versions are used.
+ */
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNELS 1
+#endif
+
+#ifdef HAVE_AVX2_KERNELS
+static int have_avx2(void) {
+    static int checked = 0;
+    static int supported = 0;
+    if (!checked) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2");
+        checked = 1;
+    }
+    return supported;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+#define LOAD(p) _mm256_loadu_si256((const __m256i *) (p))
+#define STORE(p, v) _mm256_storeu_si256((__m256i *) (p), (v))
+
+/* Each kernel handles the largest multiple of 8 elements and returns how many it did */
+
+AVX2 static size_t bitMatch_avx2(const int *x, const int *y, int *out, size_t len) {
+    size_t i;
+    __m256i ones = _mm256_set1_epi32(-1);
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i diff = _mm256_xor_si256(LOAD(x + i), LOAD(y + i));
+        STORE(out + i, _mm256_xor_si256(diff, ones));
+    }
+    return i;
+}
+
+AVX2 static size_t allOddBits_avx2(const int *x, int *out, size_t len) {
+    size_t i;
+    __m256i odd = _mm256_set1_epi32(0xAAAAAAAA);
+    __m256i one = _mm256_set1_epi32(1);
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i all_set = _mm256_cmpeq_epi32(_mm256_and_si256(LOAD(x + i), odd), odd);
+        STORE(out + i, _mm256_and_si256(all_set, one));
+    }
+    return i;
+}
+
+AVX2 static size_t floatAbsVal_avx2(const unsigned *uf, unsigned *out, size_t len) {
+    size_t i;
+    __m256i magnitude_mask = _mm256_set1_epi32(0x7FFFFFFF);
+    __m256i inf = _mm256_set1_epi32(0x7F800000);
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i u = LOAD(uf + i);
+        __m256i magnitude = _mm256_and_si256(u, magnitude_mask);
+        /* NaN: magnitude above that of inf (signed compare is safe, sign bit is clear) */
+        __m256i is_nan = _mm256_cmpgt_epi32(magnitude, inf);
+        STORE(out + i, _mm256_blendv_epi8(magnitude, u, is_nan));
+    }
+    return i;
+}
+
+AVX2 static size_t implication_avx2(const int *x, const int *y, int *out, size_t len) {
+    size_t i;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi32(1);
+    for (i = 0; i + 8 <= len; i += 8) {
+        /* !(x & !y): false only when y == 0 and bit 0 of x is set */
+        __m256i y_zero = _mm256_cmpeq_epi32(LOAD(y + i), zero);
+        __m256i x_and_not_y = _mm256_and_si256(_mm256_and_si256(LOAD(x + i), one), y_zero);
+        STORE(out + i, _mm256_xor_si256(x_and_not_y, one));
+    }
+    return i;
+}
+
+AVX2 static size_t isNegative_avx2(const int *x, int *out, size_t len) {
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        STORE(out + i, _mm256_srli_epi32(LOAD(x + i), 31));
+    }
+    return i;
+}
+
+AVX2 static size_t sign_avx2(const int *x, int *out, size_t len) {
+    size_t i;
+    __m256i zero = _mm256_setzero_si256();
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i v = LOAD(x + i);
+        /* (x > 0) - (x < 0), with each comparison giving 0 or -1 */
+        __m256i pos = _mm256_cmpgt_epi32(v, zero);
+        __m256i neg = _mm256_cmpgt_epi32(zero, v);
+        STORE(out + i, _mm256_sub_epi32(neg, pos));
+    }
+    return i;
+}
+
+AVX2 static size_t isGreater_avx2(const int *x, const int *y, int *out, size_t len) {
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        STORE(out + i, _mm256_srli_epi32(_mm256_cmpgt_epi32(LOAD(x + i), LOAD(y + i)), 31));
+    }
+    return i;
+}
+
+AVX2 static size_t logicalShift_avx2(const int *x, const int *n, int *out, size_t len) {
+    size_t i;
+    /* The hardware shift in the scalar version only uses the low 5 bits of n */
+    __m256i count_mask = _mm256_set1_epi32(31);
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m256i count = _mm256_and_si256(LOAD(n + i), count_mask);
+        STORE(out + i, _mm256_srlv_epi32(LOAD(x + i), count));
+    }
+    return i;
+}
+
+AVX2 static size_t rotateRight_avx2(const int *x, const int *n, int *out, size_t len) {
+    size_t i;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i count_mask = _mm256_set1_epi32(31);
+    __m256i width = _mm256_set1_epi32(32);
+    for (i = 0; i + 8 <= len; i += 8) {
+        /* Rotating n >= 0 times one bit at a time rotates by n % 32, negative n rotates
+           not at all. A left shift by 32 gives 0 in AVX2, which covers n % 32 == 0. */
+        __m256i count = LOAD(n + i);
+        count = _mm256_andnot_si256(_mm256_cmpgt_epi32(zero, count), count);
+        count = _mm256_and_si256(count, count_mask);
+        __m256i u = LOAD(x + i);
+        __m256i right = _mm256_srlv_epi32(u, count);
+        __m256i left = _mm256_sllv_epi32(u, _mm256_sub_epi32(width, count));
+        STORE(out + i, _mm256_or_si256(right, left));
+    }
+    return i;
+}
+
+AVX2 static size_t greatestBitPos_avx2(const int *x, int *out, size_t len) {
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8) {
+        /* Smear the highest set bit into every lower position, then keep only the top one */
+        __m256i v = LOAD(x + i);
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 1));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 2));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 4));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 8));
+        v = _mm256_or_si256(v, _mm256_srli_epi32(v, 16));
+        STORE(out + i, _mm256_xor_si256(v, _mm256_srli_epi32(v, 1)));
+    }
+    return i;
+}
+
+#define VECTOR_PART(kernel, ...) (have_avx2() ? kernel(__VA_ARGS__) : 0)
+#else
+#define VECTOR_PART(kernel, ...) 0
+#endif // HAVE_AVX2_KERNELS
+
+void test_bitMatch_batch(const int *x, const int *y, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(bitMatch_avx2, x, y, out, len); i < len; i++) {
+        out[i] = test_bitMatch(x[i], y[i]);
+    }
+}
+
+void test_evenBits_batch(int *out, size_t len) {
+    int result = test_evenBits();
+    for (size_t i = 0; i < len; i++) {
+        out[i] = result;
+    }
+}
+
+void test_allOddBits_batch(const int *x, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(allOddBits_avx2, x, out, len); i < len; i++) {
+        out[i] = test_allOddBits(x[i]);
+    }
+}
+
+void test_floatAbsVal_batch(const unsigned *uf, unsigned *out, size_t len) {
+    for (size_t i = VECTOR_PART(floatAbsVal_avx2, uf, out, len); i < len; i++) {
+        out[i] = test_floatAbsVal(uf[i]);
+    }
+}
+
+void test_implication_batch(const int *x, const int *y, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(implication_avx2, x, y, out, len); i < len; i++) {
+        out[i] = test_implication(x[i], y[i]);
+    }
+}
+
+void test_isNegative_batch(const int *x, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(isNegative_avx2, x, out, len); i < len; i++) {
+        out[i] = test_isNegative(x[i]);
+    }
+}
+
+void test_sign_batch(const int *x, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(sign_avx2, x, out, len); i < len; i++) {
+        out[i] = test_sign(x[i]);
+    }
+}
+
+void test_isGreater_batch(const int *x, const int *y, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(isGreater_avx2, x, y, out, len); i < len; i++) {
+        out[i] = test_isGreater(x[i], y[i]);
+    }
+}
+
+void test_logicalShift_batch(const int *x, const int *n, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(logicalShift_avx2, x, n, out, len); i < len; i++) {
+        out[i] = test_logicalShift(x[i], n[i]);
+    }
+}
+
+void test_rotateRight_batch(const int *x, const int *n, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(rotateRight_avx2, x, n, out, len); i < len; i++) {
+        out[i] = test_rotateRight(x[i], n[i]);
+    }
+}
+
+/* No vector kernel: float multiplication has to match the scalar code's rounding exactly */
+void test_floatScale4_batch(const unsigned *uf, unsigned *out, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        out[i] = test_floatScale4(uf[i]);
+    }
+}
+
+void test_greatestBitPos_batch(const int *x, int *out, size_t len) {
+    for (size_t i = VECTOR_PART(greatestBitPos_avx2, x, out, len); i < len; i++) {
+        out[i] = test_greatestBitPos(x[i]);
+    }
+}
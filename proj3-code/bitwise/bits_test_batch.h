@@ -0,0 +1,21 @@
+#ifndef BITS_TEST_BATCH_H
+#define BITS_TEST_BATCH_H
+
+#include <stddef.h>
+
+// Batch versions of the reference implementations in bits_test.c:
+// out[i] is the result for the i-th argument(s)
+void test_bitMatch_batch(const int *x, const int *y, int *out, size_t len);
+void test_evenBits_batch(int *out, size_t len);
+void test_allOddBits_batch(const int *x, int *out, size_t len);
+void test_floatAbsVal_batch(const unsigned *uf, unsigned *out, size_t len);
+void test_implication_batch(const int *x, const int *y, int *out, size_t len);
+void test_isNegative_batch(const int *x, int *out, size_t len);
+void test_sign_batch(const int *x, int *out, size_t len);
+void test_isGreater_batch(const int *x, const int *y, int *out, size_t len);
+void test_logicalShift_batch(const int *x, const int *n, int *out, size_t len);
+void test_rotateRight_batch(const int *x, const int *n, int *out, size_t len);
+void test_floatScale4_batch(const unsigned *uf, unsigned *out, size_t len);
+void test_greatestBitPos_batch(const int *x, int *out, size_t len);
+
+#endif // BITS_TEST_BATCH_H
@@ -2,26 +2,54 @@
 // Improvements by Jack Kolb <jhkolb@umn.edu>
 #include <assert.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ipc.h>
+#include <sys/prctl.h>
 #include <sys/shm.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "bench.h"
 #include "bits_impl.h"
+#include "bits_test.h"
 #include "dl_protocol.h"
+#include "emu.h"
+#include "report.h"
+#include "result_cache.h"
+#include "rng.h"
 #include "sema.h"
 #include "utils.h"
 
 #define SHMID_STRLEN 32
 #define SERVER_PROG "./btest_server"
 
+// Identifies the harness and reference implementations, set by the Makefile
+// from the source checksum. Without it, cached results only last for one build.
+#ifndef HARNESS_SOURCE_HASH
+#define HARNESS_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+// Text of the bits.s this program was built from (bits_source.s)
+extern const char bits_source[];
+
+// Highest rating given by getFuncRating()
+#define MAX_RATING 4
+
 // Globals for signal handling
 jmp_buf envbuf;
-int timeout_limit = 10;
+
+// CPU seconds each batch of tests may take, indexed by the function's rating
+int timeout_limits[MAX_RATING + 1] = {10, 10, 10, 10, 10};
+
+// Watchdog for the batch being run. It counts the CPU time of the thread running
+// student code, so waiting on the server or other processes doesn't use it up.
+timer_t watchdog;
 
 void handle_sig(int signo) {
     if (signo == SIGALRM) {
@@ -45,7 +73,8 @@ int install_signal_handler() {
     }
     sigact.sa_flags = SA_RESTART;
 
-    if (sigaction(SIGALRM, &sigact, NULL) == -1 || sigaction(SIGSEGV, &sigact, NULL) == -1) {
+    if (sigaction(SIGALRM, &sigact, NULL) == -1 || sigaction(SIGSEGV, &sigact, NULL) == -1 ||
+            sigaction(SIGFPE, &sigact, NULL) == -1) {
         perror("sigaction");
         return -1;
     }
@@ -53,83 +82,705 @@ int install_signal_handler() {
     return 0;
 }
 
+// die_with_client - Have this child killed when the client exits, so the server and
+// workers don't wait forever for a client that crashed. Returns -1 if it already has.
+static int die_with_client(pid_t client_pid) {
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1) {
+        perror("prctl");
+        return -1;
+    }
+    return getppid() == client_pid ? 0 : -1;
+}
+
+// install_watchdog - Create this process's batch watchdog, which raises SIGALRM
+// when it expires. Timers aren't inherited across fork, so each worker needs one.
+int install_watchdog() {
+    struct sigevent sev = {
+        .sigev_notify = SIGEV_SIGNAL,
+        .sigev_signo = SIGALRM,
+    };
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &watchdog) == -1) {
+        perror("timer_create");
+        return -1;
+    }
+    return 0;
+}
+
+// set_watchdog - Arm the watchdog to expire after secs of CPU time, or disarm it if 0
+void set_watchdog(int secs) {
+    struct itimerspec its = {
+        .it_value = { .tv_sec = secs },
+    };
+    timer_settime(watchdog, 0, &its, NULL);
+}
+
+// thread_cpu_ns - CPU time used by the calling thread, the clock the watchdog runs on
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// monotonic_ns - Wall clock time, read around each batch when profiling
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// parse_timeout - Handle -T <lim>, setting the limit for every rating, or
+// -T <rating>:<lim>, setting it for one. Returns 0 on success, -1 on error.
+static int parse_timeout(const char *arg) {
+    int rating, limit;
+    char extra;
+    if (sscanf(arg, "%d:%d %c", &rating, &limit, &extra) == 2) {
+        if (rating < 1 || rating > MAX_RATING || limit < 0) {
+            return -1;
+        }
+        timeout_limits[rating] = limit;
+    } else if (sscanf(arg, "%d %c", &limit, &extra) == 1 && limit >= 0) {
+        for (int i = 0; i <= MAX_RATING; i++) {
+            timeout_limits[i] = limit;
+        }
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
 // Restrict to brief output for grading purposes?
 int grade_mode = 0;
 
+// Format of the results (-O), and the number of functions reported so far
+enum report_format report_format = REPORT_TEXT;
+unsigned n_reported = 0;
+
+// Number of client workers running student code, one per core by default
+int n_workers = 1;
+
+// Test only one function (-f), and exhaustively (-x)?
+const char *test_fname = NULL;
+int exhaustive = 0;
+
+// Seed for random test values (-s), which cached results depend on
+unsigned long long seed = RNG_SEED_DEFAULT;
+
+// Keep testing after failures, reporting all of them (-a)?
+int collect_all = 0;
+
+// Pin arguments to fixed values (-1, -2, -3)? Those results aren't cached
+int pinned = 0;
+
+// Measure cycles and instructions per call (-B)?
+int bench_mode = 0;
+
+// Print semaphore handoff counters when done?
+int print_sema_stats = 0;
+
+// Time each batch for the server's phase profile (--profile)?
+int profiling = 0;
+
+// Run bits.s in the emulator instead of natively (-E)? Its functions' entry
+// points are looked up once, -1 for any that are missing.
+int emulate = 0;
+emu_program_t emu;
+int emu_entries[NUM_PUZZLES];
+
+// Result cache state, keyed on the function bodies in bits_source. Records are
+// trusted as they are, so the cache is only used when asked for (-C), never
+// by default in the submission directory, where a student could forge them.
+const char *cache_dir = NULL;
+result_key_t cache_keys[NUM_PUZZLES];
+int is_cached[NUM_PUZZLES];
+enum test_outcome cached_outcome[NUM_PUZZLES];
+function_result_t cached_result[NUM_PUZZLES];
+
 // Point totals
 unsigned total_points_possible = 0;
 unsigned total_points_earned = 0;
 
 // Display usage info
 static void usage(char *cmd) {
-    printf("Usage: %s [-hg] [-f <name> [-1|-2|-3 <val>]*] [-T <time limit>]\n", cmd);
+    printf("Usage: %s [-haBEgSx] [-f <name> [-1|-2|-3 <val>]*] [-C <dir>] [-G <dir>] [-k <count>] [-O text|json|tap] [-s <seed>] [-T [<rating>:]<time limit>]* [-V <threads>] [-w <workers>] [--profile[=<file>]]\n", cmd);
     printf("  -1 <val>  Specify first function argument\n");
     printf("  -2 <val>  Specify second function argument\n");
     printf("  -3 <val>  Specify third function argument\n");
+    printf("  -a        Keep testing after failures, counting them all and listing the first few\n");
+    printf("  -B        Report cycles and instructions per call, with the oracle as a baseline\n");
+    printf("  -E        Run bits.s in an emulator, with timeouts counted in instructions per call.\n");
+    printf("            It covers moves, arithmetic, imul, shifts, rotates, bt, setcc, cmov,\n");
+    printf("            jumps, push/pop, xchg, lea and cltq/cltd; anything else must run natively\n");
+    printf("  -C <dir>  Reuse results for unchanged functions from dir, which must not be\n");
+    printf("            writable by students (default: off)\n");
     printf("  -f <name> Test only the named function\n");
+    printf("  -G <dir>  Cache expected outputs in dir, which must not be writable by students\n");
+    printf("            (default: off)\n");
     printf("  -g        Compact output for grading (with no error msgs)\n");
     printf("  -h        Print this message\n");
-    printf("  -T <lim>  Set timeout limit to lim\n");
+    printf("  -k <n>    List up to n distinct failures per function with -a (default 5, max %d)\n",
+        MAX_COUNTEREXAMPLES);
+    printf("  -O <fmt>  Print results as text (default), json (one object per line) or tap,\n");
+    printf("            each function's as soon as it is done\n");
+    printf("  -s <seed> Seed for random test values (default %d)\n", RNG_SEED_DEFAULT);
+    printf("  -S        Print client/server handoff statistics to stderr\n");
+    printf("  -T <lim>  Set timeout limit to lim CPU seconds per batch of tests (0 for none)\n");
+    printf("  -T <r>:<lim>  Set timeout limit for functions with rating r only\n");
+    printf("  -V <n>    Validate results in n server threads (default: one per core, 0 for none)\n");
+    printf("  -w <n>    Run student code in n worker processes (default: one per core)\n");
+    printf("  -x        Test single-argument functions on all 2^32 inputs\n");
+    printf("  --profile[=<file>]  Print time, CPU time, bytes and batches spent in each phase\n");
+    printf("            of testing to stderr, and write them as json to file (default btest_profile.json)\n");
     exit(1);
 }
 
-void reportFunctionResult(enum test_outcome outcome, function_result_t *result) {
+// load_cached_results - Compute a cache key for each function in bits_source and
+// look up the result of any that have been tested before, only for only_fname if
+// non-NULL. Returns the number of functions with cached results.
+static int load_cached_results(const char *only_fname) {
+    char salt[128];
+    snprintf(salt, sizeof(salt), "%s|%s|%s|%llu", HARNESS_SOURCE_HASH,
+            exhaustive ? "exhaustive" : "sampled", emulate ? "emulated" : "native", seed);
+    result_cache_keys(bits_source, salt, cache_keys);
+
+    int n_cached = 0;
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        if (only_fname != NULL && strcmp(only_fname, getFuncName(id)) != 0) {
+            continue;
+        }
+        if (cache_keys[id].cacheable &&
+                result_cache_lookup(cache_dir, cache_keys[id].key, &cached_outcome[id], &cached_result[id])) {
+            is_cached[id] = 1;
+            n_cached++;
+        }
+    }
+    return n_cached;
+}
+
+// printTestCall - Print a test case as a call, e.g. "bitMatch(7[0x7], 14[0xe])"
+static void printTestCall(const function_result_t *result) {
+    const char *func_name = getFuncName(result->function_id);
+    switch (getNumArgs(result->function_id)) {
+        case 2: {
+            printf("%s(%d[0x%x], %d[0x%x])", func_name, result->arg1, result->arg1,
+                result->arg2, result->arg2);
+            break;
+        }
+        case 1: {
+            printf("%s(%d[0x%x])", func_name, result->arg1, result->arg1);
+            break;
+        }
+        case 0: {
+            printf("%s()", func_name);
+            break;
+        }
+        default: {
+            // Should never happen
+            printf("Error: Invalid function ID received from server\n");
+        }
+    }
+}
+
+// printFailure - Describe one failed test. Crashes are only pinned to a test case
+// in collect-all mode (-a), so show_call says whether to print the arguments.
+static void printFailure(enum test_outcome outcome, const function_result_t *result, int show_call) {
+    const char *func_name = getFuncName(result->function_id);
+    if (outcome == FAILURE) {
+        printf("ERROR: Test ");
+        printTestCall(result);
+        printf(" failed...\n");
+        printf("...Gives %d[0x%x].  Should be %d[0x%x]\n",
+            result->actual_output, result->actual_output,
+            result->expected_output, result->expected_output);
+        return;
+    }
+
+    printf("ERROR: Test ");
+    if (show_call) {
+        printTestCall(result);
+    } else {
+        printf("%s", func_name);
+    }
+    printf(" failed.\n");
+    if (outcome == TIMEOUT && emulate) {
+        printf("  Ran for more than %d instructions (probably infinite loop)\n", EMU_FUEL_DEFAULT);
+    } else if (outcome == TIMEOUT) {
+        printf("  Timed out after %d secs (probably infinite loop)\n",
+            timeout_limits[getFuncRating(result->function_id)]);
+    } else if (outcome == SEGFAULT) {
+        printf("  Segmentation Fault\n");
+    } else if (outcome == FLOAT_ERROR) {
+        printf("  Floating Point Operation Exception\n");
+    }
+}
+
+// printFailureClass - Summarize one class of failures found in collect-all mode
+// (-a) by its smallest failing input
+static void printFailureClass(const failure_class_t *class) {
+    const function_result_t *result = &class->smallest.result;
+    char name[64];
+    getFailureClassName(result->function_id, class->failure_class, name, sizeof(name));
+    printf("    %s: %llu failure%s, smallest ", name, (unsigned long long) class->n_failures,
+        class->n_failures == 1 ? "" : "s");
+    printTestCall(result);
+    switch (class->smallest.outcome) {
+        case FAILURE:
+            printf(" gives %d[0x%x], should be %d[0x%x]\n", result->actual_output,
+                result->actual_output, result->expected_output, result->expected_output);
+            break;
+        case TIMEOUT:
+            printf(" times out\n");
+            break;
+        case SEGFAULT:
+            printf(" causes a segmentation fault\n");
+            break;
+        default:
+            printf(" causes a floating point exception\n");
+    }
+}
+
+// reportRecord - Report a function's result in the format chosen with -O
+static void reportRecord(enum test_outcome outcome, const function_result_t *result,
+        const failure_report_t *failures, int cached, const function_stats_t *stats) {
+    unsigned rating = getFuncRating(result->function_id);
+    report_record_t record = {
+        .name = getFuncName(result->function_id),
+        .rating = rating,
+        .score = outcome == SUCCESS ? rating : 0,
+        .outcome = outcome,
+        .cached = cached,
+        .num_args = getNumArgs(result->function_id),
+        .result = result,
+        .n_errors = outcome == SUCCESS ? 0 : 1,
+        .stats = stats,
+    };
+    if (outcome != SUCCESS && collect_all) {
+        // The first failure found is the one to show, as in the text report
+        record.n_errors = failures->n_failures;
+        if (failures->n_examples > 0) {
+            record.outcome = failures->examples[0].outcome;
+            record.result = &failures->examples[0].result;
+            record.has_call = 1;
+        }
+    }
+    report_function(stdout, report_format, ++n_reported, &record);
+}
+
+void reportFunctionResult(enum test_outcome outcome, function_result_t *result,
+        const failure_report_t *failures, const function_stats_t *stats) {
+    enum function_id id = result->function_id;
+    int cached = outcome == CACHED;
+    if (outcome == CACHED) {
+        // Server skipped the function, report its result from the last time
+        // the same code was tested
+        outcome = cached_outcome[id];
+        result = &cached_result[id];
+        result->function_id = id;
+    } else if (cache_dir != NULL && cache_keys[id].cacheable && outcome != TIMEOUT) {
+        // Timeouts depend on machine load, so only deterministic outcomes are kept
+        if (result_cache_store(cache_dir, cache_keys[id].key, outcome, result) == -1 && !grade_mode &&
+                report_format == REPORT_TEXT) {
+            printf("Warning: Unable to save %s result in %s\n", getFuncName(id), cache_dir);
+        }
+    }
+
     const char *func_name = getFuncName(result->function_id);
     unsigned rating = getFuncRating(result->function_id);
     total_points_possible += rating;
+    if (outcome == SUCCESS) {
+        total_points_earned += rating;
+    }
+    if (report_format != REPORT_TEXT) {
+        reportRecord(outcome, result, failures, cached, stats);
+        return;
+    }
 
     if (outcome == SUCCESS) {
         printf(" %d\t%d\t%d\t%s\n", rating, rating, 0, func_name);
-        total_points_earned += rating;
+    } else if (collect_all) {
+        if (!grade_mode) {
+            for (unsigned i = 0; i < failures->n_examples; i++) {
+                printFailure(failures->examples[i].outcome, &failures->examples[i].result, 1);
+            }
+            printf("  %llu failing test case%s%s, in %u class%s:\n",
+                (unsigned long long) failures->n_failures, failures->n_failures == 1 ? "" : "s",
+                failures->stopped ? " before testing stopped" : " in total",
+                failures->n_classes, failures->n_classes == 1 ? "" : "es");
+            for (unsigned i = 0; i < failures->n_classes; i++) {
+                printFailureClass(&failures->classes[i]);
+            }
+        }
+        printf(" %d\t%d\t%llu\t%s\n", 0, rating, (unsigned long long) failures->n_failures, func_name);
     } else {
         if (!grade_mode) {
-            if (outcome == FAILURE) {
-                switch (getNumArgs(result->function_id)) {
-                    case 2: {
-                        printf("ERROR: Test %s(%d[0x%x], %d[0x%x]) failed...\n",
-                            func_name, result->arg1, result->arg1,
-                            result->arg2, result->arg2);
-                        break;
-                    }
-                    case 1: {
-                        printf("ERROR: Test %s(%d[0x%x]) failed...\n",
-                            func_name, result->arg1, result->arg1);
-                        break;
-                    }
-                    case 0: {
-                        printf("ERROR: Test %s() failed...\n", func_name);
-                        break;
+            printFailure(outcome, result, 0);
+        }
+        printf(" %d\t%d\t%d\t%s\n", 0, rating, 1, func_name);
+    }
+}
+
+// Per-function batch loops. Elements in a batch's buffer occur in chunks of
+// num_args + 1: all of the arguments followed by space for the result. Each loop
+// is specialized for its function's arity so it is just loads, a call and a store.
+// Benchmark mode (-B) uses a second loop that measures every call, followed by a
+// loop measuring the oracle on the same inputs.
+typedef void (*batch_runner_t)(int *elems, unsigned n_test_cases);
+typedef void (*bench_runner_t)(int *elems, unsigned n_test_cases, bench_hist_t hists[2]);
+
+// Oracle results go nowhere, but the calls can't be optimized out
+volatile int bench_sink;
+
+#define BATCH_RUNNER_0(func) \
+    static void run_##func(int *elems, unsigned n_test_cases) { \
+        for (int *e = elems, *end = elems + n_test_cases; e < end; e++) { \
+            e[batch_result_offset(0)] = func(); \
+        } \
+    } \
+    static void bench_##func(int *elems, unsigned n_test_cases, bench_hist_t hists[2]) { \
+        for (int *e = elems, *end = elems + n_test_cases; e < end; e++) { \
+            BENCH_CALL(&hists[0], e[batch_result_offset(0)] = func()); \
+        } \
+        for (int *e = elems, *end = elems + n_test_cases; e < end; e++) { \
+            BENCH_CALL(&hists[1], bench_sink = test_##func()); \
+        } \
+    }
+
+#define BATCH_RUNNER_1(func) \
+    static void run_##func(int *elems, unsigned n_test_cases) { \
+        for (int *e = elems, *end = elems + 2 * n_test_cases; e < end; e += 2) { \
+            e[batch_result_offset(1)] = func(e[0]); \
+        } \
+    } \
+    static void bench_##func(int *elems, unsigned n_test_cases, bench_hist_t hists[2]) { \
+        for (int *e = elems, *end = elems + 2 * n_test_cases; e < end; e += 2) { \
+            BENCH_CALL(&hists[0], e[batch_result_offset(1)] = func(e[0])); \
+        } \
+        for (int *e = elems, *end = elems + 2 * n_test_cases; e < end; e += 2) { \
+            BENCH_CALL(&hists[1], bench_sink = test_##func(e[0])); \
+        } \
+    }
+
+#define BATCH_RUNNER_2(func) \
+    static void run_##func(int *elems, unsigned n_test_cases) { \
+        for (int *e = elems, *end = elems + 3 * n_test_cases; e < end; e += 3) { \
+            e[batch_result_offset(2)] = func(e[0], e[1]); \
+        } \
+    } \
+    static void bench_##func(int *elems, unsigned n_test_cases, bench_hist_t hists[2]) { \
+        for (int *e = elems, *end = elems + 3 * n_test_cases; e < end; e += 3) { \
+            BENCH_CALL(&hists[0], e[batch_result_offset(2)] = func(e[0], e[1])); \
+        } \
+        for (int *e = elems, *end = elems + 3 * n_test_cases; e < end; e += 3) { \
+            BENCH_CALL(&hists[1], bench_sink = test_##func(e[0], e[1])); \
+        } \
+    }
+
+BATCH_RUNNER_2(bitMatch)
+BATCH_RUNNER_0(evenBits)
+BATCH_RUNNER_1(allOddBits)
+BATCH_RUNNER_1(floatAbsVal)
+BATCH_RUNNER_2(implication)
+BATCH_RUNNER_1(isNegative)
+BATCH_RUNNER_1(sign)
+BATCH_RUNNER_2(isGreater)
+BATCH_RUNNER_2(logicalShift)
+BATCH_RUNNER_2(rotateRight)
+BATCH_RUNNER_1(floatScale4)
+BATCH_RUNNER_1(greatestBitPos)
+
+static const batch_runner_t batch_runners[NUM_PUZZLES] = {
+    [BIT_MATCH] = run_bitMatch,
+    [EVEN_BITS] = run_evenBits,
+    [ALL_ODD_BITS] = run_allOddBits,
+    [FLOAT_ABS_VAL] = run_floatAbsVal,
+    [IMPLICATION] = run_implication,
+    [IS_NEGATIVE] = run_isNegative,
+    [SIGN] = run_sign,
+    [IS_GREATER] = run_isGreater,
+    [LOGICAL_SHIFT] = run_logicalShift,
+    [ROTATE_RIGHT] = run_rotateRight,
+    [FLOAT_SCALE_4] = run_floatScale4,
+    [GREATEST_BIT_POS] = run_greatestBitPos,
+};
+
+static const bench_runner_t bench_runners[NUM_PUZZLES] = {
+    [BIT_MATCH] = bench_bitMatch,
+    [EVEN_BITS] = bench_evenBits,
+    [ALL_ODD_BITS] = bench_allOddBits,
+    [FLOAT_ABS_VAL] = bench_floatAbsVal,
+    [IMPLICATION] = bench_implication,
+    [IS_NEGATIVE] = bench_isNegative,
+    [SIGN] = bench_sign,
+    [IS_GREATER] = bench_isGreater,
+    [LOGICAL_SHIFT] = bench_logicalShift,
+    [ROTATE_RIGHT] = bench_rotateRight,
+    [FLOAT_SCALE_4] = bench_floatScale4,
+    [GREATEST_BIT_POS] = bench_greatestBitPos,
+};
+
+// Benchmark histograms for each function's bits.s code [0] and oracle [1]
+bench_hist_t bench_hists[NUM_PUZZLES][2];
+
+// Case being run in collect-all mode, where a jump out of a signal handler can't lose it
+volatile unsigned collect_case;
+
+// run_collecting - Run a batch one case at a time (-a), so that a crash can be
+// pinned to the case that caused it and testing can resume with the next one.
+// A timeout ends the batch. Fills in the batch's n_run, n_crashes, and crashes.
+static void run_collecting(test_batch_t *test_batch, batch_runner_t run_batch, unsigned stride,
+        int timeout) {
+    unsigned n_test_cases = test_batch->n_test_cases;
+    test_batch->n_run = n_test_cases;
+    test_batch->n_crashes = 0;
+    collect_case = 0;
+
+    // One watchdog still covers the whole batch, crashes and all
+    set_watchdog(timeout);
+    int rc = sigsetjmp(envbuf, 1);
+    if (rc == 1) {
+        // Timed out, the server treats the rest of the batch as untested
+        test_batch->n_run = collect_case;
+        return;
+    } else if (rc != 0) {
+        if (test_batch->n_crashes == 0) {
+            memset(test_batch->crashes, SUCCESS, n_test_cases);
+        }
+        test_batch->crashes[collect_case] = rc == 2 ? SEGFAULT : FLOAT_ERROR;
+        test_batch->n_crashes++;
+        collect_case++;
+    }
+    for (; collect_case < n_test_cases; collect_case++) {
+        run_batch(test_batch->elems + collect_case * stride, 1);
+    }
+    set_watchdog(0);
+}
+
+// run_emulated - Run a batch in the emulator (-E). Its failures are reported the
+// same way as the native runners' signals, by the reply type this returns. In
+// collect-all mode (-a), a fault only marks its case, as a segfault would.
+static enum message_type run_emulated(test_batch_t *test_batch, enum function_id id) {
+    unsigned num_args = getNumArgs(id);
+    unsigned stride = num_args > 0 ? num_args + 1 : 1;
+    // A timeout limit of 0 means none, as it does for native runs
+    uint64_t fuel = timeout_limits[getFuncRating(id)] == 0 ? UINT64_MAX : EMU_FUEL_DEFAULT;
+    unsigned n_test_cases = test_batch->n_test_cases;
+    unsigned done = 0, stopped_at;
+
+    if (collect_all) {
+        test_batch->n_run = n_test_cases;
+        test_batch->n_crashes = 0;
+    }
+    while (done < n_test_cases) {
+        emu_status_t status = emu_run_batch(&emu, emu_entries[id], num_args,
+            test_batch->elems + done * stride, stride, n_test_cases - done, fuel, &stopped_at);
+        done += stopped_at;
+        if (status == EMU_RETURNED) {
+            break;
+        } else if (!collect_all) {
+            return status == EMU_OUT_OF_FUEL ? TIMEOUT_FAILURE : SEGFAULT_FAILURE;
+        } else if (status == EMU_OUT_OF_FUEL) {
+            // The server treats the rest of the batch as untested
+            test_batch->n_run = done;
+            break;
+        }
+        if (test_batch->n_crashes == 0) {
+            memset(test_batch->crashes, SUCCESS, n_test_cases);
+        }
+        test_batch->crashes[done++] = SEGFAULT;
+        test_batch->n_crashes++;
+    }
+    return TEST_RESULT_BATCH;
+}
+
+// serve_channel - Run batches of tests sent by the server over one channel until
+// the server signals the end of testing. The server may queue several batches in
+// the channel's ring, so the next one is usually ready when this one is done.
+// Only the reporting worker (channel 0) prints results. Returns 0 on success,
+// 1 on error.
+static int serve_channel(shmem_buf_t *channel, int worker_index) {
+    int is_reporter = worker_index == 0;
+    if (install_watchdog() == -1) {
+        return 1;
+    }
+
+    // Converse with server as long as needed, taking messages from the
+    // channel's ring in the order they were sent
+    uint32_t seq = 0;
+    uint64_t batch_cpu_start = 0;
+    uint64_t batch_wall_start = 0;
+    while (1) {
+        ring_slot_t *slot = &channel->slots[seq % RING_SLOTS];
+
+        // Wait until server has sent us something
+        if (sema_wait(&slot->ready_for_client) == -1) {
+            perror("sema_wait");
+            return 1;
+        }
+        if (slot->seq != seq) {
+            printf("Error: Message received out of sequence from server\n");
+            return 1;
+        }
+
+        switch (slot->type) {
+            case TEST_INPUT_BATCH: {
+                test_batch_t *test_batch = (test_batch_t *) slot->payload;
+                if (is_reporter && test_batch->previous_outcome != ONGOING) {
+                    reportFunctionResult(test_batch->previous_outcome, &test_batch->previous_result,
+                            &test_batch->previous_failures, &test_batch->previous_stats);
+                }
+
+                // Read again when the reply is sent, however the batch ended
+                batch_cpu_start = thread_cpu_ns();
+                if (profiling) {
+                    batch_wall_start = monotonic_ns();
+                }
+                int rc = sigsetjmp(envbuf, 1);
+                if (rc == 1) {
+                    // We jumped here due to a timeout in student func execution
+                    slot->type = TIMEOUT_FAILURE;
+                    break;
+                } else if (rc == 2) {
+                    // We jumped here due to a segfault in stuent func execution
+                    // The batch's watchdog is still armed, so cancel it
+                    set_watchdog(0);
+                    slot->type = SEGFAULT_FAILURE;
+                    break;
+                } else if (rc == 3) {
+                    // We jumped here due to a floating point exception in student func execution
+                    set_watchdog(0);
+                    slot->type = SIGFPE_FAILURE;
+                    break;
+                }
+
+                if (test_batch->function_id >= NUM_PUZZLES) {
+                    printf("Error: Invalid function ID received from server\n");
+                    return 1;
+                }
+                enum function_id id = test_batch->function_id;
+
+                if (emulate) {
+                    slot->type = run_emulated(test_batch, id);
+                    break;
+                }
+
+                if (collect_all) {
+                    // Functions without arguments still use two slots per case, but
+                    // their cases overlap
+                    unsigned num_args = getNumArgs(id);
+                    run_collecting(test_batch, batch_runners[id], num_args > 0 ? num_args + 1 : 1,
+                        timeout_limits[getFuncRating(id)]);
+                    slot->type = TEST_RESULT_BATCH;
+                    break;
+                }
+
+                // Set up watchdog for timeout enforcement, covering the whole batch
+                set_watchdog(timeout_limits[getFuncRating(id)]);
+                if (bench_mode) {
+                    bench_runners[id](test_batch->elems, test_batch->n_test_cases, bench_hists[id]);
+                } else {
+                    batch_runners[id](test_batch->elems, test_batch->n_test_cases);
+                }
+                // Cancel watchdog
+                set_watchdog(0);
+                // Prep reply to server
+                slot->type = TEST_RESULT_BATCH;
+                break;
+            }
+
+            case END: {
+                // We're done and can terminate
+                // But the reporting worker first needs to check on result of previous function's tests
+                if (is_reporter) {
+                    test_batch_t *test_batch = (test_batch_t *) slot->payload;
+                    assert(test_batch->previous_outcome != ONGOING);
+                    reportFunctionResult(test_batch->previous_outcome, &test_batch->previous_result,
+                            &test_batch->previous_failures, &test_batch->previous_stats);
+
+                    if (report_format == REPORT_TEXT) {
+                        printf("Total points: %d/%d\n", total_points_earned, total_points_possible);
+                    } else {
+                        report_end(stdout, report_format, n_reported, total_points_earned,
+                            total_points_possible);
                     }
-                    default: {
-                        // Should never happen
-                        printf("Error: Invalid function ID received from server\n");
+                    if (bench_mode) {
+                        const char *names[NUM_PUZZLES];
+                        for (int id = 0; id < NUM_PUZZLES; id++) {
+                            names[id] = getFuncName(id);
+                        }
+                        // Keep structured output parseable
+                        bench_print(report_format == REPORT_TEXT ? stdout : stderr, names, bench_hists,
+                            NUM_PUZZLES);
                     }
                 }
-                printf("...Gives %d[0x%x].  Should be %d[0x%x]\n",
-                    result->actual_output, result->actual_output,
-                    result->expected_output, result->expected_output);
-            } else if (outcome == TIMEOUT) {
-                printf("ERROR: Test %s failed.\n", func_name);
-                printf("  Timed out after %d secs (probably infinite loop)\n", timeout_limit);
-            } else if (outcome == SEGFAULT) {
-                printf("ERROR: Test %s failed.\n", func_name);
-                printf("  Segmentation Fault\n");
-            } else if (outcome == FLOAT_ERROR) {
-                printf("ERROR: Test %s failed.\n", func_name);
-                printf("  Floating Point Operation Exception\n");
+                if (print_sema_stats) {
+                    char who[32];
+                    snprintf(who, sizeof(who), "client worker %d", worker_index);
+                    sema_stats_t stats;
+                    sema_get_stats(&stats);
+                    fflush(stdout);
+                    sema_print_stats(stderr, who, &stats);
+                }
+                return 0;
+            }
+
+            default: {
+                // Should never happen
+                printf("Error: Invalid message type received from server\n");
+                return 1;
             }
         }
-        printf(" %d\t%d\t%d\t%s\n", 0, rating, 1, func_name);
+
+        // Indicate to server that client's reply is ready
+        ((test_batch_t *) slot->payload)->cpu_ns = thread_cpu_ns() - batch_cpu_start;
+        if (profiling) {
+            ((test_batch_t *) slot->payload)->wall_ns = monotonic_ns() - batch_wall_start;
+        }
+        if (sema_post(&slot->ready_for_server) == -1) {
+            perror("sem_post");
+            return 1;
+        }
+        seq++;
     }
 }
 
 int main(int argc, char **argv) {
+    long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cores > 0) {
+        n_workers = n_cores < MAX_WORKERS ? n_cores : MAX_WORKERS;
+    }
+
     // Parse command line args
-    char c;
-    while ((c = getopt(argc, argv, "hgf:T:1:2:3:")) != -1)
+    // --profile has no short form, 'P' is just how getopt_long reports it
+    static const struct option long_options[] = {
+        {"profile", optional_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "haBEgSxC:f:G:O:T:V:k:s:w:1:2:3:", long_options,
+            NULL)) != -1)
         switch (c) {
-            // Ignore this, it's passed to server
-            case 'f':
+            // Ignore these, they're passed to server
+            case 'f': { // Only this function's result can come from the cache
+                int id = 0;
+                while (id < NUM_PUZZLES && strcmp(getFuncName(id), optarg) != 0) {
+                    id++;
+                }
+                if (id == NUM_PUZZLES) {
+                    printf("Unknown function '%s'\n", optarg);
+                    return 0;
+                }
+                test_fname = optarg;
+                break;
+            }
+
+            case 'G':
+                break;
+
+            case 'x': // Exhaustive results are cached separately, also passed to server
+                exhaustive = 1;
+                break;
+
+            case 'C': // Set result cache directory
+                cache_dir = strcmp(optarg, "-") == 0 ? NULL : optarg;
                 break;
 
             // Don't care what these are specifically
@@ -144,15 +795,78 @@ int main(int argc, char **argv) {
                     printf("Bad argument '%s'\n", optarg);
                     return 0;
                 }
+                pinned = 1;
+                break;
+            }
+
+            case 'a': // Collect all failures, also passed to server
+                collect_all = 1;
+                break;
+
+            case 'k': { // Number of failures to list, passed to server
+                int k = atoi(optarg);
+                if (k < 1 || k > MAX_COUNTEREXAMPLES) {
+                    printf("Number of failures to list must be between 1 and %d\n", MAX_COUNTEREXAMPLES);
+                    return 0;
+                }
                 break;
             }
 
+            case 's': { // Seed for random test values, passed to server
+                char *end;
+                seed = strtoull(optarg, &end, 0);
+                if (*optarg == '\0' || *end != '\0') {
+                    printf("Bad seed '%s'\n", optarg);
+                    return 0;
+                }
+                break;
+            }
+
+            case 'B': // Benchmark mode
+                bench_mode = 1;
+                break;
+
+            case 'E': // Emulate bits.s, also passed to server
+                emulate = 1;
+                break;
+
+            case 'O': // Output format, also passed to server
+                if (report_parse_format(optarg, &report_format) == -1) {
+                    printf("Unknown output format '%s'\n", optarg);
+                    return 0;
+                }
+                break;
+
             case 'g': // grading option for autograder
                 grade_mode = 1;
                 break;
 
+            case 'S': // Print handoff statistics, also passed to server
+                print_sema_stats = 1;
+                break;
+
+            case 'P': // Profile phases of testing, also passed to server, which prints it
+                profiling = 1;
+                break;
+
             case 'T': // Set timeout limit
-                timeout_limit = atoi(optarg);
+                if (parse_timeout(optarg) == -1) {
+                    printf("Bad timeout limit '%s'\n", optarg);
+                    return 0;
+                }
+                break;
+
+            case 'V': { // Number of server validation threads, passed to server
+                int v = atoi(optarg);
+                if (v < 0 || v > MAX_WORKERS) {
+                    printf("Number of validation threads must be between 0 and %d\n", MAX_WORKERS);
+                    return 0;
+                }
+                break;
+            }
+
+            case 'w': // Set number of client workers
+                n_workers = atoi(optarg);
                 break;
 
             case 'h': // help
@@ -168,14 +882,54 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    // Set up memory to share with server
-    int shm_id = shmget(IPC_PRIVATE, sizeof(shmem_buf_t), IPC_CREAT|S_IRUSR|S_IWUSR);
+    if (n_workers < 1 || n_workers > MAX_WORKERS) {
+        printf("Number of workers must be between 1 and %d\n", MAX_WORKERS);
+        return 1;
+    }
+
+    // Measurements are only collected and printed by a single worker, and
+    // cached functions would go unmeasured
+    if (bench_mode) {
+        n_workers = 1;
+        cache_dir = NULL;
+        bench_init();
+    }
+
+    if (emulate) {
+        // Cycle counts of the emulator say nothing about the code
+        if (bench_mode) {
+            printf("Benchmark mode (-B) runs bits.s natively and can't be combined with -E\n");
+            return 1;
+        }
+        if (emu_load(&emu, bits_source, "bits.s") == -1) {
+            printf("Unable to emulate bits.s, test it natively instead\n");
+            return 1;
+        }
+        for (int id = 0; id < NUM_PUZZLES; id++) {
+            emu_entries[id] = emu_entry(&emu, getFuncName(id));
+        }
+    }
+
+    // Cached results only describe the first failure, and results for
+    // hand-picked arguments say nothing about the function
+    if (collect_all || pinned) {
+        cache_dir = NULL;
+    }
+
+    // Functions whose code has been tested before can be skipped
+    int n_cached = 0;
+    if (cache_dir != NULL) {
+        n_cached = load_cached_results(test_fname);
+    }
+
+    // Set up memory to share with server, one channel per worker
+    int shm_id = shmget(IPC_PRIVATE, n_workers * sizeof(shmem_buf_t), IPC_CREAT|S_IRUSR|S_IWUSR);
     if (shm_id == -1) {
         perror("shmget");
         return 1;
     }
-    shmem_buf_t *sh_buf = shmat(shm_id, NULL, 0);
-    if (sh_buf == (void *) -1) {
+    shmem_buf_t *channels = shmat(shm_id, NULL, 0);
+    if (channels == (void *) -1) {
         perror("shmat");
         return 1;
     }
@@ -185,33 +939,53 @@ int main(int argc, char **argv) {
         perror("shmctl");
         return 1;
     }
-    sh_buf->ready_for_client = 0;
-    sh_buf->ready_for_server = 0;
+    for (int i = 0; i < n_workers; i++) {
+        for (int j = 0; j < RING_SLOTS; j++) {
+            channels[i].slots[j].ready_for_client = (sema_t) {};
+            channels[i].slots[j].ready_for_server = (sema_t) {};
+        }
+    }
 
     // Launch server process
+    pid_t client_pid = getpid();
     pid_t child_pid = fork();
     if (child_pid == 0) {
+        if (die_with_client(client_pid) == -1) {
+            return 1;
+        }
+
         // Detach from inherited memory segment (will reattach after exec)
-        if (shmdt(sh_buf) == -1) {
+        if (shmdt(channels) == -1) {
             perror("shmdt");
             return 1;
         }
 
-        // Store shm_id in a string for use with exec below
+        // Store shm_id and worker count in strings for use with exec below
         char shmid_str[SHMID_STRLEN];
         snprintf(shmid_str, SHMID_STRLEN, "%d", shm_id);
+        char n_workers_str[SHMID_STRLEN];
+        snprintf(n_workers_str, SHMID_STRLEN, "%d", n_workers);
 
         // Prepare command-line arguments for server.
-        // Includes shm_id plus all args passed to this process (client)
-        char *server_argv[argc + 2]; // All args plus shm_id plus NULL sentinel
+        // Includes shm_id and worker count plus all args passed to this process (client)
+        // Functions with cached results are passed on with -K so they're skipped.
+        char *server_argv[argc + 3 + 2 * n_cached]; // Plus shm_id, worker count, and NULL sentinel
         server_argv[0] = SERVER_PROG;
         server_argv[1] = shmid_str;
+        server_argv[2] = n_workers_str;
         for (int i = 1; i < argc; i++) {
-            server_argv[i + 1] = argv[i];
+            server_argv[i + 2] = argv[i];
+        }
+        int n_server_args = argc + 2;
+        for (int id = 0; id < NUM_PUZZLES; id++) {
+            if (is_cached[id]) {
+                server_argv[n_server_args++] = "-K";
+                server_argv[n_server_args++] = (char *) getFuncName(id);
+            }
         }
-        server_argv[argc + 1] = NULL;
+        server_argv[n_server_args] = NULL;
 
-        // Launch btest_server, 32-bit binary and all
+        // Launch btest_server
         if (execv(SERVER_PROG, server_argv) == -1) {
             perror("execv");
             return 1;
@@ -219,168 +993,53 @@ int main(int argc, char **argv) {
         // Successful exec does not return
     } else if (child_pid == -1) {
         perror("fork");
-        shmdt(sh_buf);
+        shmdt(channels);
         return 1;
     }
 
-    // Print header
-    printf("Score\tRating\tErrors\tFunction\n");
-
-    // Converse with server as long as needed
-    while (1) {
-        // Wait until server has sent us something
-        if (sema_wait(&sh_buf->ready_for_client) == -1) {
-            perror("sema_wait");
-            shmdt(sh_buf);
+    // Launch the additional workers. Each serves its own channel and exits once
+    // the server has finished. This process serves channel 0 and reports results.
+    for (int i = 1; i < n_workers; i++) {
+        pid_t worker_pid = fork();
+        if (worker_pid == 0) {
+            if (die_with_client(client_pid) == -1) {
+                exit(1);
+            }
+            int status = serve_channel(&channels[i], i);
+            if (shmdt(channels) == -1) {
+                perror("shmdt");
+                status = 1;
+            }
+            exit(status);
+        } else if (worker_pid == -1) {
+            perror("fork");
+            shmdt(channels);
             return 1;
         }
+    }
 
-        switch (sh_buf->type) {
-            case TEST_INPUT_BATCH: {
-                test_batch_t *test_batch = (test_batch_t *) sh_buf->payload;
-                if (test_batch->previous_outcome != ONGOING) {
-                    reportFunctionResult(test_batch->previous_outcome, &test_batch->previous_result);
-                }
-
-                int rc = sigsetjmp(envbuf, 1);
-                if (rc == 1) {
-                    // We jumped here due to a timeout in student func execution
-                    sh_buf->type = TIMEOUT_FAILURE;
-                    break;
-                } else if (rc == 2) {
-                    // We jumped here due to a segfault in stuent func execution
-                    sh_buf->type = SEGFAULT_FAILURE;
-                    break;
-                } else if (rc == 3) {
-                    // We jumped here due to a floating point exception in student func execution
-                    sh_buf->type = SIGFPE_FAILURE;
-                }
-
-                unsigned num_args = getNumArgs(test_batch->function_id);
-                if (num_args == -1) {
-                    printf("Error: Invalid function ID received from server\n");
-                    shmdt(sh_buf);
-                    return 1;
-                }
-
-                // Read in elements from payload's buffer.
-                // They occur in chunks of num_args + 1
-                // Each element has space for all arguments plus a result
-                int arg1;
-                int arg2;
-                for (int i = 0; i < test_batch->n_test_cases; i++) {
-                    int j = i * (num_args + 1);
-                    arg1 = test_batch->elems[j];
-                    if (num_args == 2) {
-                        j++;
-                        arg2 = test_batch->elems[j];
-                    }
-                    j++; // j now refers to location for function's output
-
-                    // Set up alarm for timeout enforcement
-                    if (timeout_limit > 0) {
-                        alarm(timeout_limit);
-                    }
-
-                    switch (test_batch->function_id) {
-                        case BIT_MATCH: {
-                            test_batch->elems[j] = bitMatch(arg1, arg2);
-                            break;
-                        }
-                        case EVEN_BITS: {
-                            test_batch->elems[j] = evenBits();
-                            break;
-                        }
-                        case ALL_ODD_BITS: {
-                            test_batch->elems[j] = allOddBits(arg1);
-                            break;
-                        }
-                        case FLOAT_ABS_VAL: {
-                            test_batch->elems[j] = floatAbsVal(arg1);
-                            break;
-                        }
-                        case IMPLICATION: {
-                            test_batch->elems[j] = implication(arg1, arg2);
-                            break;
-                        }
-                        case IS_NEGATIVE: {
-                            test_batch->elems[j] = isNegative(arg1);
-                            break;
-                        }
-                        case SIGN: {
-                            test_batch->elems[j] = sign(arg1);
-                            break;
-                        }
-                        case IS_GREATER: {
-                            test_batch->elems[j] = isGreater(arg1, arg2);
-                            break;
-                        }
-                        case LOGICAL_SHIFT: {
-                            test_batch->elems[j] = logicalShift(arg1, arg2);
-                            break;
-                        }
-                        case ROTATE_RIGHT: {
-                            test_batch->elems[j] = rotateRight(arg1, arg2);
-                            break;
-                        }
-                        case FLOAT_SCALE_4: {
-                            test_batch->elems[j] = floatScale4(arg1);
-                            break;
-                        }
-                        case GREATEST_BIT_POS: {
-                            test_batch->elems[j] = greatestBitPos(arg1);
-                            break;
-                        }
-                        default: {
-                            // Should never happen
-                            printf("Error: Received invalid function ID from server\n");
-                            shmdt(sh_buf);
-                            return 1;
-                        }
-                    }
-                }
-                // Cancel alarm
-                alarm(0);
-                // Prep reply to server
-                sh_buf->type = TEST_RESULT_BATCH;
-                break;
-            }
-
-            case END: {
-                // We're done and can terminate
-                // But first need to check on result of previous function's tests
-                test_batch_t *test_batch = (test_batch_t *) sh_buf->payload;
-                assert(test_batch->previous_outcome != ONGOING);
-                reportFunctionResult(test_batch->previous_outcome, &test_batch->previous_result);
-
-                printf("Total points: %d/%d\n", total_points_earned, total_points_possible);
-
-                int exit_status = 0;
-                if (shmdt(sh_buf) == -1) {
-                    perror("shmdt");
-                    exit_status = 1;
-                }
-                // Wait for server to terminate
-                if (wait(NULL) == -1) {
-                    perror("wait");
-                    exit_status = 1;
-                }
-                return exit_status;
-            }
+    // Print header
+    if (report_format == REPORT_TEXT) {
+        printf("Score\tRating\tErrors\tFunction\n");
+    } else {
+        report_begin(stdout, report_format);
+    }
 
-            default: {
-                // Should never happen
-                printf("Error: Invalid message type received from server\n");
-                shmdt(sh_buf);
-                return 1;
-            }
-        }
+    int exit_status = serve_channel(&channels[0], 0);
+    if (shmdt(channels) == -1) {
+        perror("shmdt");
+        exit_status = 1;
+    }
+    if (exit_status != 0) {
+        return exit_status;
+    }
 
-        // Indicate to server that client's reply is ready
-        if (sema_post(&sh_buf->ready_for_server) == -1) {
-            perror("sem_post");
-            shmdt(sh_buf);
-            return 1;
+    // Wait for server and other workers to terminate
+    for (int i = 0; i < n_workers; i++) {
+        if (wait(NULL) == -1) {
+            perror("wait");
+            exit_status = 1;
         }
     }
+    return exit_status;
 }
@@ -9,34 +9,35 @@
  * around zero and tmin and tmax for integer puzzles, and zero, norm,
  * and denorm boundaries for floating point puzzles.
  *
- * Note: not 64-bit safe. Always compile with gcc -m32 option.
+ * The server used to be built with gcc -m32. It is now built 64-bit, and
+ * "make test-builds" checks that the 32-bit and 64-bit builds generate the
+ * same test cases and expected outputs, and lay out messages the same way.
  */
 #include <assert.h>
+#include <getopt.h>
 #include <limits.h>
-#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "bits_test.h"
 #include "dl_protocol.h"
+#include "golden.h"
+#include "profile.h"
+#include "rng.h"
+#include "testgen.h"
 #include "utils.h"
 #include "sema.h"
 
-/* For functions with a single argument, generate TEST_RANGE values
-   above and below the min and max test values, and above and below
-   zero. Functions with two or three args will use square and cube
-   roots of this value, respectively, to avoid combinatorial
-   explosion */
-#define TEST_RANGE 500000
-
-/* This defines the maximum size of any test value array. The
-   gen_vals() routine creates k test values for each value of
-   TEST_RANGE, thus MAX_TEST_VALS must be at least k*TEST_RANGE */
-#define MAX_TEST_VALS 13*TEST_RANGE
+/* In exhaustive mode (-x), the 2^32 inputs to a single-argument
+   function are split into this many equally-sized shards */
+#define EXHAUSTIVE_SHARDS 64
 
 enum function_id all_funcs[] = {
     BIT_MATCH,
@@ -60,374 +61,1082 @@ static char *test_fname = NULL;
 static int has_arg[] = {0, 0};
 static unsigned argval[] = {0, 0};
 
-// random_val - Return random integer value between min and max
-static int random_val(int min, int max) {
-    double weight = rand()/(double) RAND_MAX;
-    int result = min * (1-weight) + max * weight;
-    return result;
+/* Where golden files with the expected outputs of each function's sampled
+   test vectors live (-G). Off by default, since the directory btest runs in
+   is the submission's, and a student could plant files there. */
+static const char *golden_dir = NULL;
+
+/* Seed for random test values (-s) */
+static uint64_t seed = RNG_SEED_DEFAULT;
+
+/* Keep testing after failures (-a), reporting up to max_examples of them (-k) */
+#define COUNTEREXAMPLES_DEFAULT 5
+static int collect_all = 0;
+static unsigned max_examples = COUNTEREXAMPLES_DEFAULT;
+
+/* Functions the client already has a cached result for (-K) */
+static int cached[NUM_PUZZLES];
+
+/* Test every possible input to single-argument functions (-x) */
+static int exhaustive = 0;
+
+/* Number of validation threads (-V), by default one per core */
+static int n_validate_threads = -1;
+
+/* Brief output for grading purposes (-g), suppresses progress messages */
+static int grade_mode = 0;
+
+/* Handoff counters gathered from every thread, printed with -S */
+static int print_sema_stats = 0;
+static sema_stats_t server_sema_stats;
+static pthread_mutex_t sema_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Time spent in each phase of testing each function (--profile), written to
+   profile_path. Nothing is timed unless profiling is set. */
+#define PROFILE_PATH_DEFAULT "btest_profile.json"
+static int profiling = 0;
+static const char *profile_path = PROFILE_PATH_DEFAULT;
+static function_profile_t profiles[NUM_PUZZLES];
+
+// collect_sema_stats - Fold the calling thread's handoff counters into the totals
+static void collect_sema_stats(void) {
+    sema_stats_t stats;
+    sema_get_stats(&stats);
+    pthread_mutex_lock(&sema_stats_lock);
+    sema_add_stats(&server_sema_stats, &stats);
+    pthread_mutex_unlock(&sema_stats_lock);
 }
 
-// gen_vals - Generate the integer values we'll use to test a function
-static int gen_vals(int test_vals[], int min, int max, int test_range, int arg_pos, int is_float) {
-    int test_count = 0;
+// find_mismatch - Index of the first of len results, stored stride ints apart,
+// that differs from expected, or -1 if they all match
+static int find_mismatch(const int *results, unsigned stride, const int *expected, unsigned len) {
+    for (unsigned i = 0; i < len; i++) {
+        if (results[i * stride] != expected[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    /* Special case: If the user has specified a specific function
-       argument using the -1, -2, or -3 flags, then simply use this
-       argument and return */
-    if (has_arg[arg_pos] != 0) {
-        test_vals[0] = argval[arg_pos];
-        return 1;
+// validate_test_results - Check a batch of results returned by the client. If golden is
+// non-NULL it holds the expected output of each case in the batch, otherwise expected
+// outputs come from the reference implementations. Returns the index of the first
+// incorrect result, filling in *result with the details of the failure, or -1 if every
+// result in the batch is correct.
+int validate_test_results(int *batch_elems, unsigned batch_size, enum function_id func,
+        unsigned num_args, const int *golden, function_result_t *result) {
+    if (func >= NUM_PUZZLES) {
+        // Should never happen
+        fprintf(stderr, "Invalid function ID for validate_test_results\n");
+        return -1;
     }
 
-    /*
-     * Special case: Generate test vals for floating point functions
-     * where the input argument is an unsigned bit-level
-     * representation of a float. For this case we want to test the
-     * regions around zero, the smallest normalized and largest
-     * denormalized numbers, one, and the largest normalized number,
-     * as well as inf and nan.
-     */
-    if (is_float) {
-        unsigned smallest_norm = 0x00800000;
-        unsigned one = 0x3f800000;
-        unsigned largest_norm = 0x7f000000;
+    unsigned stride = num_args + 1;
+    const int *results = batch_elems + batch_result_offset(num_args);
 
-        unsigned inf = 0x7f800000;
-        unsigned nan =  0x7fc00000;
-        unsigned sign = 0x80000000;
+    if (golden != NULL) {
+        int i = find_mismatch(results, stride, golden, batch_size);
+        if (i != -1) {
+            const int *elem = batch_elems + i * stride;
+            result->function_id = func;
+            result->arg1 = num_args > 0 ? elem[0] : 0;
+            result->arg2 = num_args == 2 ? elem[1] : 0;
+            result->expected_output = golden[i];
+            result->actual_output = results[i * stride];
+        }
+        return i;
+    }
+
+    int arg1[VALIDATE_CHUNK] = {};
+    int arg2[VALIDATE_CHUNK] = {};
+    int expected[VALIDATE_CHUNK];
+    for (unsigned base = 0; base < batch_size; base += VALIDATE_CHUNK) {
+        unsigned len = batch_size - base < VALIDATE_CHUNK ? batch_size - base : VALIDATE_CHUNK;
+        testgen_oracle(func, num_args, batch_elems + base * stride, len, arg1, arg2, expected);
 
-        /* Test range should be at most 1/2 the range of one exponent
-           value */
-        if (test_range > (1 << 23)) {
-            test_range = 1 << 23;
+        int i = find_mismatch(results + base * stride, stride, expected, len);
+        if (i != -1) {
+            result->function_id = func;
+            result->arg1 = arg1[i];
+            result->arg2 = arg2[i];
+            result->expected_output = expected[i];
+            result->actual_output = results[(base + i) * stride];
+            return base + i;
         }
+    }
+    return -1;
+}
+
+/* Shrinking state of one class of failures (-a) */
+typedef struct {
+    uint64_t n_failures;
+    counterexample_t smallest;  /* smallest failing input found so far */
+    int in_flight;              /* candidates smaller than it are being tested */
+    int dirty;                  /* smallest changed since candidates were last sent */
+} class_state_t;
+
+/* State shared by all of the channel threads while they test one function.
+   Test cases are numbered 0..total_cases-1 and handed out in order, one
+   batch at a time, to whichever channel asks next. */
+typedef struct {
+    pthread_mutex_t lock;
+    test_vectors_t vec;         /* the function and its test cases */
+    uint64_t next_case;         /* first case not yet handed out */
+    int stop;                   /* set once a failure makes further batches pointless */
+    int error;                  /* set if any channel hit a communication error */
+    uint64_t fail_index;        /* case number of the earliest failure found so far */
+    enum test_outcome outcome;
+    function_result_t result;
+    failure_report_t failures;  /* every failure, in collect-all mode (-a) */
+    uint64_t example_index[MAX_COUNTEREXAMPLES]; /* case number of each example kept */
+    class_state_t classes[MAX_FAILURE_CLASSES]; /* failures grouped by getFailureClass() */
+    uint64_t shard_passed[EXHAUSTIVE_SHARDS]; /* cases passed in each exhaustive shard */
+    const int *golden;          /* expected output of every case, if cached on disk */
+    function_stats_t stats;     /* cost of testing, reported with the result */
+    function_profile_t profile; /* every channel thread's phases (--profile) */
+} test_run_t;
+
+/* Server's view of one worker channel, kept from one function to the next */
+typedef struct {
+    shmem_buf_t *ring;
+    uint32_t next_seq;          /* sequence number of the next message to send */
+} channel_t;
 
-        /* Functions where the input argument is an unsigned bit-level
-           representation of a float. The number of tests generated
-           inside this loop body is the value k referenced in the
-           comment for the global variable MAX_TEST_VALS. */
-        for (int i = 0; i < test_range; i++) {
-            /* Denorms around zero */
-            test_vals[test_count++] = i;
-            test_vals[test_count++] = sign | i;
+/* One thread drives each worker channel */
+typedef struct {
+    test_run_t *run;
+    channel_t *chan;
+    int first_claimed;          /* first batch was handed out before the thread started */
+    uint64_t first_start;
+    unsigned first_count;
+    enum test_outcome previous_outcome; /* result to piggyback on first batch */
+    function_result_t previous_result;
+    failure_report_t previous_failures;
+    function_stats_t previous_stats;
+    uint64_t batch_start[RING_SLOTS];   /* what each slot's batch holds */
+    unsigned batch_count[RING_SLOTS];
+    int batch_shrinking[RING_SLOTS];    /* batch holds shrinking candidates, not test cases */
+    int validating[RING_SLOTS];         /* slot's reply is with the validation pool (pool.lock) */
+    int validate_error;                 /* the pool found an invalid reply (pool.lock) */
+    pthread_cond_t validated;           /* signalled when the pool finishes one of its replies */
+} channel_ctx_t;
 
-            /* Region around norm to denorm transition */
-            test_vals[test_count++] = smallest_norm + i;
-            test_vals[test_count++] = smallest_norm - i;
-            test_vals[test_count++] = sign | (smallest_norm + i);
-            test_vals[test_count++] = sign | (smallest_norm - i);
+/* Threads that validate replies for every channel (-V), so that a channel
+   thread can go straight back to feeding its worker. Replies are validated in
+   any order: failures are kept by case number, so the result is the same. */
+typedef struct {
+    channel_ctx_t *ctx;
+    unsigned idx;               /* slot holding the reply */
+} validate_job_t;
 
-            /* Region around one */
-            test_vals[test_count++] = one + i;
-            test_vals[test_count++] = one - i;
-            test_vals[test_count++] = sign | (one + i);
-            test_vals[test_count++] = sign | (one - i);
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t has_jobs;
+    validate_job_t *jobs;       /* queue of replies waiting for a thread */
+    unsigned head, n_jobs, capacity;
+    int closing;
+    pthread_t *threads;
+    unsigned n_threads;         /* 0 if channel threads validate their own replies */
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .has_jobs = PTHREAD_COND_INITIALIZER,
+};
 
-            /* Region below largest norm */
-            test_vals[test_count++] = largest_norm - i;
-            test_vals[test_count++] = sign | (largest_norm - i);
+// claim_cases - Hand out the next batch of test cases. Returns 0 if there is
+// nothing left to test for the current function.
+static int claim_cases(test_run_t *run, uint64_t *start, unsigned *count) {
+    int claimed = 0;
+    pthread_mutex_lock(&run->lock);
+    if (!run->stop && run->next_case < run->vec.total_cases) {
+        uint64_t remaining = run->vec.total_cases - run->next_case;
+        *start = run->next_case;
+        *count = remaining < MAX_BATCH_CASES ? remaining : MAX_BATCH_CASES;
+        run->next_case += *count;
+        claimed = 1;
+    }
+    pthread_mutex_unlock(&run->lock);
+    return claimed;
+}
+
+// add_example - Keep a failure if it's among the first max_examples distinct ones
+// by case number. Call with run->lock held.
+static void add_example(test_run_t *run, uint64_t fail_index, enum test_outcome outcome,
+        const function_result_t *result) {
+    failure_report_t *failures = &run->failures;
+    unsigned n = failures->n_examples;
+
+    // The same inputs can appear more than once, keep just the earliest
+    for (unsigned i = 0; i < n; i++) {
+        counterexample_t *example = &failures->examples[i];
+        if (example->outcome == outcome && example->result.arg1 == result->arg1 &&
+                example->result.arg2 == result->arg2) {
+            if (fail_index > run->example_index[i]) {
+                return;
+            }
+            // Drop the later copy, then insert this one below
+            memmove(&failures->examples[i], &failures->examples[i + 1],
+                    (n - i - 1) * sizeof(counterexample_t));
+            memmove(&run->example_index[i], &run->example_index[i + 1],
+                    (n - i - 1) * sizeof(uint64_t));
+            n--;
+            break;
         }
+    }
+
+    unsigned pos = n;
+    while (pos > 0 && run->example_index[pos - 1] > fail_index) {
+        pos--;
+    }
+    if (pos >= max_examples) {
+        failures->n_examples = n;
+        return;
+    }
+    if (n == max_examples) {
+        n--;
+    }
+    memmove(&failures->examples[pos + 1], &failures->examples[pos],
+            (n - pos) * sizeof(counterexample_t));
+    memmove(&run->example_index[pos + 1], &run->example_index[pos],
+            (n - pos) * sizeof(uint64_t));
+    failures->examples[pos].outcome = outcome;
+    failures->examples[pos].result = *result;
+    failures->examples[pos].result.function_id = run->vec.func;
+    run->example_index[pos] = fail_index;
+    failures->n_examples = n + 1;
+}
+
+// shrink_less - Order failing inputs for shrinking: fewest set bits first, then
+// closest to 0, then by bit pattern so the order is total
+static int shrink_less(unsigned num_args, const function_result_t *a, const function_result_t *b) {
+    int bits_a = __builtin_popcount(a->arg1) + (num_args == 2 ? __builtin_popcount(a->arg2) : 0);
+    int bits_b = __builtin_popcount(b->arg1) + (num_args == 2 ? __builtin_popcount(b->arg2) : 0);
+    if (bits_a != bits_b) {
+        return bits_a < bits_b;
+    }
+    uint64_t mag_a = llabs((long long) a->arg1) + (num_args == 2 ? llabs((long long) a->arg2) : 0);
+    uint64_t mag_b = llabs((long long) b->arg1) + (num_args == 2 ? llabs((long long) b->arg2) : 0);
+    if (mag_a != mag_b) {
+        return mag_a < mag_b;
+    }
+    if (a->arg1 != b->arg1) {
+        return (unsigned) a->arg1 < (unsigned) b->arg1;
+    }
+    return (unsigned) a->arg2 < (unsigned) b->arg2;
+}
+
+// add_to_class - Count a failure in its class, and make it the class's
+// representative if it's the smallest seen. Call with run->lock held.
+static void add_to_class(test_run_t *run, enum test_outcome outcome, const function_result_t *result) {
+    class_state_t *class = &run->classes[getFailureClass(run->vec.func, result->arg1, result->arg2)];
+    if (class->n_failures == 0 || shrink_less(run->vec.num_args, result, &class->smallest.result)) {
+        class->smallest.outcome = outcome;
+        class->smallest.result = *result;
+        class->smallest.result.function_id = run->vec.func;
+        class->dirty = 1;
+    }
+    class->n_failures++;
+}
 
-        /* special vals */
-        test_vals[test_count++] = inf;        /* inf */
-        test_vals[test_count++] = sign | inf; /* -inf */
-        test_vals[test_count++] = nan;        /* nan */
-        test_vals[test_count++] = sign | nan; /* -nan */
+// record_failure - Remember a failure found at case fail_index, keeping only the
+// earliest one so the reported failure doesn't depend on thread scheduling. In
+// collect-all mode (-a), every failure is counted and only a timeout stops testing.
+static void record_failure(test_run_t *run, uint64_t fail_index, enum test_outcome outcome,
+        const function_result_t *result) {
+    pthread_mutex_lock(&run->lock);
+    if (run->outcome == SUCCESS || fail_index < run->fail_index) {
+        run->fail_index = fail_index;
+        run->outcome = outcome;
+        run->result = *result;
+        run->result.function_id = run->vec.func;
+    }
+    if (collect_all) {
+        run->failures.n_failures++;
+        add_example(run, fail_index, outcome, result);
+        add_to_class(run, outcome, result);
+    }
+    if (!collect_all || outcome == TIMEOUT) {
+        run->stop = 1;
+        run->failures.stopped = 1;
+    }
+    pthread_mutex_unlock(&run->lock);
+}
+
+// record_batch_stats - Add a finished batch's cost to the function's totals
+static void record_batch_stats(test_run_t *run, uint64_t cpu_ns, unsigned n_tested) {
+    pthread_mutex_lock(&run->lock);
+    run->stats.n_tests += n_tested;
+    run->stats.cpu_ns += cpu_ns;
+    pthread_mutex_unlock(&run->lock);
+}
 
-        return test_count;
+// record_shard_progress - In exhaustive mode, report each shard as soon as all of
+// its cases have passed
+static void record_shard_progress(test_run_t *run, uint64_t start, unsigned count) {
+    uint64_t shard_size = EXHAUSTIVE_SPACE / EXHAUSTIVE_SHARDS;
+    unsigned shard = start / shard_size;
+    pthread_mutex_lock(&run->lock);
+    run->shard_passed[shard] += count;
+    if (run->shard_passed[shard] == shard_size && !grade_mode) {
+        fprintf(stderr, "  %s: shard %u/%u [0x%08x, 0x%08x] passed\n", getFuncName(run->vec.func),
+                shard + 1, EXHAUSTIVE_SHARDS, (uint32_t) (shard * shard_size),
+                (uint32_t) ((shard + 1) * shard_size - 1));
     }
+    pthread_mutex_unlock(&run->lock);
+}
 
+// collect_failures - Record every failure in a batch the client ran in collect-all
+// mode (-a): each case marked as crashed, each wrong result, and a timeout if the
+// client didn't get through the whole batch
+static void collect_failures(test_run_t *run, test_batch_t *test_batch, uint64_t start,
+        unsigned count, const int *expected) {
+    unsigned num_args = run->vec.num_args;
+    unsigned stride = num_args + 1;
+    const int *results = test_batch->elems + batch_result_offset(num_args);
+    unsigned n_run = test_batch->n_run < count ? test_batch->n_run : count;
 
-    /*
-     * Normal case: Generate test vals for integer functions
-     */
+    for (unsigned i = 0; i < n_run; i++) {
+        enum test_outcome outcome;
+        if (test_batch->n_crashes > 0 && test_batch->crashes[i] != SUCCESS) {
+            outcome = test_batch->crashes[i];
+        } else if (results[i * stride] != expected[i]) {
+            outcome = FAILURE;
+        } else {
+            continue;
+        }
+        const int *elem = test_batch->elems + i * stride;
+        function_result_t result = {
+            .arg1 = num_args > 0 ? elem[0] : 0,
+            .arg2 = num_args == 2 ? elem[1] : 0,
+            .expected_output = expected[i],
+            .actual_output = outcome == FAILURE ? results[i * stride] : 0,
+        };
+        record_failure(run, start + i, outcome, &result);
+    }
 
-    /* If the range is small enough, then do exhaustively */
-    if (max - MAX_TEST_VALS <= min) {
-        for (int i = min; i <= max; i++)
-            test_vals[test_count++] = i;
-        return test_count;
+    if (n_run < count) {
+        const int *elem = test_batch->elems + n_run * stride;
+        function_result_t result = {
+            .arg1 = num_args > 0 ? elem[0] : 0,
+            .arg2 = num_args == 2 ? elem[1] : 0,
+            .expected_output = expected[n_run],
+        };
+        record_failure(run, start + n_run, TIMEOUT, &result);
     }
+}
 
-    /* Otherwise, need to sample.  Do so near the boundaries, around
-       zero, and for some random cases. */
-    for (int i = 0; i < test_range; i++) {
-        /* Test around the boundaries */
-        test_vals[test_count++] = min + i;
-        test_vals[test_count++] = max - i;
+// add_candidates - Write inputs that might still fail but are smaller than
+// smallest, staying within its class and the function's argument ranges.
+// Returns the number of candidates written to elems.
+static unsigned add_candidates(const test_run_t *run, const function_result_t *smallest, int *elems) {
+    unsigned num_args = run->vec.num_args;
+    unsigned stride = num_args + 1;
+    unsigned n = 0;
+    if (num_args == 0) {
+        return 0;
+    }
+    unsigned failure_class = getFailureClass(run->vec.func, smallest->arg1, smallest->arg2);
 
-        /* If zero falls between min and max, then also test around zero */
-        if (i >= min && i <= max) {
-            test_vals[test_count++] = i;
+    for (unsigned pos = 0; pos < num_args; pos++) {
+        int value = pos == 0 ? smallest->arg1 : smallest->arg2;
+        int tries[32 + 8];
+        unsigned n_tries = 0;
+        // Clear any one set bit, or move towards 0
+        for (int bit = 0; bit < 32; bit++) {
+            if (value & (1u << bit)) {
+                tries[n_tries++] = value & ~(1u << bit);
+            }
         }
-        if (-i >= min && -i <= max) {
-            test_vals[test_count++] = -i;
+        tries[n_tries++] = value >> 1;
+        tries[n_tries++] = value / 2;
+        tries[n_tries++] = value > 0 ? value - 1 : value + 1;
+        tries[n_tries++] = 0;
+        tries[n_tries++] = 1;
+        tries[n_tries++] = -1;
+        tries[n_tries++] = INT_MIN;
+
+        /* Float arguments are bit patterns, any of which is valid */
+        int is_float = run->vec.func == FLOAT_ABS_VAL || run->vec.func == FLOAT_SCALE_4;
+        for (unsigned i = 0; i < n_tries; i++) {
+            function_result_t candidate = *smallest;
+            if (pos == 0) {
+                candidate.arg1 = tries[i];
+            } else {
+                candidate.arg2 = tries[i];
+            }
+            if (!is_float && (tries[i] < getFuncMinArg(run->vec.func, pos + 1) ||
+                        tries[i] > getFuncMaxArg(run->vec.func, pos + 1))) {
+                continue;
+            }
+            if (getFailureClass(run->vec.func, candidate.arg1, candidate.arg2) != failure_class ||
+                    !shrink_less(num_args, &candidate, smallest)) {
+                continue;
+            }
+            int *elem = elems + n * stride;
+            elem[0] = candidate.arg1;
+            if (num_args == 2) {
+                elem[1] = candidate.arg2;
+            }
+            n++;
         }
-        /* Random case between min and max */
-        test_vals[test_count++] = random_val(min, max);
+    }
+    return n;
+}
 
+// take_shrink_batch - Gather candidates for every class whose smallest failure
+// has changed since its candidates were last sent (-a). Returns the number of
+// candidates written to elems, 0 if there is nothing to shrink.
+static unsigned take_shrink_batch(test_run_t *run, int *elems) {
+    unsigned n = 0;
+    pthread_mutex_lock(&run->lock);
+    for (unsigned c = 0; c < MAX_FAILURE_CLASSES && !run->stop; c++) {
+        class_state_t *class = &run->classes[c];
+        if (!class->dirty || class->in_flight) {
+            continue;
+        }
+        class->dirty = 0;
+        unsigned added = add_candidates(run, &class->smallest.result, elems + n * (run->vec.num_args + 1));
+        class->in_flight = added > 0;
+        n += added;
     }
-    return test_count;
+    pthread_mutex_unlock(&run->lock);
+    return n;
 }
 
-void validate_test_results(int *batch_elems, unsigned batch_size, enum function_id func,
-        unsigned num_args, enum test_outcome *previous_outcome, function_result_t *previous_result) {
+// shrink_results - Check a batch of shrinking candidates. Any that still fail
+// become the smallest in their class and are shrunk further. A timeout stops
+// shrinking the classes in the batch, as their remaining candidates weren't run.
+static void shrink_results(test_run_t *run, test_batch_t *test_batch, unsigned count, int *expected) {
+    unsigned num_args = run->vec.num_args;
+    unsigned stride = num_args + 1;
+    const int *results = test_batch->elems + batch_result_offset(num_args);
+    unsigned n_run = test_batch->n_run < count ? test_batch->n_run : count;
+    testgen_expected(&run->vec, test_batch->elems, count, expected);
 
-    for (int i = 0; i < batch_size; i++) {
-        int j = i * (num_args + 1);
-        int arg1 = batch_elems[j];
-        int arg2;
-        j++;
-        if (num_args == 2) {
-            arg2 = batch_elems[j];
-            j++;
+    pthread_mutex_lock(&run->lock);
+    for (unsigned i = 0; i < count; i++) {
+        const int *elem = test_batch->elems + i * stride;
+        function_result_t result = {
+            .function_id = run->vec.func,
+            .arg1 = elem[0],
+            .arg2 = num_args == 2 ? elem[1] : 0,
+            .expected_output = expected[i],
+        };
+        class_state_t *class = &run->classes[getFailureClass(run->vec.func, result.arg1, result.arg2)];
+        class->in_flight = 0;
+        if (i >= n_run) {
+            class->dirty = 0;
+            continue;
         }
-        int actual_result = batch_elems[j];
 
-        int expected_result;
-        switch (func) {
-            case BIT_MATCH:
-                expected_result = test_bitMatch(arg1, arg2);
-                break;
-            case EVEN_BITS:
-                expected_result = test_evenBits();
-                break;
-            case ALL_ODD_BITS:
-                expected_result = test_allOddBits(arg1);
-                break;
-            case FLOAT_ABS_VAL:
-                expected_result = test_floatAbsVal(arg1);
-                break;
-            case IMPLICATION:
-                expected_result = test_implication(arg1, arg2);
-                break;
-            case IS_NEGATIVE:
-                expected_result = test_isNegative(arg1);
-                break;
-            case SIGN:
-                expected_result = test_sign(arg1);
-                break;
-            case IS_GREATER:
-                expected_result = test_isGreater(arg1, arg2);
-                break;
-            case LOGICAL_SHIFT:
-                expected_result = test_logicalShift(arg1, arg2);
-                break;
-            case ROTATE_RIGHT:
-                expected_result = test_rotateRight(arg1, arg2);
-                break;
-            case FLOAT_SCALE_4:
-                expected_result = test_floatScale4(arg1);
+        enum test_outcome outcome = FAILURE;
+        if (test_batch->n_crashes > 0 && test_batch->crashes[i] != SUCCESS) {
+            outcome = test_batch->crashes[i];
+        } else if (results[i * stride] != expected[i]) {
+            result.actual_output = results[i * stride];
+        } else {
+            continue;
+        }
+        if (shrink_less(num_args, &result, &class->smallest.result)) {
+            class->smallest.outcome = outcome;
+            class->smallest.result = result;
+            class->dirty = 1;
+        }
+    }
+    pthread_mutex_unlock(&run->lock);
+}
+
+// batch_bytes - Size of the test case data in a batch of count cases
+static uint64_t batch_bytes(const test_run_t *run, unsigned count) {
+    unsigned num_args = run->vec.num_args;
+    return (uint64_t) count * (num_args > 0 ? num_args + 1 : 1) * sizeof(int);
+}
+
+// merge_profile - Add a channel thread's phases to the function's profile
+static void merge_profile(test_run_t *run, const function_profile_t *profile) {
+    pthread_mutex_lock(&run->lock);
+    profile_add(&run->profile, profile);
+    pthread_mutex_unlock(&run->lock);
+}
+
+// send_message - Publish the message already placed in the channel's next slot
+// to the client. Returns 0 on success, -1 on error.
+static int send_message(channel_t *chan, enum message_type type) {
+    ring_slot_t *slot = &chan->ring->slots[chan->next_seq % RING_SLOTS];
+    slot->seq = chan->next_seq;
+    slot->type = type;
+    if (sema_post(&slot->ready_for_client) == -1) {
+        perror("sema_post");
+        return -1;
+    }
+    chan->next_seq++;
+    return 0;
+}
+
+// validate_batch - Check the reply in slot idx of a channel against the
+// expected outputs, recording any failure. expected is scratch space for
+// MAX_BATCH_CASES outputs, needed in collect-all mode (-a). Returns 0 on
+// success, -1 if the reply makes no sense.
+static int validate_batch(channel_ctx_t *ctx, unsigned idx, int *expected) {
+    test_run_t *run = ctx->run;
+    ring_slot_t *slot = &ctx->chan->ring->slots[idx];
+    uint64_t start = ctx->batch_start[idx];
+    unsigned count = ctx->batch_count[idx];
+    function_result_t result = {};
+    switch (slot->type) {
+        case TIMEOUT_FAILURE:
+            record_failure(run, start, TIMEOUT, &result);
+            break;
+        case SEGFAULT_FAILURE:
+            record_failure(run, start, SEGFAULT, &result);
+            break;
+        case SIGFPE_FAILURE:
+            record_failure(run, start, FLOAT_ERROR, &result);
+            break;
+        case TEST_RESULT_BATCH: {
+            test_batch_t *test_batch = (test_batch_t *) slot->payload;
+            const int *golden = run->golden != NULL ? run->golden + start : NULL;
+            if (ctx->batch_shrinking[idx]) {
+                shrink_results(run, test_batch, count, expected);
                 break;
-            case GREATEST_BIT_POS:
-                expected_result = test_greatestBitPos(arg1);
+            }
+            if (collect_all) {
+                if (golden == NULL) {
+                    testgen_expected(&run->vec, test_batch->elems, count, expected);
+                }
+                collect_failures(run, test_batch, start, count, golden != NULL ? golden : expected);
                 break;
-            default:
-                // Should never happen
-                fprintf(stderr, "Invalid function ID for validate_test_results\n");
-                return;
+            }
+            int failed_at = validate_test_results(test_batch->elems, count, run->vec.func,
+                    run->vec.num_args, golden, &result);
+            if (failed_at != -1) {
+                record_failure(run, start + failed_at, FAILURE, &result);
+            } else if (run->vec.exhaustive) {
+                record_shard_progress(run, start, count);
+            }
+            break;
         }
+        default:
+            // Should never happen
+            fprintf(stderr, "run_test: Invalid message type received\n");
+            return -1;
+    }
+    return 0;
+}
 
-        if (actual_result != expected_result) {
-            *previous_outcome = FAILURE;
-            previous_result->function_id = func;
-            previous_result->arg1 = arg1;
-            previous_result->arg2 = arg2;
-            previous_result->expected_output = expected_result;
-            previous_result->actual_output = actual_result;
-            return;
+// profile_validation - validate_batch(), adding its cost to *profile when profiling
+static int profile_validation(channel_ctx_t *ctx, unsigned idx, int *expected,
+        function_profile_t *profile) {
+    if (!profiling) {
+        return validate_batch(ctx, idx, expected);
+    }
+    profile_mark_t mark;
+    profile_begin(&mark);
+    int rc = validate_batch(ctx, idx, expected);
+    /* Results are read, as well as any golden outputs */
+    uint64_t bytes = batch_bytes(ctx->run, ctx->batch_count[idx]);
+    if (ctx->run->golden != NULL && !ctx->batch_shrinking[idx]) {
+        bytes += ctx->batch_count[idx] * sizeof(int);
+    }
+    profile_end(&profile->phases[PHASE_VALIDATE], &mark, bytes);
+    return rc;
+}
+
+// validate_thread - Thread body: validate replies queued by channel threads
+// until the pool is closed
+static void *validate_thread(void *arg) {
+    int *expected = NULL;
+    if (collect_all) {
+        expected = malloc(MAX_BATCH_CASES * sizeof(int));
+        if (expected == NULL) {
+            perror("malloc");
+            exit(1);
         }
     }
-    *previous_outcome = SUCCESS;
-    previous_result->function_id = func;
+    pthread_mutex_lock(&pool.lock);
+    while (1) {
+        while (pool.n_jobs == 0 && !pool.closing) {
+            pthread_cond_wait(&pool.has_jobs, &pool.lock);
+        }
+        if (pool.n_jobs == 0) {
+            break;
+        }
+        validate_job_t job = pool.jobs[pool.head];
+        pool.head = (pool.head + 1) % pool.capacity;
+        pool.n_jobs--;
+        pthread_mutex_unlock(&pool.lock);
+
+        function_profile_t profile = {};
+        int rc = profile_validation(job.ctx, job.idx, expected, &profile);
+        if (profiling) {
+            merge_profile(job.ctx->run, &profile);
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        job.ctx->validating[job.idx] = 0;
+        if (rc == -1) {
+            job.ctx->validate_error = 1;
+        }
+        pthread_cond_signal(&job.ctx->validated);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    free(expected);
+    return NULL;
 }
 
-int run_test(shmem_buf_t *sh_buf, enum function_id func, enum test_outcome *previous_outcome,
-        function_result_t *previous_result) {
-    test_batch_t *test_batch = (test_batch_t *) sh_buf->payload;
-    test_batch->function_id = func;
-    unsigned num_args = getNumArgs(func);
-    // Each test case needs to store arguments and another int for the result
-    size_t remaining_payload_bytes = MSG_BUF_SIZE - (sizeof(enum test_outcome) + sizeof(function_result_t) +
-            sizeof(enum function_id) + sizeof(unsigned));
-    size_t max_batch_size = remaining_payload_bytes / (sizeof(int) * (num_args + 1));
-
-    int test_counts[2];         /* number of test values for each arg */
-    int arg_test_range[2] = {}; /* test range for each argument */
-
-    /* These are the test values for each arg. Declared with the
-       static attribute so that the array will be allocated in bss
-       rather than the stack */
-    static int arg_test_vals[2][MAX_TEST_VALS];
-    /* Assign range of argument test vals so as to conserve the total
-       number of tests, independent of the number of arguments */
-    if (num_args == 0) {
-        arg_test_range[0] = 0;
-    } else if (num_args == 1) {
-        arg_test_range[0] = TEST_RANGE;
+// start_pool - Start n_threads validation threads, room for the replies of
+// n_channels channels. With no threads, channel threads validate their own replies.
+static void start_pool(unsigned n_threads, unsigned n_channels) {
+    if (n_threads == 0) {
+        return;
+    }
+    pool.capacity = n_channels * RING_SLOTS;
+    pool.jobs = malloc(pool.capacity * sizeof(validate_job_t));
+    pool.threads = malloc(n_threads * sizeof(pthread_t));
+    if (pool.jobs == NULL || pool.threads == NULL) {
+        perror("malloc");
+        exit(1);
     }
-    else {
-        assert(num_args == 2);
-        arg_test_range[0] = pow((double)TEST_RANGE, 0.5);  /* sqrt */
-        arg_test_range[1] = arg_test_range[0];
+    for (unsigned i = 0; i < n_threads; i++) {
+        if (pthread_create(&pool.threads[i], NULL, validate_thread, NULL) != 0) {
+            fprintf(stderr, "start_pool: Failed to start validation thread\n");
+            exit(1);
+        }
     }
+    pool.n_threads = n_threads;
+}
 
-    /* Sanity check on the ranges */
-    if (arg_test_range[0] < 1) {
-        arg_test_range[0] = 1;
+// stop_pool - Let the validation threads finish and wait for them
+static void stop_pool(void) {
+    pthread_mutex_lock(&pool.lock);
+    pool.closing = 1;
+    pthread_cond_broadcast(&pool.has_jobs);
+    pthread_mutex_unlock(&pool.lock);
+    for (unsigned i = 0; i < pool.n_threads; i++) {
+        pthread_join(pool.threads[i], NULL);
     }
-    if (arg_test_range[1] < 1) {
-        arg_test_range[1] = 1;
+    free(pool.threads);
+    free(pool.jobs);
+}
+
+// submit_validation - Queue the reply in slot idx for a validation thread
+static void submit_validation(channel_ctx_t *ctx, unsigned idx) {
+    pthread_mutex_lock(&pool.lock);
+    ctx->validating[idx] = 1;
+    pool.jobs[(pool.head + pool.n_jobs) % pool.capacity] = (validate_job_t) {
+        .ctx = ctx,
+        .idx = idx,
+    };
+    pool.n_jobs++;
+    pthread_cond_signal(&pool.has_jobs);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// reclaim_slots - Advance *free_seq past messages whose replies have been
+// validated, waiting for the oldest one first if wait is set. Returns 0 on
+// success, -1 if a validation thread found an invalid reply.
+static int reclaim_slots(channel_ctx_t *ctx, uint32_t *free_seq, uint32_t done_seq, int wait) {
+    pthread_mutex_lock(&pool.lock);
+    while (wait && ctx->validating[*free_seq % RING_SLOTS]) {
+        pthread_cond_wait(&ctx->validated, &pool.lock);
     }
+    while (*free_seq != done_seq && !ctx->validating[*free_seq % RING_SLOTS]) {
+        (*free_seq)++;
+    }
+    int failed = ctx->validate_error;
+    pthread_mutex_unlock(&pool.lock);
+    return failed ? -1 : 0;
+}
 
-    /* Create a test set for each argument */
-    for (int i = 0; i < num_args; i++) {
-        int is_float;
-        switch (func) {
-            case FLOAT_ABS_VAL:
-            case FLOAT_SCALE_4:
-                is_float = 1;
-                break;
-            default:
-                is_float = 0;
+// drive_channel - Thread body: keep one worker busy with batches until the
+// current function's tests are exhausted or a failure is found. Up to
+// RING_SLOTS batches are queued at once, so the next batch is generated and
+// the previous one validated while the worker runs the current one. With a
+// validation pool, replies are handed to it, and a slot is reused as soon as
+// its reply has been validated.
+static void *drive_channel(void *arg) {
+    channel_ctx_t *ctx = arg;
+    test_run_t *run = ctx->run;
+    channel_t *chan = ctx->chan;
+
+    uint32_t done_seq = chan->next_seq; /* oldest message still awaiting a reply */
+    uint32_t free_seq = chan->next_seq; /* oldest message whose slot is still in use */
+    int first = 1;
+    function_profile_t profile = {};    /* only filled in when profiling */
+    profile_mark_t mark;
+
+    /* Collect-all mode (-a) needs every expected output, not just the first mismatch */
+    int *expected = NULL;
+    if (collect_all && pool.n_threads == 0) {
+        expected = malloc(MAX_BATCH_CASES * sizeof(int));
+        if (expected == NULL) {
+            perror("malloc");
+            goto error;
         }
-        test_counts[i] =  gen_vals(arg_test_vals[i], getFuncMinArg(func, i+1),
-                getFuncMaxArg(func, i+1), arg_test_range[i], i, is_float);
     }
+    while (1) {
+        if (pool.n_threads == 0) {
+            free_seq = done_seq;
+        } else if (reclaim_slots(ctx, &free_seq, done_seq, 0) == -1) {
+            goto error;
+        }
 
-    unsigned pending_batch_size = 0;
-    unsigned batches_sent = 0;
-    int a1 = 0;
-    int a2 = 0;
+        /* Fill every free slot in the ring */
+        while (chan->next_seq - free_seq < RING_SLOTS) {
+            uint64_t start = 0;
+            unsigned count;
+            unsigned idx = chan->next_seq % RING_SLOTS;
+            test_batch_t *test_batch = (test_batch_t *) chan->ring->slots[idx].payload;
+            /* Shrinking failures found so far (-a) goes ahead of further testing,
+               so it is usually done by the time the last test cases are */
+            ctx->batch_shrinking[idx] = 0;
+            if (profiling) {
+                profile_begin(&mark);
+            }
+            if (first && ctx->first_claimed) {
+                start = ctx->first_start;
+                count = ctx->first_count;
+                testgen_fill(&run->vec, test_batch->elems, start, count);
+            } else if (collect_all && (count = take_shrink_batch(run, test_batch->elems)) > 0) {
+                ctx->batch_shrinking[idx] = 1;
+            } else if (claim_cases(run, &start, &count)) {
+                testgen_fill(&run->vec, test_batch->elems, start, count);
+            } else {
+                break;
+            }
+            if (profiling) {
+                profile_end(&profile.phases[PHASE_GENERATE], &mark, batch_bytes(run, count));
+            }
+            test_batch->function_id = run->vec.func;
+            test_batch->n_test_cases = count;
 
-    // Ugly hack to make 0-arg functions work
-    // Need while loop immediately below to iterate at least one time
-    int iterated_once = 0;
+            // If first batch on the reporting channel, report results from previous
+            // function. Otherwise, just tell client tests are still ongoing.
+            test_batch->previous_outcome = first ? ctx->previous_outcome : ONGOING;
+            if (first) {
+                test_batch->previous_result = ctx->previous_result;
+                test_batch->previous_failures = ctx->previous_failures;
+                test_batch->previous_stats = ctx->previous_stats;
+            }
+            first = 0;
 
-    while (!iterated_once || (a1 < test_counts[0] && (num_args == 1 || a2 < test_counts[1]))) {
-        iterated_once = 1;
-        while (pending_batch_size < max_batch_size && a1 < test_counts[0] && (num_args == 1 || a2 < test_counts[1])) {
-            // Each test case takes up num_args + 1 int slots in memory, so this is our starting index for current test case
-            int j = pending_batch_size * (num_args + 1);
-            test_batch->elems[j] = arg_test_vals[0][a1];
-            if (num_args == 2) {
-                test_batch->elems[j+1] = arg_test_vals[1][a2];
+            ctx->batch_start[idx] = start;
+            ctx->batch_count[idx] = count;
+            if (profiling) {
+                profile_begin(&mark);
             }
-            pending_batch_size++;
-            if (num_args == 2) {
-                a2++;
-                if (a2 == test_counts[1]) {
-                    a2 = 0;
-                    a1++;
-                }
-            } else {
-                a1++;
+            if (send_message(chan, TEST_INPUT_BATCH) == -1) {
+                goto error;
+            }
+            if (profiling) {
+                profile_end(&profile.phases[PHASE_SEND], &mark, batch_bytes(run, count));
             }
         }
-        if (batches_sent == 0) {
-            // If first batch of tests for new func, report results from previous function
-            test_batch->previous_outcome = *previous_outcome;
-            test_batch->previous_result = *previous_result;
-        } else {
-            // Otherwise, just tell client tests are still ongoing for same function
-            test_batch->previous_outcome = ONGOING;
-        }
-        if (num_args == 0) {
-            test_batch->n_test_cases = 1;
-            pending_batch_size = 1;
-        } else {
-            test_batch->n_test_cases = pending_batch_size;
+        if (done_seq == chan->next_seq) {
+            if (free_seq == done_seq) {
+                /* Nothing in flight and nothing left to hand out */
+                break;
+            }
+            /* Replies still being validated may yet call for shrinking batches (-a) */
+            if (reclaim_slots(ctx, &free_seq, done_seq, 1) == -1) {
+                goto error;
+            }
+            continue;
         }
-        sh_buf->type = TEST_INPUT_BATCH;
 
-        // Now notify client and wait for its reply
-        if (sema_post(&sh_buf->ready_for_client) == -1) {
-            perror("sema_post");
-            return -1;
+        /* Check the oldest batch while the worker runs the ones queued after it */
+        unsigned idx = done_seq % RING_SLOTS;
+        ring_slot_t *slot = &chan->ring->slots[idx];
+        if (profiling) {
+            profile_begin(&mark);
         }
-        if (sema_wait(&sh_buf->ready_for_server) == -1) {
+        if (sema_wait(&slot->ready_for_server) == -1) {
             perror("sema_wait");
-            return -1;
+            goto error;
+        }
+        if (profiling) {
+            profile_end(&profile.phases[PHASE_WAIT], &mark, 0);
+        }
+        test_batch_t *reply = (test_batch_t *) slot->payload;
+        unsigned n_tested = 0;
+        if (slot->type == TEST_RESULT_BATCH && !ctx->batch_shrinking[idx]) {
+            /* In collect-all mode (-a), a timeout ends the batch early */
+            n_tested = collect_all ? reply->n_run : ctx->batch_count[idx];
         }
+        record_batch_stats(run, reply->cpu_ns, n_tested);
+        if (profiling) {
+            /* The client timed its own part */
+            phase_stats_t *client = &profile.phases[PHASE_CLIENT];
+            client->wall_ns += reply->wall_ns;
+            client->cpu_ns += reply->cpu_ns;
+            client->bytes += batch_bytes(run, ctx->batch_count[idx]);
+            client->batches++;
+        }
+        if (pool.n_threads > 0) {
+            submit_validation(ctx, idx);
+        } else if (profile_validation(ctx, idx, expected, &profile) == -1) {
+            goto error;
+        }
+        done_seq++;
+    }
+    free(expected);
+    collect_sema_stats();
+    if (profiling) {
+        merge_profile(run, &profile);
+    }
+    return NULL;
 
-        switch (sh_buf->type) {
-            case TIMEOUT_FAILURE: {
-                *previous_outcome = TIMEOUT;
-                previous_result->function_id = func;
-                return 0;
-            }
-            case SEGFAULT_FAILURE: {
-                *previous_outcome = SEGFAULT;
-                previous_result->function_id = func;
-                return 0;
-            }
-            case SIGFPE_FAILURE: {
-                *previous_outcome = FLOAT_ERROR;
-                previous_result->function_id = func;
-                return 0;
-            }
-            case TEST_RESULT_BATCH: {
-                validate_test_results(test_batch->elems, pending_batch_size, func, num_args,
-                        previous_outcome, previous_result);
-                if (*previous_outcome == FAILURE) {
-                    return 0;
-                }
-                break;
-            }
-            default:
-                // Should never happen
-                fprintf(stderr, "run_test: Invalid message type received\n");
-                return -1;
+error:
+    /* Validation threads may still be reading this channel's slots */
+    if (pool.n_threads > 0) {
+        while (free_seq != done_seq) {
+            reclaim_slots(ctx, &free_seq, done_seq, 1);
         }
+    }
+    free(expected);
+    collect_sema_stats();
+    if (profiling) {
+        merge_profile(run, &profile);
+    }
+    pthread_mutex_lock(&run->lock);
+    run->error = 1;
+    run->stop = 1;
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
 
-        pending_batch_size = 0;
-        batches_sent++;
+// monotonic_ns - Wall clock time for measuring how long testing takes
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int run_test(channel_t *channels, unsigned n_channels, enum function_id func,
+        enum test_outcome *previous_outcome, function_result_t *previous_result,
+        failure_report_t *previous_failures, function_stats_t *previous_stats) {
+    uint64_t start_ns = monotonic_ns();
+    profile_mark_t mark;
+    if (profiling) {
+        profile_begin(&mark);
+    }
+    test_run_t run = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .outcome = cached[func] ? CACHED : SUCCESS,
+    };
+    testgen_options_t opts = {
+        .seed = seed,
+        .exhaustive = exhaustive,
+        .has_arg = {has_arg[0], has_arg[1]},
+        .argval = {argval[0], argval[1]},
+    };
+    if (cached[func]) {
+        /* Nothing to test, so nothing is generated, but the first (empty)
+           batch still carries the previous function's result */
+        run.vec = (test_vectors_t) { .func = func, .num_args = getNumArgs(func) };
+    } else {
+        testgen_init(&run.vec, func, &opts);
     }
 
+    /* Expected outputs for the sampled vectors never change between runs, so
+       they come from the golden file cache when possible */
+    golden_t golden = {};
+    if (run.vec.total_cases > 0 && !run.vec.exhaustive && !has_arg[0] && !has_arg[1]) {
+        golden_open(&golden, golden_dir, getFuncName(func), testgen_golden_key(&run.vec),
+                run.vec.total_cases, testgen_fill_golden, &run.vec);
+        run.golden = golden.expected;
+    }
+    if (profiling && run.vec.total_cases > 0) {
+        profile_end(&run.profile.phases[PHASE_SETUP], &mark,
+                run.golden != NULL ? run.vec.total_cases * sizeof(int) : 0);
+    }
+
+    /* The reporting channel (0) always takes the first batch so that it can carry
+       the previous function's result before any other channel gets to work */
+    channel_ctx_t ctxs[n_channels];
+    pthread_t threads[n_channels];
+    for (unsigned i = 0; i < n_channels; i++) {
+        ctxs[i] = (channel_ctx_t) {
+            .run = &run,
+            .chan = &channels[i],
+            .previous_outcome = ONGOING,
+        };
+        pthread_cond_init(&ctxs[i].validated, NULL);
+    }
+    if (!claim_cases(&run, &ctxs[0].first_start, &ctxs[0].first_count)) {
+        ctxs[0].first_count = 0;
+    }
+    ctxs[0].first_claimed = 1;
+    ctxs[0].previous_outcome = *previous_outcome;
+    ctxs[0].previous_result = *previous_result;
+    ctxs[0].previous_failures = *previous_failures;
+    ctxs[0].previous_stats = *previous_stats;
+
+    for (unsigned i = 0; i < n_channels; i++) {
+        if (pthread_create(&threads[i], NULL, drive_channel, &ctxs[i]) != 0) {
+            fprintf(stderr, "run_test: Failed to start channel thread\n");
+            exit(1);
+        }
+    }
+    for (unsigned i = 0; i < n_channels; i++) {
+        pthread_join(threads[i], NULL);
+        pthread_cond_destroy(&ctxs[i].validated);
+    }
+
+    golden_close(&golden);
+    if (profiling) {
+        profile_add(&profiles[func], &run.profile);
+    }
+    if (run.error) {
+        return -1;
+    }
+    *previous_outcome = run.outcome;
+    *previous_result = run.result;
+    previous_result->function_id = func;
+    for (unsigned c = 0; c < MAX_FAILURE_CLASSES; c++) {
+        if (run.classes[c].n_failures > 0) {
+            failure_class_t *class = &run.failures.classes[run.failures.n_classes++];
+            class->failure_class = c;
+            class->n_failures = run.classes[c].n_failures;
+            class->smallest = run.classes[c].smallest;
+        }
+    }
+    *previous_failures = run.failures;
+    *previous_stats = run.stats;
+    previous_stats->wall_ns = monotonic_ns() - start_ns;
     return 0;
 }
 
-void run_tests(shmem_buf_t *sh_buf) {
+void run_tests(channel_t *channels, unsigned n_channels) {
     enum test_outcome previous_outcome = ONGOING;
     function_result_t previous_result;
+    static failure_report_t previous_failures;
+    function_stats_t previous_stats = {};
 
     if (test_fname != NULL) {
-        run_test(sh_buf, getFuncId(test_fname), &previous_outcome, &previous_result);
+        run_test(channels, n_channels, getFuncId(test_fname), &previous_outcome, &previous_result,
+                &previous_failures, &previous_stats);
     } else {
         for (int i = 0; i < NUM_PUZZLES; i++) {
-            run_test(sh_buf, all_funcs[i], &previous_outcome, &previous_result);
+            run_test(channels, n_channels, all_funcs[i], &previous_outcome, &previous_result,
+                    &previous_failures, &previous_stats);
         }
     }
 
-    sh_buf->type = END;
-    test_batch_t *test_batch = (test_batch_t  *)sh_buf->payload;
-    test_batch->previous_outcome = previous_outcome;
-    test_batch->previous_result = previous_result;
-    if (sema_post(&sh_buf->ready_for_client) == -1) {
-        perror("sema_post");
-        // No need for further cleanup at this point - that's handled in main()
+    /* Only the reporting channel receives the final result. Every ring has been
+       drained by now, so each channel's next slot is free. */
+    for (unsigned i = 0; i < n_channels; i++) {
+        channel_t *chan = &channels[i];
+        ring_slot_t *slot = &chan->ring->slots[chan->next_seq % RING_SLOTS];
+        test_batch_t *test_batch = (test_batch_t  *)slot->payload;
+        if (i == 0) {
+            test_batch->previous_outcome = previous_outcome;
+            test_batch->previous_result = previous_result;
+            test_batch->previous_failures = previous_failures;
+            test_batch->previous_stats = previous_stats;
+        } else {
+            test_batch->previous_outcome = ONGOING;
+        }
+        if (send_message(chan, END) == -1) {
+            // No need for further cleanup at this point - that's handled in main()
+            return;
+        }
     }
 }
 
+// find_function - Id of the function called name, or -1 if there's none
+static int find_function(const char *name) {
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        if (strcmp(getFuncName(id), name) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
 int main(int argc, char *argv[]) {
-    assert(argc >= 2);
+    assert(argc >= 3);
     int shmid = atoi(argv[1]);
-    shmem_buf_t *sh_buf = shmat(shmid, NULL, 0);
-    if (sh_buf == (void *)-1) {
+    unsigned n_channels = atoi(argv[2]);
+    if (n_channels < 1 || n_channels > MAX_WORKERS) {
+        fprintf(stderr, "Invalid number of channels\n");
+        return 1;
+    }
+    shmem_buf_t *rings = shmat(shmid, NULL, 0);
+    if (rings == (void *)-1) {
         perror("shmat");
         return 1;
     }
+    channel_t channels[n_channels];
+    for (unsigned i = 0; i < n_channels; i++) {
+        channels[i].ring = &rings[i];
+        channels[i].next_seq = 0;
+    }
 
-    char c;
-    while ((c = getopt(argc, argv, "hgf:T:1:2:3:")) != -1)
+    /* --profile has no short form, 'P' is just how getopt_long reports it */
+    static const struct option long_options[] = {
+        {"profile", optional_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "haBEgSxC:f:G:K:O:T:V:k:s:w:1:2:3:", long_options,
+            NULL)) != -1)
         switch (c) {
         case 'h': /* help */
             // Handled by client, ignore it here
         break;
     case 'g': /* grading option for autograder */
-        // Handled by client, ignore it here
+        grade_mode = 1;
+        break;
+    case 'S': /* print handoff statistics */
+        print_sema_stats = 1;
+        break;
+    case 'P': /* time each phase of testing, dumping the times to a file */
+        profiling = 1;
+        if (optarg != NULL) {
+            profile_path = strdup(optarg);
+        }
+        break;
+    case 'x': /* exhaustive testing of single-argument functions */
+        exhaustive = 1;
+        break;
+    case 'G': /* golden file directory */
+        golden_dir = strcmp(optarg, "-") == 0 ? NULL : strdup(optarg);
+        break;
+    case 'a': /* keep testing after failures */
+        collect_all = 1;
+        break;
+    case 'k': /* number of counterexamples to report with -a */
+        max_examples = atoi(optarg);
+        break;
+    case 's': /* seed for random test values */
+        seed = strtoull(optarg, NULL, 0);
+        break;
+    case 'B': /* benchmark mode */
+        // Handled by client
+        break;
+    case 'E': /* run bits.s in the emulator */
+        // Handled by client
+        break;
+    case 'O': /* output format */
+        // Handled by client
+        break;
+    case 'C': /* result cache directory */
+        // Handled by client, which passes cached functions with -K
         break;
+    case 'K': { /* function with a cached result, skip it */
+        int id = find_function(optarg);
+        if (id < 0) {
+            fprintf(stderr, "btest_server: Unknown function '%s'\n", optarg);
+            exit(1);
+        }
+        cached[id] = 1;
+        break;
+    }
     case 'f': /* test only one function */
+        if (find_function(optarg) < 0) {
+            fprintf(stderr, "btest_server: Unknown function '%s'\n", optarg);
+            exit(1);
+        }
         test_fname = strdup(optarg);
         break;
     case '1': /* Get first argument */
@@ -445,14 +1154,43 @@ int main(int argc, char *argv[]) {
     case 'T': /* Set timeout limit */
         // Handled by client, ignore it here
         break;
+    case 'V': /* Number of validation threads */
+        n_validate_threads = atoi(optarg);
+        break;
+    case 'w': /* Number of workers */
+        // Handled by client, which passes the final count as argv[2]
+        break;
     default:
         // Shouldn't happen as any errors caught by cilent
         exit(1);
     }
 
+    /* Validation only pays off in its own threads when there are cores to spare */
+    if (n_validate_threads < 0) {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_validate_threads = n_cores > 1 ? n_cores : 0;
+    }
+    start_pool(n_validate_threads, n_channels);
+
     /* test each function */
-    run_tests(sh_buf);
-    if (shmdt(sh_buf) == -1) {
+    run_tests(channels, n_channels);
+    stop_pool();
+    if (print_sema_stats) {
+        collect_sema_stats();
+        sema_print_stats(stderr, "server", &server_sema_stats);
+    }
+    if (profiling) {
+        const char *names[NUM_PUZZLES];
+        for (int id = 0; id < NUM_PUZZLES; id++) {
+            names[id] = getFuncName(id);
+        }
+        profile_print(stderr, names, profiles, NUM_PUZZLES);
+        if (profile_dump(profile_path, names, profiles, NUM_PUZZLES) == 0 &&
+                strcmp(profile_path, "-") != 0) {
+            fprintf(stderr, "Profile written to %s\n", profile_path);
+        }
+    }
+    if (shmdt(rings) == -1) {
         perror("shmdt");
         return 1;
     }
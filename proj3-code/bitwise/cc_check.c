@@ -0,0 +1,465 @@
+/*
+ * cc_check - Check that the functions in bits.s follow the calling
+ * convention: every callee-saved register is pushed before it's used and
+ * popped back before returning, and the stack is balanced on every path.
+ * Prints nothing if all is well, so check_bitwise can tell from the output
+ * alone whether to go on and run btest.
+ *
+ * The functions checked are the ones declared in bits_impl.h. Each one runs
+ * from its label to the next function's, and is walked as a control-flow
+ * graph: every instruction is reached with the same picture of the stack
+ * whichever path leads there, or the paths disagree about what's been pushed.
+ *
+ * Instructions btest can't emulate are still accepted, since they assemble
+ * and run natively: for those only the registers they name, and the few
+ * they use implicitly, are checked.
+ */
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "x86_parse.h"
+
+/* Functions read from the header, and values pushed at once */
+#define MAX_FUNCTIONS 64
+#define MAX_STACK 64
+
+/* Distinct problems reported per function */
+#define MAX_ERRORS 16
+
+/* The registers a function must leave as it found them */
+static const int callee_saved[X86_NUM_REGS] = {
+    [REG_RBX] = 1, [REG_RBP] = 1, [REG_R12] = 1, [REG_R13] = 1, [REG_R14] = 1, [REG_R15] = 1,
+};
+
+/* Instructions outside the subset that use registers without naming them */
+static const struct {
+    const char *mnemonic;
+    enum x86_reg uses;          /* callee-saved register read or written */
+    int moves_rsp;              /* changes %rsp in a way that isn't followed */
+} implicit_ops[] = {
+    { "cpuid", REG_RBX, 0 }, { "xlat", REG_RBX, 0 }, { "xlatb", REG_RBX, 0 },
+    { "cmpxchg8b", REG_RBX, 0 }, { "cmpxchg16b", REG_RBX, 0 },
+    { "enter", REG_NONE, 1 }, { "enterq", REG_NONE, 1 },
+    { "pushf", REG_NONE, 1 }, { "pushfq", REG_NONE, 1 },
+    { "popf", REG_NONE, 1 }, { "popfq", REG_NONE, 1 },
+};
+
+/* What's on the stack on the way into an instruction. Each slot holds the
+   original value of a callee-saved register, or REG_NONE for anything else. */
+typedef struct {
+    int reached;
+    unsigned depth;
+    unsigned frame;             /* depth plus one when %rbp was set from %rsp, or 0 */
+    enum x86_reg slots[MAX_STACK];
+} stack_state_t;
+
+typedef struct {
+    const x86_program_t *prog;
+    const char *name;
+    int begin, end;             /* instructions of the function */
+    stack_state_t *states;      /* indexed from begin */
+    int *worklist;
+    unsigned n_work;
+    unsigned n_errors;
+    int error_lines[MAX_ERRORS];
+} function_check_t;
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-hc] [-i <header>] <file>\n", cmd);
+    printf("  -c        Print each function's instruction counts\n");
+    printf("  -h        Print this message\n");
+    printf("  -i <file> Check the functions declared in file (default bits_impl.h)\n");
+    printf("  <file>    Assembly to check\n");
+    exit(1);
+}
+
+// read_function_names - Collect the name of every function declared in a
+// header, one declaration per line. Returns the number found, or -1 on error.
+static int read_function_names(const char *path, char names[][X86_MAX_LABEL_LEN]) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror(path);
+        return -1;
+    }
+    int n = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL && n < MAX_FUNCTIONS) {
+        char *paren = strchr(line, '(');
+        if (strncmp(line, "//", 2) == 0 || paren == NULL) {
+            continue;
+        }
+        char *start = paren;
+        while (start > line && (start[-1] == '_' || (start[-1] >= 'a' && start[-1] <= 'z') ||
+                (start[-1] >= 'A' && start[-1] <= 'Z') || (start[-1] >= '0' && start[-1] <= '9'))) {
+            start--;
+        }
+        int len = paren - start;
+        if (len == 0 || len >= X86_MAX_LABEL_LEN) {
+            continue;
+        }
+        memcpy(names[n], start, len);
+        names[n][len] = '\0';
+        n++;
+    }
+    fclose(in);
+    return n;
+}
+
+// report - Print a problem with the function, once per line of the source
+static void report(function_check_t *fc, int line, const char *format, ...) {
+    for (unsigned i = 0; i < fc->n_errors; i++) {
+        if (fc->error_lines[i] == line) {
+            return;
+        }
+    }
+    if (fc->n_errors == MAX_ERRORS) {
+        return;
+    }
+    fc->error_lines[fc->n_errors++] = line;
+    va_list ap;
+    va_start(ap, format);
+    printf("ERROR: %s: ", fc->name);
+    vprintf(format, ap);
+    printf(" on line %d\n", line);
+    va_end(ap);
+}
+
+// is_saved - Whether the original value of reg is somewhere on the stack
+static int is_saved(const stack_state_t *st, enum x86_reg reg) {
+    for (unsigned i = 0; i < st->depth; i++) {
+        if (st->slots[i] == reg) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// check_use - Report a callee-saved register used before it was saved
+static void check_use(function_check_t *fc, const stack_state_t *st, const x86_insn_t *insn,
+        enum x86_reg reg, int width) {
+    if (reg != REG_NONE && callee_saved[reg] && !is_saved(st, reg)) {
+        report(fc, insn->line, "Register %%%s used without being pushed",
+                x86_reg_name(reg, width > 0 ? width : 8, 0));
+    }
+}
+
+// writes_operand - Whether an instruction writes its i'th operand
+static int writes_operand(const x86_insn_t *insn, unsigned i) {
+    switch (insn->op) {
+        case OP_CMP:
+        case OP_TEST:
+        case OP_BT:
+        case OP_PUSH:
+        case OP_JCC:
+        case OP_JMP:
+            return 0;
+        case OP_XCHG:
+            return 1;
+        case OP_OTHER:
+            /* Exchanges write both their operands */
+            if (strncmp(insn->mnemonic, "xadd", 4) == 0 || strncmp(insn->mnemonic, "cmpxchg", 7) == 0) {
+                return 1;
+            }
+            return i == insn->n_operands - 1;
+        default:
+            return i == insn->n_operands - 1;
+    }
+}
+
+// follow - Pass the state after an instruction on to its successor at index
+// next, checking that every path gets there with the same stack
+static void follow(function_check_t *fc, const x86_insn_t *insn, int next,
+        const stack_state_t *st) {
+    if (next < fc->begin || next >= fc->end) {
+        report(fc, insn->line, next == fc->end ? "Runs past the end of the function" :
+                "Jumps out of the function");
+        return;
+    }
+    stack_state_t *dest = &fc->states[next - fc->begin];
+    if (!dest->reached) {
+        *dest = *st;
+        dest->reached = 1;
+        fc->worklist[fc->n_work++] = next;
+    } else if (dest->depth != st->depth ||
+            memcmp(dest->slots, st->slots, st->depth * sizeof(st->slots[0])) != 0) {
+        report(fc, fc->prog->insns[next].line,
+                "Paths arrive with different values pushed on the stack");
+    } else if (dest->frame != st->frame) {
+        report(fc, fc->prog->insns[next].line,
+                "Paths arrive with %%rbp pointing at different places on the stack");
+    }
+}
+
+// pop - Take the top value off the stack into reg. Returns 0, or -1 if it
+// was the return address.
+static int pop(function_check_t *fc, stack_state_t *st, const x86_insn_t *insn,
+        enum x86_reg reg) {
+    if (st->depth == 0) {
+        report(fc, insn->line, "Pops the return address");
+        return -1;
+    }
+    if (st->slots[st->depth - 1] != REG_NONE && st->slots[st->depth - 1] != reg) {
+        report(fc, insn->line, "Saved %%%s popped into the wrong register",
+                x86_reg_name(st->slots[st->depth - 1], 8, 0));
+    }
+    st->depth--;
+    return 0;
+}
+
+// step_other - Check the registers an instruction outside the subset uses
+// without naming them. leave is followed: it puts %rsp back where mov
+// %rsp,%rbp found it and pops %rbp. Returns 0, or -1 if the stack is lost.
+static int step_other(function_check_t *fc, stack_state_t *st, const x86_insn_t *insn) {
+    if (strcmp(insn->mnemonic, "leave") == 0 || strcmp(insn->mnemonic, "leaveq") == 0) {
+        if (st->frame == 0) {
+            report(fc, insn->line, "Leaves without %%rbp set from %%rsp");
+            return -1;
+        }
+        st->depth = st->frame - 1;
+        st->frame = 0;
+        return pop(fc, st, insn, REG_RBP);
+    }
+    for (unsigned i = 0; i < sizeof(implicit_ops) / sizeof(implicit_ops[0]); i++) {
+        if (strcmp(insn->mnemonic, implicit_ops[i].mnemonic) != 0) {
+            continue;
+        }
+        check_use(fc, st, insn, implicit_ops[i].uses, 8);
+        if (implicit_ops[i].moves_rsp) {
+            report(fc, insn->line, "Changes %%rsp in a way that can't be followed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// step - Check one instruction and work out what's on the stack after it
+static void step(function_check_t *fc, int index) {
+    const x86_insn_t *insn = &fc->prog->insns[index];
+    stack_state_t st = fc->states[index - fc->begin];
+
+    /* Pushing a callee-saved register for the first time is how it's saved */
+    int saving = insn->op == OP_PUSH && insn->operands[0].kind == OPND_REG &&
+        callee_saved[insn->operands[0].reg] && !is_saved(&st, insn->operands[0].reg);
+    /* And popping its original value back is how it's restored */
+    int restoring = insn->op == OP_POP && st.depth > 0 && insn->operands[0].kind == OPND_REG &&
+        st.slots[st.depth - 1] == insn->operands[0].reg;
+    for (unsigned i = 0; i < insn->n_operands; i++) {
+        const x86_operand_t *opnd = &insn->operands[i];
+        if (opnd->kind == OPND_REG && !saving && !restoring) {
+            check_use(fc, &st, insn, opnd->reg, opnd->width);
+        } else if (opnd->kind == OPND_MEM) {
+            check_use(fc, &st, insn, opnd->base, 8);
+            check_use(fc, &st, insn, opnd->index, 8);
+        }
+        if (opnd->kind == OPND_REG && opnd->reg == REG_RSP && writes_operand(insn, i)) {
+            /* Only whole slots added or removed with an immediate can be followed */
+            const x86_operand_t *src = &insn->operands[0];
+            if ((insn->op != OP_ADD && insn->op != OP_SUB) || src->kind != OPND_IMM ||
+                    src->imm % 8 != 0) {
+                report(fc, insn->line, "Changes %%rsp in a way that can't be followed");
+                return;
+            }
+            long slots = (insn->op == OP_SUB ? src->imm : -src->imm) / 8;
+            if ((long) st.depth + slots < 0 || st.depth + slots > MAX_STACK) {
+                report(fc, insn->line, "Moves %%rsp %s", slots < 0 ?
+                        "above the return address" : "too far");
+                return;
+            }
+            for (long s = 0; s < slots; s++) {
+                st.slots[st.depth + s] = REG_NONE;
+            }
+            st.depth += slots;
+        }
+        /* Remember where the stack was when %rbp was pointed at it, for leave */
+        if (opnd->kind == OPND_REG && opnd->reg == REG_RBP && writes_operand(insn, i)) {
+            const x86_operand_t *src = &insn->operands[0];
+            int from_rsp = insn->op == OP_MOV && insn->width == 8 && src->kind == OPND_REG &&
+                src->reg == REG_RSP;
+            st.frame = from_rsp ? st.depth + 1 : 0;
+        }
+    }
+
+    switch (insn->op) {
+        case OP_PUSH:
+            if (st.depth == MAX_STACK) {
+                report(fc, insn->line, "Pushes too many values");
+                return;
+            }
+            st.slots[st.depth++] = saving ? insn->operands[0].reg : REG_NONE;
+            break;
+        case OP_POP:
+            if (pop(fc, &st, insn, insn->operands[0].kind == OPND_REG ?
+                    insn->operands[0].reg : REG_NONE) != 0) {
+                return;
+            }
+            break;
+        case OP_OTHER:
+            if (step_other(fc, &st, insn) != 0) {
+                return;
+            }
+            break;
+        case OP_RET:
+            if (st.depth > 0) {
+                report(fc, insn->line, "Returns with values still pushed on the stack");
+            }
+            return;
+        case OP_JMP:
+        case OP_JCC:
+            follow(fc, insn, insn->operands[0].target, &st);
+            if (insn->op == OP_JMP) {
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    follow(fc, insn, index + 1, &st);
+}
+
+// longest_path - Most instructions executed on any path from index to a ret,
+// or -1 if a loop can be reached. depth is 0 for unvisited instructions, -1
+// for those on the current path, and the result plus one for finished ones.
+static int longest_path(const function_check_t *fc, int index, int *depth) {
+    if (index < fc->begin || index >= fc->end) {
+        return 0;
+    }
+    int *d = &depth[index - fc->begin];
+    if (*d != 0) {
+        return *d > 0 ? *d - 1 : -1;
+    }
+    *d = -1;
+    const x86_insn_t *insn = &fc->prog->insns[index];
+    int longest = 0;
+    if (insn->op != OP_RET) {
+        if (insn->op == OP_JMP || insn->op == OP_JCC) {
+            longest = longest_path(fc, insn->operands[0].target, depth);
+        }
+        if (longest >= 0 && insn->op != OP_JMP) {
+            int fall = longest_path(fc, index + 1, depth);
+            longest = fall < 0 ? -1 : (fall > longest ? fall : longest);
+        }
+    }
+    if (longest < 0) {
+        return -1;
+    }
+    *d = longest + 2;
+    return longest + 1;
+}
+
+// check_function - Walk every path through one function. Returns the number
+// of problems found.
+static unsigned check_function(const x86_program_t *prog, const char *name, int begin, int end,
+        int print_counts) {
+    unsigned n = end - begin;
+    function_check_t fc = {
+        .prog = prog,
+        .name = name,
+        .begin = begin,
+        .end = end,
+        .states = calloc(n + 1, sizeof(stack_state_t)),
+        .worklist = malloc((n + 1) * sizeof(int)),
+    };
+    int *depth = calloc(n + 1, sizeof(int));
+    if (fc.states == NULL || fc.worklist == NULL || depth == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    if (begin < end) {
+        fc.states[0].reached = 1;
+        fc.worklist[fc.n_work++] = begin;
+        while (fc.n_work > 0) {
+            step(&fc, fc.worklist[--fc.n_work]);
+        }
+    } else {
+        printf("ERROR: %s: Function has no instructions\n", name);
+        fc.n_errors++;
+    }
+
+    if (print_counts) {
+        unsigned reached = 0;
+        for (unsigned i = 0; i < n; i++) {
+            reached += fc.states[i].reached;
+        }
+        int longest = longest_path(&fc, begin, depth);
+        if (longest < 0) {
+            printf("%-16s %8u %8u %8s\n", name, n, reached, "loops");
+        } else {
+            printf("%-16s %8u %8u %8d\n", name, n, reached, longest);
+        }
+    }
+    free(fc.states);
+    free(fc.worklist);
+    free(depth);
+    return fc.n_errors;
+}
+
+int main(int argc, char *argv[]) {
+    int c;
+    int print_counts = 0;
+    const char *header = "bits_impl.h";
+    while ((c = getopt(argc, argv, "hci:")) != -1) {
+        switch (c) {
+            case 'c':
+                print_counts = 1;
+                break;
+            case 'i':
+                header = optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+    const char *path = argv[optind];
+    if (access(path, F_OK) != 0) {
+        printf("ERROR: %s does not exist\n", path);
+        return 2;
+    }
+
+    char names[MAX_FUNCTIONS][X86_MAX_LABEL_LEN];
+    int n_funcs = read_function_names(header, names);
+    if (n_funcs < 0) {
+        return 1;
+    }
+
+    /* The parser explains on stderr, but check_bitwise only looks at stdout */
+    x86_program_t prog;
+    if (x86_parse_file_lenient(path, &prog) != 0) {
+        printf("ERROR: %s can't be checked, see above\n", path);
+        return 3;
+    }
+
+    /* A function ends where the next one in the file begins */
+    int starts[MAX_FUNCTIONS];
+    for (int i = 0; i < n_funcs; i++) {
+        starts[i] = x86_find_label(&prog, names[i]);
+    }
+
+    if (print_counts) {
+        printf("%-16s %8s %8s %8s\n", "Function", "Instrs", "Reached", "Longest");
+    }
+    unsigned n_errors = 0;
+    for (int i = 0; i < n_funcs; i++) {
+        if (starts[i] < 0) {
+            /* Missing functions are btest's to report */
+            continue;
+        }
+        int end = prog.n_insns;
+        for (int j = 0; j < n_funcs; j++) {
+            if (starts[j] > starts[i] && starts[j] < end) {
+                end = starts[j];
+            }
+        }
+        n_errors += check_function(&prog, names[i], starts[i], end, print_counts);
+    }
+    x86_free(&prog);
+    return n_errors > 0 ? 4 : 0;
+}
@@ -0,0 +1,26 @@
+# Functions cc_check must reject, with the errors in bad.expected
+    .text
+    .globl rotateRight
+rotateRight:
+    movl %esi, %ecx
+    movl %edi, %ebx             # %rbx not pushed
+    rorl %cl, %ebx
+    movl %ebx, %eax
+    ret
+
+    .globl sign
+sign:
+    imull %edi, %r12d           # %r12 not pushed
+    movl %edi, %eax
+    ret
+
+    .globl isGreater
+isGreater:
+    xchgq %rsp, %rax            # %rsp can't be followed
+    ret
+
+    .globl logicalShift
+logicalShift:
+    subq $8, %rsp
+    leave                       # %rbp was never set from %rsp
+    ret
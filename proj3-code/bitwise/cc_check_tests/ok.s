@@ -0,0 +1,44 @@
+# Functions cc_check must accept though btest can't emulate every instruction
+# in them. Run by make test-cc_check, which expects no output.
+    .text
+    .globl rotateRight
+rotateRight:
+    endbr64
+    movl %esi, %ecx
+    movl %edi, %eax
+    rorl %cl, %eax
+    ret
+
+    .globl sign
+sign:
+    pushq %rbx
+    imull $1, %edi, %ebx        # callee-saved, but pushed first
+    movl %ebx, %eax
+    sarl $31, %eax
+    testl %ebx, %ebx
+    setne %bl
+    movzbl %bl, %ebx
+    orl %ebx, %eax
+    popq %rbx
+    ret
+
+    .globl isGreater
+isGreater:
+    pushq %rbp
+    movq %rsp, %rbp
+    subq $16, %rsp
+    movl %edi, -4(%rbp)
+    xorl %eax, %eax
+    cmpl %esi, -4(%rbp)
+    setg %al
+    leave
+    ret
+
+    .globl logicalShift
+logicalShift:
+    movslq %edi, %rax
+    cltq
+    xchgl %esi, %ecx
+    shrl %cl, %eax
+    bsrl %eax, %edx
+    rep ret
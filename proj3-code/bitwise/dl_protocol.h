@@ -3,10 +3,30 @@
 
 #include <stdint.h>
 
-// One GiB should be small enough for most systems, right?
-#define MSG_BUF_SIZE 1073741824
+#include "sema.h"
+
 #define NUM_PUZZLES 12
 
+// Largest number of test cases the server places in a single batch.
+// Keeping batches small lets the server spread them evenly over workers.
+#define MAX_BATCH_CASES (1 << 16)
+
+// Number of slots in each channel's ring, i.e. how many batches can be in
+// flight to one worker while the server generates and validates others
+#define RING_SLOTS 4
+
+// Each test case holds at most two arguments plus the result
+#define MAX_CASE_INTS 3
+
+// Upper limit on number of client workers (-w)
+#define MAX_WORKERS 256
+
+// Most counterexamples reported per function in collect-all mode (-a)
+#define MAX_COUNTEREXAMPLES 32
+
+// Number of classes failing inputs are grouped into, see getFailureClass()
+#define MAX_FAILURE_CLASSES 33
+
 enum message_type {
     TEST_INPUT_BATCH,   // 1) Server -> Client. Batch of inputs to test on student implementation.
                         // Optionally with failure info from a previous pbatch.
@@ -39,16 +59,10 @@ enum test_outcome {
     SEGFAULT,           // Previous tests encountered a segfault
     FLOAT_ERROR,        // Previous test caused a floating point exception
     FAILURE,            // Tests finished but incorrect result was found.
+    CACHED,             // Previous function skipped, client already has its result
     ONGOING             // Tests still pending for current function. Nothing to report.
 };
 
-typedef struct {
-    uint32_t ready_for_client;   // Is input ready for client to consume?
-    uint32_t ready_for_server;   // Is input ready for server to consume?
-    enum message_type type;      // Message type ID
-    char payload[MSG_BUF_SIZE];  // Payload. Structure depends on message type.
-} shmem_buf_t;
-
 typedef struct {
     enum function_id function_id;   // ID of function with results
     int arg1;                       //  First argument for failure case (if applicable)
@@ -57,12 +71,75 @@ typedef struct {
     int actual_output;              // Result produced by student function (if applicable)
 } function_result_t;
 
+typedef struct {
+    enum test_outcome outcome;      // How this test case failed
+    function_result_t result;       // Its arguments and outputs
+} counterexample_t;
+
+// Failures in one class, with the smallest failing input found after shrinking
+typedef struct {
+    uint64_t n_failures __attribute__((aligned(8))); // Failing test cases in the class
+    unsigned failure_class;         // See getFailureClass()
+    counterexample_t smallest;
+} failure_class_t;
+
+// Every failure found for a function in collect-all mode (-a)
+typedef struct {
+    uint64_t n_failures __attribute__((aligned(8))); // Total failing test cases
+    int stopped;                    // Testing stopped at a timeout, so more may fail
+    unsigned n_examples;            // First distinct failures, in test case order
+    counterexample_t examples[MAX_COUNTEREXAMPLES];
+    unsigned n_classes;             // Classes with failures, in class order
+    failure_class_t classes[MAX_FAILURE_CLASSES];
+} failure_report_t;
+
+// Cost of testing one function, reported along with its result
+typedef struct {
+    uint64_t n_tests __attribute__((aligned(8)));   // Test cases run, not counting shrinking
+    uint64_t wall_ns __attribute__((aligned(8)));   // Elapsed time from first batch to last result
+    uint64_t cpu_ns __attribute__((aligned(8)));    // CPU time of the workers running batches
+} function_stats_t;
+
 typedef struct {
     enum test_outcome previous_outcome; // Outcome to report for previous function?
     function_result_t previous_result;  // Information on results for previous function (if applicable)
+    failure_report_t previous_failures; // All failures for previous function (-a only)
+    function_stats_t previous_stats;    // Cost of testing previous function
     enum function_id function_id;       // Current function to be tested
     unsigned n_test_cases;              // Total number of test cases included in this batch
+    // In collect-all mode (-a), the client keeps going after a crash and marks
+    // the case in crashes[] with SEGFAULT or FLOAT_ERROR. A timeout ends the batch.
+    unsigned n_run;                     // Cases run before any timeout (-a only)
+    unsigned n_crashes;                 // Number of cases marked in crashes[] (-a only)
+    uint8_t crashes[MAX_BATCH_CASES];   // Only valid if n_crashes > 0
+    uint64_t cpu_ns __attribute__((aligned(8))); // Client CPU time spent on the batch, in any reply
+    uint64_t wall_ns __attribute__((aligned(8))); // Client wall time spent on the batch (--profile only)
     int elems[];                        // Input test values (and space for outputs)
 } test_batch_t;
 
+// Where the result of a case sits among its elems: just after its arguments.
+// Functions without arguments still leave one unused slot before the result,
+// so their cases overlap.
+static inline unsigned batch_result_offset(unsigned num_args) {
+    return num_args > 0 ? num_args : 1;
+}
+
+// Payload needs room for the largest possible batch
+#define MSG_BUF_SIZE (sizeof(test_batch_t) + MAX_BATCH_CASES * MAX_CASE_INTS * sizeof(int))
+
+// One message slot. Messages on a channel are numbered in the order the server
+// sends them, and message n always travels in slot n % RING_SLOTS.
+typedef struct {
+    sema_t ready_for_client;     // Is input ready for client to consume?
+    sema_t ready_for_server;     // Is input ready for server to consume?
+    uint32_t seq;                // Sequence number of the message in this slot
+    enum message_type type;      // Message type ID
+    char payload[MSG_BUF_SIZE];  // Payload. Structure depends on message type.
+} ring_slot_t;
+
+// One channel per client worker. Channel 0 belongs to the client that reports results.
+typedef struct {
+    ring_slot_t slots[RING_SLOTS];
+} shmem_buf_t;
+
 #endif // DL_PROTOCOL_H
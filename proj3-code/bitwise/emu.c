@@ -0,0 +1,486 @@
+#include <string.h>
+
+#include "dl_protocol.h"
+#include "emu.h"
+
+// The stack sits just below this made-up address, which no real pointer the
+// function could compute by accident is likely to hit
+#define STACK_TOP 0x00007ffe00000000ULL
+#define STACK_BOTTOM (STACK_TOP - EMU_STACK_SIZE)
+
+// Return address pushed by the caller. Returning anywhere else means the
+// function clobbered its stack.
+#define RETURN_SENTINEL 0x00007ffdfffff000ULL
+
+typedef struct {
+    uint64_t regs[X86_NUM_REGS];
+    int cf, zf, sf, of;
+    uint8_t stack[EMU_STACK_SIZE];
+    unsigned low_water;         // Lowest stack offset written since it was last cleared
+} cpu_t;
+
+int emu_load(emu_program_t *emu, const char *source, const char *name) {
+    return x86_parse(source, name, &emu->prog);
+}
+
+void emu_free(emu_program_t *emu) {
+    x86_free(&emu->prog);
+}
+
+int emu_entry(const emu_program_t *emu, const char *func_name) {
+    return x86_find_label(&emu->prog, func_name);
+}
+
+static uint64_t width_mask(int width) {
+    return width == 8 ? UINT64_MAX : (1ULL << (8 * width)) - 1;
+}
+
+static int sign_bit(uint64_t v, int width) {
+    return (v >> (8 * width - 1)) & 1;
+}
+
+// sign_extend - The low width bytes of v as a signed value
+static int64_t sign_extend(uint64_t v, int width) {
+    int shift = 64 - 8 * width;
+    return (int64_t) (v << shift) >> shift;
+}
+
+// address - Where a memory operand points, or -1 if it's outside the stack
+static int64_t address(const cpu_t *cpu, const x86_operand_t *opnd, int width) {
+    uint64_t addr = opnd->imm;
+    if (opnd->base != REG_NONE) {
+        addr += cpu->regs[opnd->base];
+    }
+    if (opnd->index != REG_NONE) {
+        addr += cpu->regs[opnd->index] * opnd->scale;
+    }
+    if (addr < STACK_BOTTOM || addr > STACK_TOP - width) {
+        return -1;
+    }
+    return addr - STACK_BOTTOM;
+}
+
+// load - Value of an operand. Returns 0, or -1 on a bad memory access.
+static int load(const cpu_t *cpu, const x86_operand_t *opnd, int width, uint64_t *value) {
+    switch (opnd->kind) {
+        case OPND_REG:
+            *value = opnd->high8 ? (cpu->regs[opnd->reg] >> 8) & 0xff
+                : cpu->regs[opnd->reg] & width_mask(width);
+            return 0;
+        case OPND_IMM:
+            *value = (uint64_t) opnd->imm & width_mask(width);
+            return 0;
+        case OPND_MEM: {
+            int64_t offset = address(cpu, opnd, width);
+            if (offset < 0) {
+                return -1;
+            }
+            *value = 0;
+            memcpy(value, &cpu->stack[offset], width);
+            return 0;
+        }
+        default:
+            return -1;
+    }
+}
+
+// store - Write an operand the way the hardware does: 32-bit register writes
+// clear the upper half, 8 and 16-bit writes leave the rest alone. Returns 0,
+// or -1 on a bad memory access.
+static int store(cpu_t *cpu, const x86_operand_t *opnd, int width, uint64_t value) {
+    if (opnd->kind == OPND_MEM) {
+        int64_t offset = address(cpu, opnd, width);
+        if (offset < 0) {
+            return -1;
+        }
+        memcpy(&cpu->stack[offset], &value, width);
+        if (offset < cpu->low_water) {
+            cpu->low_water = offset;
+        }
+        return 0;
+    }
+    if (opnd->kind != OPND_REG) {
+        return -1;
+    }
+    uint64_t *reg = &cpu->regs[opnd->reg];
+    if (opnd->high8) {
+        *reg = (*reg & ~0xff00ULL) | (value & 0xff) << 8;
+    } else if (width >= 4) {
+        *reg = value & width_mask(width);
+    } else {
+        *reg = (*reg & ~width_mask(width)) | (value & width_mask(width));
+    }
+    return 0;
+}
+
+static void set_result_flags(cpu_t *cpu, uint64_t res, int width, int cf, int of) {
+    cpu->cf = cf;
+    cpu->of = of;
+    cpu->zf = (res & width_mask(width)) == 0;
+    cpu->sf = sign_bit(res, width);
+}
+
+static int condition(const cpu_t *cpu, enum x86_cond cc) {
+    switch (cc) {
+        case CC_O: return cpu->of;
+        case CC_NO: return !cpu->of;
+        case CC_B: return cpu->cf;
+        case CC_AE: return !cpu->cf;
+        case CC_E: return cpu->zf;
+        case CC_NE: return !cpu->zf;
+        case CC_BE: return cpu->cf || cpu->zf;
+        case CC_A: return !cpu->cf && !cpu->zf;
+        case CC_S: return cpu->sf;
+        case CC_NS: return !cpu->sf;
+        case CC_L: return cpu->sf != cpu->of;
+        case CC_GE: return cpu->sf == cpu->of;
+        case CC_LE: return cpu->zf || cpu->sf != cpu->of;
+        case CC_G: return !cpu->zf && cpu->sf == cpu->of;
+    }
+    return 0;
+}
+
+// shift - Shift by count, which has already been masked and isn't 0
+static uint64_t shift(cpu_t *cpu, enum x86_op op, uint64_t a, unsigned count, int width) {
+    unsigned bits = 8 * width;
+    uint64_t res;
+    int cf, of;
+    switch (op) {
+        case OP_SHL:
+            res = count < 64 ? a << count : 0;
+            cf = count <= bits ? (a >> (bits - count)) & 1 : 0;
+            of = sign_bit(res, width) ^ cf;
+            break;
+        case OP_SHR:
+            res = count < bits ? a >> count : 0;
+            cf = count <= bits ? (a >> (count - 1)) & 1 : 0;
+            of = sign_bit(a, width);
+            break;
+        default: {
+            int64_t sa = sign_extend(a, width);
+            res = sa >> (count < 64 ? count : 63);
+            cf = (sa >> (count <= bits ? count - 1 : 63)) & 1;
+            of = 0;
+            break;
+        }
+    }
+    res &= width_mask(width);
+    set_result_flags(cpu, res, width, cf, of);
+    return res;
+}
+
+// rotate - Rotate by count, which has already been masked and isn't 0. Only
+// CF and OF change.
+static uint64_t rotate(cpu_t *cpu, enum x86_op op, uint64_t a, unsigned count, int width) {
+    unsigned bits = 8 * width;
+    unsigned r = count % bits;
+    uint64_t res = a;
+    if (r != 0) {
+        res = op == OP_ROL ? a << r | a >> (bits - r) : a >> r | a << (bits - r);
+    }
+    res &= width_mask(width);
+    if (op == OP_ROL) {
+        cpu->cf = res & 1;
+        cpu->of = sign_bit(res, width) ^ cpu->cf;
+    } else {
+        cpu->cf = sign_bit(res, width);
+        cpu->of = sign_bit(res, width) ^ sign_bit(res << 1, width);
+    }
+    return res;
+}
+
+// push - Returns 0, or -1 if the stack overflows
+static int push(cpu_t *cpu, uint64_t value) {
+    if (cpu->regs[REG_RSP] - 8 < STACK_BOTTOM || cpu->regs[REG_RSP] > STACK_TOP) {
+        return -1;
+    }
+    cpu->regs[REG_RSP] -= 8;
+    unsigned offset = cpu->regs[REG_RSP] - STACK_BOTTOM;
+    memcpy(&cpu->stack[offset], &value, 8);
+    if (offset < cpu->low_water) {
+        cpu->low_water = offset;
+    }
+    return 0;
+}
+
+// pop - Returns 0, or -1 if there's nothing on the stack
+static int pop(cpu_t *cpu, uint64_t *value) {
+    if (cpu->regs[REG_RSP] < STACK_BOTTOM || cpu->regs[REG_RSP] > STACK_TOP - 8) {
+        return -1;
+    }
+    memcpy(value, &cpu->stack[cpu->regs[REG_RSP] - STACK_BOTTOM], 8);
+    cpu->regs[REG_RSP] += 8;
+    return 0;
+}
+
+// run - Execute from pc until the function returns, leaving the result in %rax
+static emu_status_t run(const x86_program_t *prog, cpu_t *cpu, int pc, uint64_t fuel) {
+    // Implicit operands of cltq and cltd
+    static const x86_operand_t rax = { .kind = OPND_REG, .reg = REG_RAX };
+    static const x86_operand_t rdx = { .kind = OPND_REG, .reg = REG_RDX };
+
+    for (;; pc++) {
+        if (fuel-- == 0) {
+            return EMU_OUT_OF_FUEL;
+        }
+        if (pc < 0 || (unsigned) pc >= prog->n_insns) {
+            return EMU_FAULT;
+        }
+        const x86_insn_t *insn = &prog->insns[pc];
+        const x86_operand_t *src = &insn->operands[0];
+        const x86_operand_t *dst = &insn->operands[insn->n_operands - 1];
+        int width = insn->width;
+        uint64_t mask = width_mask(width);
+        uint64_t a, b, res;
+
+        switch (insn->op) {
+            case OP_RET:
+                if (pop(cpu, &a) != 0 || a != RETURN_SENTINEL) {
+                    return EMU_FAULT;
+                }
+                return EMU_RETURNED;
+
+            case OP_JMP:
+                pc = src->target - 1;
+                break;
+
+            case OP_JCC:
+                if (condition(cpu, insn->cond)) {
+                    pc = src->target - 1;
+                }
+                break;
+
+            case OP_MOV:
+                if (load(cpu, src, width, &a) != 0 || store(cpu, dst, width, a) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_MOVZ:
+            case OP_MOVS:
+                if (load(cpu, src, insn->src_width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                if (insn->op == OP_MOVS) {
+                    a = sign_extend(a, insn->src_width);
+                }
+                store(cpu, dst, width, a);
+                break;
+
+            case OP_LEA: {
+                uint64_t addr = src->imm;
+                if (src->base != REG_NONE) {
+                    addr += cpu->regs[src->base];
+                }
+                if (src->index != REG_NONE) {
+                    addr += cpu->regs[src->index] * src->scale;
+                }
+                store(cpu, dst, width, addr);
+                break;
+            }
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_CMP:
+            case OP_AND:
+            case OP_OR:
+            case OP_XOR:
+            case OP_TEST:
+                if (load(cpu, src, width, &b) != 0 || load(cpu, dst, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                switch (insn->op) {
+                    case OP_ADD:
+                        res = (a + b) & mask;
+                        set_result_flags(cpu, res, width, res < a,
+                            sign_bit(~(a ^ b) & (a ^ res), width));
+                        break;
+                    case OP_SUB:
+                    case OP_CMP:
+                        res = (a - b) & mask;
+                        set_result_flags(cpu, res, width, a < b,
+                            sign_bit((a ^ b) & (a ^ res), width));
+                        break;
+                    case OP_AND:
+                    case OP_TEST:
+                        res = a & b;
+                        set_result_flags(cpu, res, width, 0, 0);
+                        break;
+                    case OP_OR:
+                        res = a | b;
+                        set_result_flags(cpu, res, width, 0, 0);
+                        break;
+                    default:
+                        res = a ^ b;
+                        set_result_flags(cpu, res, width, 0, 0);
+                        break;
+                }
+                if (insn->op != OP_CMP && insn->op != OP_TEST && store(cpu, dst, width, res) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_NOT:
+            case OP_NEG:
+            case OP_INC:
+            case OP_DEC:
+                if (load(cpu, dst, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                switch (insn->op) {
+                    case OP_NOT:
+                        res = ~a & mask;
+                        break;
+                    case OP_NEG:
+                        res = -a & mask;
+                        set_result_flags(cpu, res, width, a != 0, a != 0 && res == a);
+                        break;
+                    case OP_INC:
+                        res = (a + 1) & mask;
+                        set_result_flags(cpu, res, width, cpu->cf, res == (mask >> 1) + 1);
+                        break;
+                    default:
+                        res = (a - 1) & mask;
+                        set_result_flags(cpu, res, width, cpu->cf, res == mask >> 1);
+                        break;
+                }
+                if (store(cpu, dst, width, res) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_IMUL: {
+                /* imul $imm, src, dst multiplies src; the other forms multiply dst */
+                const x86_operand_t *factor = insn->n_operands == 3 ? &insn->operands[1] : dst;
+                if (load(cpu, src, width, &b) != 0 || load(cpu, factor, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                __int128 product = (__int128) sign_extend(a, width) * sign_extend(b, width);
+                res = (uint64_t) product & mask;
+                int overflow = product != sign_extend(res, width);
+                set_result_flags(cpu, res, width, overflow, overflow);
+                if (store(cpu, dst, width, res) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+            }
+
+            case OP_SHL:
+            case OP_SHR:
+            case OP_SAR:
+            case OP_ROL:
+            case OP_ROR: {
+                unsigned count = (src->kind == OPND_IMM ? (uint64_t) src->imm : cpu->regs[REG_RCX]) &
+                    (width == 8 ? 63 : 31);
+                if (load(cpu, dst, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                if (count == 0) {
+                    res = a;
+                } else if (insn->op == OP_ROL || insn->op == OP_ROR) {
+                    res = rotate(cpu, insn->op, a, count, width);
+                } else {
+                    res = shift(cpu, insn->op, a, count, width);
+                }
+                if (store(cpu, dst, width, res) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+            }
+
+            case OP_BT:
+                /* Only CF changes. The parser only allows a register index
+                   with a register, so the index wraps within it. */
+                if (load(cpu, src, width, &b) != 0 || load(cpu, dst, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                cpu->cf = (a >> (b % (8 * width))) & 1;
+                break;
+
+            case OP_SETCC:
+                if (store(cpu, dst, 1, condition(cpu, insn->cond)) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_CMOVCC:
+                if (load(cpu, src, width, &b) != 0 || load(cpu, dst, width, &a) != 0) {
+                    return EMU_FAULT;
+                }
+                store(cpu, dst, width, condition(cpu, insn->cond) ? b : a);
+                break;
+
+            case OP_PUSH:
+                if (load(cpu, src, 8, &a) != 0 || push(cpu, a) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_POP:
+                if (pop(cpu, &a) != 0 || store(cpu, dst, 8, a) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_NOP:
+                break;
+
+            case OP_XCHG:
+                if (load(cpu, src, width, &a) != 0 || load(cpu, dst, width, &b) != 0 ||
+                        store(cpu, src, width, b) != 0 || store(cpu, dst, width, a) != 0) {
+                    return EMU_FAULT;
+                }
+                break;
+
+            case OP_CLTQ:
+                a = sign_extend(cpu->regs[REG_RAX], width / 2);
+                store(cpu, &rax, width, a);
+                break;
+
+            case OP_CLTD:
+                store(cpu, &rdx, width, sign_bit(cpu->regs[REG_RAX], width) ? mask : 0);
+                break;
+
+            case OP_OTHER:
+                /* Only the lenient parser gives these, and it isn't used here */
+                return EMU_FAULT;
+        }
+    }
+}
+
+emu_status_t emu_run_batch(const emu_program_t *emu, int entry, unsigned num_args, int *elems,
+        unsigned stride, unsigned n, uint64_t fuel, unsigned *stopped_at) {
+    static const enum x86_reg arg_regs[] = { REG_RDI, REG_RSI, REG_RDX };
+    cpu_t cpu;
+
+    memset(&cpu.stack, 0, sizeof(cpu.stack));
+    cpu.low_water = EMU_STACK_SIZE;
+    for (unsigned i = 0; i < n; i++) {
+        int *e = elems + i * stride;
+
+        // Every call starts with a zeroed stack, so a function reading stack
+        // it never wrote sees the same thing wherever batches happen to split.
+        // Only the part the previous call wrote needs clearing.
+        memset(&cpu.stack[cpu.low_water], 0, EMU_STACK_SIZE - cpu.low_water);
+        cpu.low_water = EMU_STACK_SIZE;
+
+        // Registers other than the arguments start out zero, so results
+        // don't depend on what ran before
+        memset(cpu.regs, 0, sizeof(cpu.regs));
+        cpu.cf = cpu.zf = cpu.sf = cpu.of = 0;
+        for (unsigned a = 0; a < num_args; a++) {
+            cpu.regs[arg_regs[a]] = (uint32_t) e[a];
+        }
+        cpu.regs[REG_RSP] = STACK_TOP;
+        push(&cpu, RETURN_SENTINEL);
+
+        emu_status_t status = entry < 0 ? EMU_FAULT : run(&emu->prog, &cpu, entry, fuel);
+        if (status != EMU_RETURNED) {
+            *stopped_at = i;
+            return status;
+        }
+        e[batch_result_offset(num_args)] = (int) cpu.regs[REG_RAX];
+    }
+    *stopped_at = n;
+    return EMU_RETURNED;
+}
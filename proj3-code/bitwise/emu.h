@@ -0,0 +1,48 @@
+#ifndef EMU_H
+#define EMU_H
+
+#include <stdint.h>
+
+#include "x86_parse.h"
+
+// Interpreter for the x86-64 subset in x86_parse.h, btest's alternative to
+// running bits.s natively (-E). Every call gets a fresh machine with a small
+// private stack, so a runaway loop only uses up its fuel and a bad memory
+// access or a clobbered return address only ends that call: no signals or
+// timers are involved.
+
+// Bytes of stack each call may use
+#define EMU_STACK_SIZE 4096
+
+// Instructions a call may execute before it counts as an infinite loop
+#define EMU_FUEL_DEFAULT (1 << 20)
+
+typedef enum {
+    EMU_RETURNED,       // Returned normally
+    EMU_OUT_OF_FUEL,    // Didn't return in time
+    EMU_FAULT,          // Touched memory outside its stack, or jumped somewhere invalid
+} emu_status_t;
+
+typedef struct {
+    x86_program_t prog;
+} emu_program_t;
+
+// Parse source for the emulator. Returns 0 on success, or -1 after printing
+// why on stderr.
+int emu_load(emu_program_t *emu, const char *source, const char *name);
+
+void emu_free(emu_program_t *emu);
+
+// Entry point of a function, or -1 if it isn't defined
+int emu_entry(const emu_program_t *emu, const char *func_name);
+
+/*
+ * Run cases of a batch laid out the way btest's runners expect: each case
+ * takes stride ints, its num_args arguments and then its result. Stops at
+ * the first case that doesn't return normally, setting *stopped_at to its
+ * index (n if all returned), and returns its status.
+ */
+emu_status_t emu_run_batch(const emu_program_t *emu, int entry, unsigned num_args, int *elems,
+        unsigned stride, unsigned n, uint64_t fuel, unsigned *stopped_at);
+
+#endif // EMU_H
@@ -0,0 +1,61 @@
+# Solutions using instructions the emulator added after the first subset:
+# imul, rol/ror, bt, xchg, cltq and cltd. Graded by make test-emu, which
+# expects every function here to pass (missing ones fault), as in expected.
+    .text
+    .globl evenBits
+evenBits:
+    movl $0x5555, %eax
+    imull $0x10001, %eax, %eax
+    ret
+
+    .globl allOddBits
+allOddBits:
+    roll $31, %edi              # odd bits down to the even positions
+    andl $0x55555555, %edi
+    xorl %eax, %eax
+    cmpl $0x55555555, %edi
+    sete %al
+    ret
+
+    .globl isNegative
+isNegative:
+    xorl %eax, %eax
+    btl $31, %edi
+    setc %al
+    ret
+
+    .globl sign
+sign:
+    movl %edi, %eax
+    cltd                        # %edx = -1 if x < 0, else 0
+    xorl %eax, %eax
+    testl %edi, %edi
+    setg %al
+    addl %edx, %eax
+    ret
+
+    .globl isGreater
+isGreater:
+    movl %edi, %eax
+    cltq
+    movslq %esi, %rdx
+    cmpq %rdx, %rax
+    setg %al
+    movzbl %al, %eax
+    ret
+
+    .globl logicalShift
+logicalShift:
+    movl %edi, %eax
+    xchgl %esi, %ecx
+    shrl %cl, %eax
+    ret
+
+    .globl rotateRight
+rotateRight:
+    movl %esi, %ecx
+    movl %edi, %eax
+    rorl %cl, %eax
+    movl $2, %edx
+    imull %edx, %ecx            # flags and %ecx don't matter here
+    ret
@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "golden.h"
+#include "rng.h"
+
+#define GOLDEN_MAGIC "BTGOLD01"
+#define GOLDEN_PATH_LEN 512
+
+// Expected outputs are computed and written this many cases at a time
+#define GOLDEN_FILL_CHUNK 65536
+
+// Cases recomputed at random before a golden file is trusted
+#define GOLDEN_VERIFY_SAMPLES 256
+
+// File header. Fixed-width fields so 32-bit and 64-bit builds agree.
+typedef struct {
+    char magic[8];
+    uint64_t key __attribute__((aligned(8)));
+    uint64_t n_cases __attribute__((aligned(8)));
+} golden_header_t;
+
+uint64_t golden_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Map path and check that it holds golden data for key. Returns 0 on success.
+static int map_golden(golden_t *g, const char *path, uint64_t key, uint64_t n_cases) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    size_t size = sizeof(golden_header_t) + n_cases * sizeof(int);
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (uint64_t) st.st_size != size) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    const golden_header_t *header = map;
+    if (memcmp(header->magic, GOLDEN_MAGIC, sizeof(header->magic)) != 0 ||
+            header->key != key || header->n_cases != n_cases) {
+        munmap(map, size);
+        return -1;
+    }
+    g->map = map;
+    g->map_size = size;
+    g->expected = (const int *) (header + 1);
+    g->n_cases = n_cases;
+    return 0;
+}
+
+// verify_golden - Recompute a random sample of the mapped expected outputs,
+// chosen afresh on every run so a doctored file can't know which are checked.
+// Returns 0 if they all match.
+static int verify_golden(const golden_t *g, golden_fill_t fill, void *ctx) {
+    uint64_t stream = rng_stream((uint64_t) time(NULL), (uint64_t) getpid() ^ (uintptr_t) g->map);
+    for (unsigned i = 0; i < GOLDEN_VERIFY_SAMPLES && g->n_cases > 0; i++) {
+        uint64_t c = rng_at(stream, i) % g->n_cases;
+        int expected;
+        fill(ctx, &expected, c, 1);
+        if (expected != g->expected[c]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Write a fresh golden file next to path, then move it into place so that
+// concurrent servers never see a partial file. Returns 0 on success.
+static int build_golden(const char *path, uint64_t key, uint64_t n_cases,
+        golden_fill_t fill, void *ctx) {
+    char tmp_path[GOLDEN_PATH_LEN];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int) getpid()) >= (int) sizeof(tmp_path)) {
+        return -1;
+    }
+    FILE *out = fopen(tmp_path, "wb");
+    if (out == NULL) {
+        return -1;
+    }
+
+    golden_header_t header = { .key = key, .n_cases = n_cases };
+    memcpy(header.magic, GOLDEN_MAGIC, sizeof(header.magic));
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    int *chunk = malloc(GOLDEN_FILL_CHUNK * sizeof(int));
+    ok = ok && chunk != NULL;
+    for (uint64_t start = 0; ok && start < n_cases; start += GOLDEN_FILL_CHUNK) {
+        unsigned count = n_cases - start < GOLDEN_FILL_CHUNK ? n_cases - start : GOLDEN_FILL_CHUNK;
+        fill(ctx, chunk, start, count);
+        ok = fwrite(chunk, sizeof(int), count, out) == count;
+    }
+    free(chunk);
+
+    if (fclose(out) != 0 || !ok || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int golden_open(golden_t *g, const char *dir, const char *func_name, uint64_t key,
+        uint64_t n_cases, golden_fill_t fill, void *ctx) {
+    memset(g, 0, sizeof(*g));
+    if (dir == NULL) {
+        return -1;
+    }
+
+    char path[GOLDEN_PATH_LEN];
+    if (snprintf(path, sizeof(path), "%s/%s.gold", dir, func_name) >= (int) sizeof(path)) {
+        return -1;
+    }
+    if (map_golden(g, path, key, n_cases) == 0) {
+        if (verify_golden(g, fill, ctx) == 0) {
+            return 0;
+        }
+        fprintf(stderr, "Warning: %s disagrees with the reference, rebuilding it\n", path);
+        golden_close(g);
+    }
+
+    // Missing, stale or wrong, so (re)build it
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    if (build_golden(path, key, n_cases, fill, ctx) == -1) {
+        return -1;
+    }
+    return map_golden(g, path, key, n_cases);
+}
+
+void golden_close(golden_t *g) {
+    if (g->map != NULL) {
+        munmap(g->map, g->map_size);
+    }
+    memset(g, 0, sizeof(*g));
+}
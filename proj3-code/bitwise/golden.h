@@ -0,0 +1,39 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// On-disk cache of the expected outputs for one function's test vectors.
+// Each file holds a header followed by one int per test case, in case order,
+// and is mapped read-only so every server process shares the same pages.
+
+typedef struct {
+    const int *expected;    // Expected output of each test case, NULL if no golden data
+    uint64_t n_cases;
+    void *map;              // Start of the mapping, including header
+    size_t map_size;
+} golden_t;
+
+// Computes the expected outputs of cases start..start+count-1 into out
+typedef void (*golden_fill_t)(void *ctx, int *out, uint64_t start, unsigned count);
+
+// 64-bit FNV-1a hash of len bytes, continuing from hash (start with GOLDEN_HASH_INIT)
+#define GOLDEN_HASH_INIT 0xcbf29ce484222325ULL
+uint64_t golden_hash(uint64_t hash, const void *data, size_t len);
+
+/*
+ * Map the golden file for func_name in dir. If the file is missing, was
+ * built for a different key or number of cases, or disagrees with fill on a
+ * random sample of cases, it is rebuilt by calling fill over every case.
+ * The key only says which vectors a file is for, so dir should be one only
+ * the harness can write to, never a submission directory. Returns 0 on
+ * success, or -1 (with g->expected NULL) if no golden data could be used, in
+ * which case the caller should fall back to computing expected outputs itself.
+ */
+int golden_open(golden_t *g, const char *dir, const char *func_name, uint64_t key,
+        uint64_t n_cases, golden_fill_t fill, void *ctx);
+
+void golden_close(golden_t *g);
+
+#endif // GOLDEN_H
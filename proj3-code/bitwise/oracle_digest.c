@@ -0,0 +1,111 @@
+/*
+ * oracle_digest.c - Print a digest of everything btest_server computes on
+ * its own: the layout of the messages it shares with the client, and each
+ * function's golden key, test vectors and expected outputs under a few sets
+ * of options. Built both 32-bit and 64-bit by "make test-builds", which
+ * checks that the two print exactly the same thing, so that a server built
+ * either way tests the same cases and gives the same results.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dl_protocol.h"
+#include "golden.h"
+#include "rng.h"
+#include "testgen.h"
+#include "utils.h"
+
+/* In exhaustive mode, this many evenly spaced chunks of VALIDATE_CHUNK cases are checked */
+#define EXHAUSTIVE_SAMPLE_CHUNKS 4096
+
+#define LAYOUT(type, field) \
+    printf("%s.%s %zu %zu\n", #type, #field, offsetof(type, field), sizeof(((type *) 0)->field))
+
+static int elems[MAX_BATCH_CASES * MAX_CASE_INTS];
+static int expected[MAX_BATCH_CASES];
+
+// print_layout - Offsets and sizes of every field the client and server share
+static void print_layout(void) {
+    printf("function_result_t %zu\n", sizeof(function_result_t));
+    printf("counterexample_t %zu\n", sizeof(counterexample_t));
+    printf("failure_class_t %zu\n", sizeof(failure_class_t));
+    printf("failure_report_t %zu\n", sizeof(failure_report_t));
+    LAYOUT(failure_report_t, n_failures);
+    LAYOUT(failure_report_t, examples);
+    LAYOUT(failure_report_t, classes);
+    printf("function_stats_t %zu\n", sizeof(function_stats_t));
+    printf("test_batch_t %zu\n", sizeof(test_batch_t));
+    LAYOUT(test_batch_t, previous_outcome);
+    LAYOUT(test_batch_t, previous_result);
+    LAYOUT(test_batch_t, previous_failures);
+    LAYOUT(test_batch_t, previous_stats);
+    LAYOUT(test_batch_t, function_id);
+    LAYOUT(test_batch_t, n_test_cases);
+    LAYOUT(test_batch_t, n_run);
+    LAYOUT(test_batch_t, crashes);
+    LAYOUT(test_batch_t, cpu_ns);
+    LAYOUT(test_batch_t, wall_ns);
+    printf("test_batch_t.elems %zu\n", offsetof(test_batch_t, elems));
+    printf("ring_slot_t %zu\n", sizeof(ring_slot_t));
+    LAYOUT(ring_slot_t, ready_for_server);
+    LAYOUT(ring_slot_t, seq);
+    LAYOUT(ring_slot_t, type);
+    LAYOUT(ring_slot_t, payload);
+    printf("shmem_buf_t %zu\n", sizeof(shmem_buf_t));
+}
+
+// digest_cases - Hash the arguments and expected outputs of count cases from start
+static uint64_t digest_cases(const test_vectors_t *vec, uint64_t hash, uint64_t start,
+        unsigned count) {
+    unsigned stride = vec->num_args > 0 ? vec->num_args + 1 : 1;
+    testgen_fill(vec, elems, start, count);
+    testgen_expected(vec, elems, count, expected);
+    for (unsigned i = 0; i < count; i++) {
+        hash = golden_hash(hash, &elems[i * stride], vec->num_args * sizeof(int));
+    }
+    return golden_hash(hash, expected, count * sizeof(int));
+}
+
+// digest_function - Print the digest of one function's cases under opts
+static void digest_function(enum function_id func, const char *label,
+        const testgen_options_t *opts) {
+    test_vectors_t vec;
+    testgen_init(&vec, func, opts);
+    uint64_t hash = GOLDEN_HASH_INIT;
+    if (vec.exhaustive) {
+        /* 2^32 cases are too many, so check evenly spaced chunks of them */
+        uint64_t spacing = vec.total_cases / EXHAUSTIVE_SAMPLE_CHUNKS;
+        for (uint64_t c = 0; c < EXHAUSTIVE_SAMPLE_CHUNKS; c++) {
+            hash = digest_cases(&vec, hash, c * spacing, VALIDATE_CHUNK);
+        }
+    } else {
+        for (uint64_t start = 0; start < vec.total_cases; start += MAX_BATCH_CASES) {
+            uint64_t left = vec.total_cases - start;
+            hash = digest_cases(&vec, hash, start, left < MAX_BATCH_CASES ? left : MAX_BATCH_CASES);
+        }
+    }
+    printf("%-16s %-12s %12llu %016llx %016llx\n", getFuncName(func), label,
+            (unsigned long long) vec.total_cases, (unsigned long long) testgen_golden_key(&vec),
+            (unsigned long long) hash);
+}
+
+int main(void) {
+    print_layout();
+
+    const struct {
+        const char *label;
+        testgen_options_t opts;
+    } runs[] = {
+        { "default", { .seed = RNG_SEED_DEFAULT } },
+        { "seed", { .seed = 0x123456789abcdefULL } },
+        { "exhaustive", { .seed = RNG_SEED_DEFAULT, .exhaustive = 1 } },
+        { "pinned", { .seed = RNG_SEED_DEFAULT, .has_arg = {1, 0}, .argval = {0x80000000u, 0} } },
+    };
+    for (unsigned r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        for (int func = 0; func < NUM_PUZZLES; func++) {
+            digest_function(func, runs[r].label, &runs[r].opts);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <string.h>
+
+#include "profile.h"
+
+static const char *const phase_names[NUM_PHASES] = {
+    "setup", "generate", "send", "wait", "client", "validate",
+};
+
+void profile_add(function_profile_t *total, const function_profile_t *profile) {
+    for (int p = 0; p < NUM_PHASES; p++) {
+        total->phases[p].wall_ns += profile->phases[p].wall_ns;
+        total->phases[p].cpu_ns += profile->phases[p].cpu_ns;
+        total->phases[p].bytes += profile->phases[p].bytes;
+        total->phases[p].batches += profile->phases[p].batches;
+    }
+}
+
+// is_empty - Whether a function went untested, e.g. skipped with -f or cached
+static int is_empty(const function_profile_t *profile) {
+    for (int p = 0; p < NUM_PHASES; p++) {
+        if (profile->phases[p].batches > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void profile_print(FILE *out, const char *const names[], const function_profile_t *profiles,
+        int n_funcs) {
+    function_profile_t total = {};
+
+    // Phases of different channel threads overlap, so a function's row can
+    // add up to more than the time it took
+    fprintf(out, "\nWall time by phase, summed over channel threads (ms):\n");
+    fprintf(out, "%-16s", "Function");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        fprintf(out, " %10s", phase_names[p]);
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i < n_funcs; i++) {
+        if (is_empty(&profiles[i])) {
+            continue;
+        }
+        fprintf(out, "%-16s", names[i]);
+        for (int p = 0; p < NUM_PHASES; p++) {
+            fprintf(out, " %10.3f", profiles[i].phases[p].wall_ns / 1e6);
+        }
+        fprintf(out, "\n");
+        profile_add(&total, &profiles[i]);
+    }
+
+    fprintf(out, "\n%-16s %12s %12s %12s %10s\n", "Phase", "Wall ms", "CPU ms", "MB", "Batches");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        const phase_stats_t *phase = &total.phases[p];
+        fprintf(out, "%-16s %12.3f %12.3f %12.3f %10llu\n", phase_names[p], phase->wall_ns / 1e6,
+                phase->cpu_ns / 1e6, phase->bytes / 1e6, (unsigned long long) phase->batches);
+    }
+}
+
+int profile_dump(const char *path, const char *const names[], const function_profile_t *profiles,
+        int n_funcs) {
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < n_funcs; i++) {
+        if (is_empty(&profiles[i])) {
+            continue;
+        }
+        for (int p = 0; p < NUM_PHASES; p++) {
+            const phase_stats_t *phase = &profiles[i].phases[p];
+            fprintf(out, "{\"function\":\"%s\",\"phase\":\"%s\",\"wall_ns\":%llu,\"cpu_ns\":%llu,"
+                "\"bytes\":%llu,\"batches\":%llu}\n", names[i], phase_names[p],
+                (unsigned long long) phase->wall_ns, (unsigned long long) phase->cpu_ns,
+                (unsigned long long) phase->bytes, (unsigned long long) phase->batches);
+        }
+    }
+    if (out == stdout) {
+        fflush(out);
+        return 0;
+    }
+    if (fclose(out) == EOF) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
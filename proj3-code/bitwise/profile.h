@@ -0,0 +1,71 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Where btest_server's time goes while testing each function (--profile).
+// Every phase is timed by the thread doing the work, except the client's,
+// which the client measures and sends back with each batch.
+
+enum profile_phase {
+    PHASE_SETUP,        // Setting up test vectors and mapping or building golden data
+    PHASE_GENERATE,     // Writing arguments into batches
+    PHASE_SEND,         // Handing batches to the client (sema_post)
+    PHASE_WAIT,         // Waiting for the client's replies (sema_wait)
+    PHASE_CLIENT,       // Client running student code, as measured by the client
+    PHASE_VALIDATE,     // Checking results against expected outputs
+    NUM_PHASES
+};
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t bytes;         // Test case data written or read
+    uint64_t batches;
+} phase_stats_t;
+
+typedef struct {
+    phase_stats_t phases[NUM_PHASES];
+} function_profile_t;
+
+// Wall and CPU time of the calling thread at the start of a phase
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+} profile_mark_t;
+
+static inline uint64_t profile_clock_ns(int clock_id) {
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// profile_begin - Note the time at the start of a phase
+static inline void profile_begin(profile_mark_t *mark) {
+    mark->wall_ns = profile_clock_ns(CLOCK_MONOTONIC);
+    mark->cpu_ns = profile_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// profile_end - Add the time since profile_begin() and one batch of bytes to a phase
+static inline void profile_end(phase_stats_t *phase, const profile_mark_t *mark, uint64_t bytes) {
+    phase->wall_ns += profile_clock_ns(CLOCK_MONOTONIC) - mark->wall_ns;
+    phase->cpu_ns += profile_clock_ns(CLOCK_THREAD_CPUTIME_ID) - mark->cpu_ns;
+    phase->bytes += bytes;
+    phase->batches++;
+}
+
+// Add every phase of *profile to *total
+void profile_add(function_profile_t *total, const function_profile_t *profile);
+
+// Print a table of each function's phases, then their totals
+void profile_print(FILE *out, const char *const names[], const function_profile_t *profiles,
+        int n_funcs);
+
+// Write one JSON object per line for each function and phase to path, or to
+// stdout if path is "-". Returns 0 on success, -1 on error.
+int profile_dump(const char *path, const char *const names[], const function_profile_t *profiles,
+        int n_funcs);
+
+#endif // PROFILE_H
@@ -0,0 +1,173 @@
+#include <string.h>
+
+#include "report.h"
+
+// outcome_name - How an outcome is spelled in records
+static const char *outcome_name(enum test_outcome outcome) {
+    switch (outcome) {
+        case SUCCESS:
+            return "success";
+        case FAILURE:
+            return "failure";
+        case TIMEOUT:
+            return "timeout";
+        case SEGFAULT:
+            return "segfault";
+        case FLOAT_ERROR:
+            return "float_error";
+        default:
+            return "unknown";
+    }
+}
+
+int report_parse_format(const char *arg, enum report_format *format) {
+    if (strcmp(arg, "text") == 0) {
+        *format = REPORT_TEXT;
+    } else if (strcmp(arg, "json") == 0) {
+        *format = REPORT_JSON;
+    } else if (strcmp(arg, "tap") == 0) {
+        *format = REPORT_TAP;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// print_string - A JSON string, which is also a double-quoted YAML scalar
+static void print_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void report_begin(FILE *out, enum report_format format) {
+    if (format == REPORT_TAP) {
+        fprintf(out, "TAP version 13\n");
+        fflush(out);
+    }
+}
+
+// print_json - One line with the record's fields. Function names are plain
+// identifiers, so nothing needs escaping.
+static void print_json(FILE *out, const report_record_t *record) {
+    const function_stats_t *stats = record->stats;
+    fprintf(out, "{");
+    if (record->submission != NULL) {
+        fprintf(out, "\"submission\":");
+        print_string(out, record->submission);
+        fprintf(out, ",");
+    }
+    fprintf(out, "\"function\":\"%s\",\"outcome\":\"%s\",\"score\":%u,\"rating\":%u,",
+        record->name, outcome_name(record->outcome), record->score, record->rating);
+    if (!record->errors_unknown) {
+        fprintf(out, "\"errors\":%llu,", (unsigned long long) record->n_errors);
+    }
+    fprintf(out, "\"cached\":%s,\"tests\":%llu,\"wall_ms\":%.3f,\"cpu_ms\":%.3f",
+        record->cached ? "true" : "false", (unsigned long long) stats->n_tests,
+        stats->wall_ns / 1e6, stats->cpu_ns / 1e6);
+
+    const function_result_t *result = record->result;
+    if (record->outcome != SUCCESS && (record->has_call || record->outcome == FAILURE)) {
+        fprintf(out, ",\"counterexample\":{\"args\":[");
+        for (unsigned i = 0; i < record->num_args; i++) {
+            fprintf(out, "%s%d", i > 0 ? "," : "", i == 0 ? result->arg1 : result->arg2);
+        }
+        fprintf(out, "]");
+        if (record->outcome == FAILURE) {
+            fprintf(out, ",\"actual\":%d,\"expected\":%d", result->actual_output,
+                result->expected_output);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}\n");
+}
+
+// print_tap - A test point with the record's fields in a YAML block
+static void print_tap(FILE *out, unsigned index, const report_record_t *record) {
+    const function_stats_t *stats = record->stats;
+    fprintf(out, "%s %u - %s\n", record->outcome == SUCCESS ? "ok" : "not ok", index, record->name);
+    fprintf(out, "  ---\n");
+    if (record->submission != NULL) {
+        fprintf(out, "  submission: ");
+        print_string(out, record->submission);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "  outcome: %s\n", outcome_name(record->outcome));
+    fprintf(out, "  score: %u\n", record->score);
+    fprintf(out, "  rating: %u\n", record->rating);
+    if (!record->errors_unknown) {
+        fprintf(out, "  errors: %llu\n", (unsigned long long) record->n_errors);
+    }
+    fprintf(out, "  cached: %s\n", record->cached ? "true" : "false");
+    fprintf(out, "  tests: %llu\n", (unsigned long long) stats->n_tests);
+    fprintf(out, "  wall_ms: %.3f\n", stats->wall_ns / 1e6);
+    fprintf(out, "  cpu_ms: %.3f\n", stats->cpu_ns / 1e6);
+
+    const function_result_t *result = record->result;
+    if (record->outcome != SUCCESS && (record->has_call || record->outcome == FAILURE)) {
+        fprintf(out, "  args: [");
+        for (unsigned i = 0; i < record->num_args; i++) {
+            fprintf(out, "%s%d", i > 0 ? ", " : "", i == 0 ? result->arg1 : result->arg2);
+        }
+        fprintf(out, "]\n");
+        if (record->outcome == FAILURE) {
+            fprintf(out, "  actual: %d\n", result->actual_output);
+            fprintf(out, "  expected: %d\n", result->expected_output);
+        }
+    }
+    fprintf(out, "  ...\n");
+}
+
+void report_function(FILE *out, enum report_format format, unsigned index,
+        const report_record_t *record) {
+    if (format == REPORT_JSON) {
+        print_json(out, record);
+    } else if (format == REPORT_TAP) {
+        print_tap(out, index, record);
+    }
+    // Whatever happens to the run after this, the record is out
+    fflush(out);
+}
+
+void report_end(FILE *out, enum report_format format, unsigned n_functions, unsigned points_earned,
+        unsigned points_possible) {
+    if (format == REPORT_JSON) {
+        fprintf(out, "{\"total_points\":%u,\"possible_points\":%u,\"functions\":%u}\n",
+            points_earned, points_possible, n_functions);
+    } else if (format == REPORT_TAP) {
+        // A plan at the end is allowed, and lets a killed run show up as incomplete
+        fprintf(out, "1..%u\n", n_functions);
+        fprintf(out, "# Total points: %u/%u\n", points_earned, points_possible);
+    }
+    fflush(out);
+}
+
+void report_relabel(FILE *out, const char *submission, const char *line) {
+    fprintf(out, "{\"submission\":");
+    print_string(out, submission);
+    fprintf(out, ",%s\n", line + 1);
+}
+
+void report_submission(FILE *out, const char *submission, const char *error, unsigned n_functions,
+        unsigned points_earned, unsigned points_possible, uint64_t wall_ns) {
+    fprintf(out, "{\"submission\":");
+    print_string(out, submission);
+    if (error != NULL) {
+        fprintf(out, ",\"error\":");
+        print_string(out, error);
+    } else {
+        fprintf(out, ",\"total_points\":%u,\"possible_points\":%u,\"functions\":%u,\"wall_ms\":%.3f",
+            points_earned, points_possible, n_functions, wall_ns / 1e6);
+    }
+    fprintf(out, "}\n");
+    fflush(out);
+}
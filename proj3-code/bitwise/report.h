@@ -0,0 +1,57 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dl_protocol.h"
+
+// Machine-readable forms of btest's results (-O). Each function's record is
+// written and flushed as soon as its result is in, so a run killed part way
+// through still leaves the scores of every function it finished.
+
+enum report_format {
+    REPORT_TEXT,        // btest's usual table, printed by btest itself
+    REPORT_JSON,        // One JSON object per line (NDJSON)
+    REPORT_TAP,         // Test Anything Protocol, version 13
+};
+
+typedef struct {
+    const char *submission;         // Path of the submission graded by bgrade, NULL in btest
+    const char *name;
+    unsigned rating;
+    unsigned score;
+    enum test_outcome outcome;      // SUCCESS, FAILURE, TIMEOUT, SEGFAULT or FLOAT_ERROR
+    int cached;                     // Result came from the result cache (-C)
+    unsigned num_args;
+    const function_result_t *result; // Failing case, unless outcome is SUCCESS
+    int has_call;                   // result's arguments are those of the failing case
+    uint64_t n_errors;              // Failing test cases found, as in the Errors column
+    int errors_unknown;             // n_errors wasn't counted and is left out (bgrade)
+    const function_stats_t *stats;
+} report_record_t;
+
+// Parse the argument of -O. Returns 0 on success, -1 if it names no format.
+int report_parse_format(const char *arg, enum report_format *format);
+
+// Write what comes before the first record
+void report_begin(FILE *out, enum report_format format);
+
+// Write the record of the index'th function reported, counting from 1
+void report_function(FILE *out, enum report_format format, unsigned index,
+        const report_record_t *record);
+
+// Write the totals after n_functions records
+void report_end(FILE *out, enum report_format format, unsigned n_functions, unsigned points_earned,
+        unsigned points_possible);
+
+// Write a json record written by btest, line (without its newline), as one
+// of submission's (json only)
+void report_relabel(FILE *out, const char *submission, const char *line);
+
+// Write bgrade's summary of one submission after its records, or the reason it
+// couldn't be graded if error is non-NULL (json only)
+void report_submission(FILE *out, const char *submission, const char *error, unsigned n_functions,
+        unsigned points_earned, unsigned points_possible, uint64_t wall_ns);
+
+#endif // REPORT_H
@@ -0,0 +1,352 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "golden.h"
+#include "result_cache.h"
+#include "utils.h"
+
+#define CACHE_PATH_LEN 512
+#define MAX_LINE 1024
+#define MAX_LABELS 256
+#define MAX_LABEL_LEN 64
+
+// One function's body, normalized line by line
+typedef struct {
+    char *text;             // Normalized lines, each terminated by '\n'
+    size_t len;
+    size_t cap;
+    char labels[MAX_LABELS][MAX_LABEL_LEN]; // Labels defined in the body, in order
+    int n_labels;
+    int defines_self;       // Body defines the function's own label
+    int unsound;            // Body can't be keyed on its own text
+    char last_mnemonic[MAX_LABEL_LEN]; // Final instruction in the body
+} body_t;
+
+static void append(body_t *body, const char *s, size_t n) {
+    if (body->len + n + 1 > body->cap) {
+        body->cap = (body->len + n + 1) * 2;
+        body->text = realloc(body->text, body->cap);
+    }
+    memcpy(body->text + body->len, s, n);
+    body->len += n;
+    body->text[body->len] = '\0';
+}
+
+static int is_ident_start(char c) {
+    return isalpha((unsigned char) c) || c == '_' || c == '.';
+}
+
+static int is_ident_char(char c) {
+    return isalnum((unsigned char) c) || c == '_' || c == '.' || c == '$';
+}
+
+// strip_comments - Remove "#" comments and "/* */" comments (which may span
+// lines, tracked by *in_block) from line, in place
+static void strip_comments(char *line, int *in_block) {
+    char *out = line;
+    for (char *p = line; *p != '\0'; p++) {
+        if (*in_block) {
+            if (p[0] == '*' && p[1] == '/') {
+                *in_block = 0;
+                p++;
+            }
+        } else if (p[0] == '/' && p[1] == '*') {
+            *in_block = 1;
+            p++;
+        } else if (*p == '#') {
+            break;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+// collapse_space - Reduce runs of whitespace to one space, dropping it entirely
+// at either end and next to punctuation, in place
+static void collapse_space(char *line) {
+    char *out = line;
+    int pending_space = 0;
+    for (char *p = line; *p != '\0'; p++) {
+        if (isspace((unsigned char) *p)) {
+            pending_space = 1;
+            continue;
+        }
+        int punct = *p == ',' || *p == '(' || *p == ')' || *p == ':';
+        int prev_punct = out > line && (out[-1] == ',' || out[-1] == '(' || out[-1] == ')');
+        if (pending_space && out > line && !punct && !prev_punct) {
+            *out++ = ' ';
+        }
+        pending_space = 0;
+        *out++ = *p;
+    }
+    *out = '\0';
+}
+
+static int find_label(const body_t *body, const char *name) {
+    for (int i = 0; i < body->n_labels; i++) {
+        if (strcmp(body->labels[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// collect_labels - Record the labels a normalized line defines ("NAME:" prefixes)
+static void collect_labels(body_t *body, const char *func_name, const char *line) {
+    const char *p = line;
+    while (is_ident_start(*p)) {
+        const char *start = p;
+        while (is_ident_char(*p)) {
+            p++;
+        }
+        if (*p != ':') {
+            return;
+        }
+        size_t n = p - start;
+        char name[MAX_LABEL_LEN];
+        if (n >= MAX_LABEL_LEN || body->n_labels == MAX_LABELS) {
+            body->unsound = 1;
+            return;
+        }
+        memcpy(name, start, n);
+        name[n] = '\0';
+        if (strcmp(name, func_name) == 0) {
+            body->defines_self = 1;
+        } else if (find_label(body, name) == -1) {
+            strcpy(body->labels[body->n_labels++], name);
+        }
+        p++;
+        while (*p == ' ') {
+            p++;
+        }
+    }
+}
+
+// rename_labels - Append line to the body with every local label replaced by
+// its position among the body's labels, so label names don't affect the key.
+// Any other symbol apart from the function's own name means the function
+// depends on code or data outside its body.
+static void rename_labels(body_t *body, const char *func_name, const char *line) {
+    const char *p = line;
+    int at_mnemonic = 1;
+    while (*p != '\0') {
+        // Registers, immediates and numbers pass through untouched
+        if (*p == '%' || isdigit((unsigned char) *p) || (*p == '-' && isdigit((unsigned char) p[1]))) {
+            const char *start = p++;
+            while (is_ident_char(*p)) {
+                p++;
+            }
+            append(body, start, p - start);
+            continue;
+        }
+        if (!is_ident_start(*p)) {
+            append(body, p, 1);
+            p++;
+            continue;
+        }
+
+        const char *start = p;
+        while (is_ident_char(*p)) {
+            p++;
+        }
+        size_t n = p - start;
+        char name[MAX_LABEL_LEN];
+        if (n >= MAX_LABEL_LEN) {
+            body->unsound = 1;
+            append(body, start, n);
+            continue;
+        }
+        memcpy(name, start, n);
+        name[n] = '\0';
+
+        int label = find_label(body, name);
+        if (label != -1) {
+            char renamed[16];
+            snprintf(renamed, sizeof(renamed), ".L%d", label);
+            append(body, renamed, strlen(renamed));
+        } else {
+            append(body, name, n);
+            if (*p == ':' || strcmp(name, func_name) == 0) {
+                // Label definition or the function's own name
+            } else if (at_mnemonic) {
+                // Instruction or directive name, remember the last instruction
+                if (name[0] != '.') {
+                    strcpy(body->last_mnemonic, name);
+                }
+                at_mnemonic = 0;
+            } else {
+                body->unsound = 1;
+            }
+        }
+        if (*p == ':') {
+            append(body, p, 1);
+            p++;
+            // An instruction may follow a label on the same line
+            while (*p == ' ') {
+                p++;
+            }
+            at_mnemonic = 1;
+        }
+    }
+    append(body, "\n", 1);
+}
+
+// puzzle_for_global - Puzzle declared by a ".global NAME" line, or -1
+static int puzzle_for_global(const char *line, const char **name_out) {
+    if (strncmp(line, ".global ", 8) != 0 && strncmp(line, ".globl ", 7) != 0) {
+        return -2;
+    }
+    const char *name = strchr(line, ' ') + 1;
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        if (strcmp(name, getFuncName(id)) == 0) {
+            *name_out = getFuncName(id);
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Split the source into normalized lines, handing each to fn
+static void for_each_line(const char *source, void (*fn)(void *ctx, char *line), void *ctx) {
+    int in_block = 0;
+    const char *p = source;
+    while (*p != '\0') {
+        const char *end = strchr(p, '\n');
+        size_t n = end != NULL ? (size_t) (end - p) : strlen(p);
+        char line[MAX_LINE];
+        if (n >= MAX_LINE) {
+            n = MAX_LINE - 1;
+        }
+        memcpy(line, p, n);
+        line[n] = '\0';
+        strip_comments(line, &in_block);
+        collapse_space(line);
+        // Full-line "/" comments, as accepted by cc_check
+        if (line[0] != '\0' && line[0] != '/') {
+            fn(ctx, line);
+        }
+        p += end != NULL ? n + 1 : n;
+        if (end != NULL && n == MAX_LINE - 1) {
+            p = end + 1;
+        }
+    }
+}
+
+typedef struct {
+    int current;            // Puzzle whose body we're in, -1 before the first
+    const char *names[NUM_PUZZLES];
+    int seen[NUM_PUZZLES];
+    body_t preamble;        // Everything before the first puzzle
+    body_t bodies[NUM_PUZZLES];
+    int pass;               // 1: collect labels, 2: normalize
+} split_t;
+
+static void split_line(void *ctx, char *line) {
+    split_t *split = ctx;
+    const char *name = NULL;
+    int id = puzzle_for_global(line, &name);
+    if (id >= 0) {
+        split->current = id;
+        if (split->pass == 1) {
+            if (split->seen[id]) {
+                // Declared twice, can't tell which body is the real one
+                split->bodies[id].unsound = 1;
+            }
+            split->seen[id] = 1;
+            split->names[id] = name;
+        }
+        return;
+    } else if (id == -1) {
+        // .global for something other than a puzzle ends the current body
+        split->current = -1;
+    }
+
+    body_t *body = split->current >= 0 ? &split->bodies[split->current] : &split->preamble;
+    const char *func_name = split->current >= 0 ? split->names[split->current] : "";
+    if (split->pass == 1) {
+        collect_labels(body, func_name, line);
+    } else {
+        rename_labels(body, func_name, line);
+    }
+}
+
+void result_cache_keys(const char *source, const char *salt, result_key_t keys[NUM_PUZZLES]) {
+    split_t split = { .current = -1 };
+    split.pass = 1;
+    for_each_line(source, split_line, &split);
+    split.current = -1;
+    split.pass = 2;
+    for_each_line(source, split_line, &split);
+
+    uint64_t base = golden_hash(GOLDEN_HASH_INIT, salt, strlen(salt));
+    if (split.preamble.text != NULL) {
+        base = golden_hash(base, split.preamble.text, split.preamble.len);
+    }
+
+    for (int id = 0; id < NUM_PUZZLES; id++) {
+        body_t *body = &split.bodies[id];
+        // A body must define its own label and end in a ret or jmp so that
+        // control can't run on into code outside it
+        keys[id].cacheable = split.seen[id] && body->text != NULL && !body->unsound &&
+            !split.preamble.unsound && body->defines_self &&
+            (strncmp(body->last_mnemonic, "ret", 3) == 0 ||
+             strcmp(body->last_mnemonic, "jmp") == 0);
+        keys[id].key = golden_hash(base, getFuncName(id), strlen(getFuncName(id)));
+        if (body->text != NULL) {
+            keys[id].key = golden_hash(keys[id].key, body->text, body->len);
+        }
+        free(body->text);
+    }
+    free(split.preamble.text);
+}
+
+static void record_path(char *path, size_t size, const char *dir, uint64_t key) {
+    snprintf(path, size, "%s/%016llx", dir, (unsigned long long) key);
+}
+
+int result_cache_lookup(const char *dir, uint64_t key, enum test_outcome *outcome,
+        function_result_t *result) {
+    char path[CACHE_PATH_LEN];
+    record_path(path, sizeof(path), dir, key);
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return 0;
+    }
+    int o;
+    int found = fscanf(in, "%d %d %d %d %d", &o, &result->arg1, &result->arg2,
+            &result->expected_output, &result->actual_output) == 5;
+    fclose(in);
+    if (!found || (o != SUCCESS && o != SEGFAULT && o != FLOAT_ERROR && o != FAILURE)) {
+        return 0;
+    }
+    *outcome = o;
+    return 1;
+}
+
+int result_cache_store(const char *dir, uint64_t key, enum test_outcome outcome,
+        const function_result_t *result) {
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    char path[CACHE_PATH_LEN];
+    char tmp_path[CACHE_PATH_LEN + 16];
+    record_path(path, sizeof(path), dir, key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int) getpid());
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    int ok = fprintf(out, "%d %d %d %d %d\n", outcome, result->arg1, result->arg2,
+            result->expected_output, result->actual_output) > 0;
+    if (fclose(out) != 0 || !ok || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdint.h>
+
+#include "dl_protocol.h"
+
+// Persistent record of each function's test outcome, keyed on a hash of
+// the function's normalized assembly. Records are small text files named
+// after the key, so one directory can be shared by many students' runs.
+// Records are trusted as they are and the keys come from public sources, so
+// the directory must be one students can't write to.
+
+typedef struct {
+    int cacheable;      // Could a sound key be computed for this function?
+    uint64_t key;
+} result_key_t;
+
+/*
+ * Split assembly source at each ".global <puzzle>" directive and compute a key
+ * for every puzzle from its body with comments, whitespace and label names
+ * normalized away, plus salt. A function is left uncacheable if its body
+ * is missing, refers to a label outside itself, or might fall through into
+ * whatever follows it.
+ */
+void result_cache_keys(const char *source, const char *salt, result_key_t keys[NUM_PUZZLES]);
+
+// Look up the record for key. Returns 1 if found, 0 otherwise.
+int result_cache_lookup(const char *dir, uint64_t key, enum test_outcome *outcome,
+        function_result_t *result);
+
+// Store a record for key. Returns 0 on success, -1 on error.
+int result_cache_store(const char *dir, uint64_t key, enum test_outcome outcome,
+        const function_result_t *result);
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,46 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Counter-based random numbers for test generation. Value i of a stream is a
+// pure function of the seed, the stream's ID and i, so any thread or shard can
+// produce any part of a stream without coordinating with the others, and the
+// values are the same on every machine and C library.
+
+#define RNG_SEED_DEFAULT 1
+
+// rng_mix - SplitMix64 finalizer, a bijection that scrambles every input bit
+static inline uint64_t rng_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// rng_stream - Key for an independent stream, e.g. one per function and argument
+static inline uint64_t rng_stream(uint64_t seed, uint64_t stream_id) {
+    return rng_mix(seed ^ rng_mix(stream_id + 0x9E3779B97F4A7C15ULL));
+}
+
+// rng_at - The 64-bit value at position counter of a stream
+static inline uint64_t rng_at(uint64_t stream, uint64_t counter) {
+    return rng_mix(stream + (counter + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+// rng_range - Uniform value in [min, max] at position counter of a stream,
+// without the bias of scaling. Draws that would be biased are replaced by
+// further values derived from the same position.
+static inline int rng_range(uint64_t stream, uint64_t counter, int min, int max) {
+    uint64_t span = (uint64_t) ((int64_t) max - min) + 1;  // 1 to 2^32
+    uint32_t threshold = (uint32_t) ((1ULL << 32) % span);
+    uint64_t r = rng_at(stream, counter);
+    for (uint64_t attempt = 1; ; attempt++) {
+        uint64_t m = (r >> 32) * span;
+        if ((uint32_t) m >= threshold) {
+            return (int) ((int64_t) min + (int64_t) (m >> 32));
+        }
+        r = rng_mix(r + attempt);
+    }
+}
+
+#endif // RNG_H
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sat.h"
+
+#define NO_REASON UINT32_MAX
+#define VAR_DECAY 0.95
+#define RESTART_UNIT 100
+
+typedef struct {
+    uint32_t *data;
+    uint32_t n, cap;
+} vec_t;
+
+struct sat {
+    uint32_t n_vars;
+    int8_t *assign;             // 1 true, -1 false, 0 unassigned
+    uint8_t *phase;             // Value to try first, the last one the variable had
+    uint32_t *level;
+    uint32_t *reason;           // Clause that implied the variable, NO_REASON for decisions
+    uint8_t *seen;
+
+    // Clauses live in one arena: a size, then that many literals. The first
+    // two literals of each clause are the watched ones.
+    vec_t mem;
+    vec_t *watches;             // Clauses watching each literal
+
+    uint32_t *trail;
+    uint32_t n_trail, qhead;
+    vec_t trail_lim;            // Start of each decision level in the trail
+
+    double *activity;
+    double var_inc;
+    uint32_t *heap;             // Unassigned variables, by activity
+    int32_t *heap_pos;          // -1 if not in the heap
+    uint32_t heap_n;
+
+    vec_t learnt;
+    int unsat;                  // Conflict at level 0
+};
+
+static void vec_push(vec_t *v, uint32_t x) {
+    if (v->n == v->cap) {
+        v->cap = v->cap ? v->cap * 2 : 8;
+        v->data = realloc(v->data, (size_t) v->cap * sizeof(uint32_t));
+        if (v->data == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    v->data[v->n++] = x;
+}
+
+static void *zalloc(size_t n, size_t size) {
+    void *p = calloc(n ? n : 1, size);
+    if (p == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    return p;
+}
+
+static int lit_value(const sat_t *s, sat_lit_t lit) {
+    int v = s->assign[lit >> 1];
+    return lit & 1 ? -v : v;
+}
+
+static void heap_swap(sat_t *s, uint32_t i, uint32_t j) {
+    uint32_t t = s->heap[i];
+    s->heap[i] = s->heap[j];
+    s->heap[j] = t;
+    s->heap_pos[s->heap[i]] = i;
+    s->heap_pos[s->heap[j]] = j;
+}
+
+static void heap_up(sat_t *s, uint32_t i) {
+    while (i > 0 && s->activity[s->heap[(i - 1) / 2]] < s->activity[s->heap[i]]) {
+        heap_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_down(sat_t *s, uint32_t i) {
+    for (;;) {
+        uint32_t best = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < s->heap_n && s->activity[s->heap[l]] > s->activity[s->heap[best]]) {
+            best = l;
+        }
+        if (r < s->heap_n && s->activity[s->heap[r]] > s->activity[s->heap[best]]) {
+            best = r;
+        }
+        if (best == i) {
+            return;
+        }
+        heap_swap(s, i, best);
+        i = best;
+    }
+}
+
+static void heap_insert(sat_t *s, uint32_t var) {
+    if (s->heap_pos[var] >= 0) {
+        return;
+    }
+    s->heap[s->heap_n] = var;
+    s->heap_pos[var] = s->heap_n;
+    heap_up(s, s->heap_n++);
+}
+
+static uint32_t heap_pop(sat_t *s) {
+    uint32_t var = s->heap[0];
+    heap_swap(s, 0, --s->heap_n);
+    s->heap_pos[var] = -1;
+    heap_down(s, 0);
+    return var;
+}
+
+static void bump(sat_t *s, uint32_t var) {
+    if ((s->activity[var] += s->var_inc) > 1e100) {
+        for (uint32_t v = 0; v < s->n_vars; v++) {
+            s->activity[v] *= 1e-100;
+        }
+        s->var_inc *= 1e-100;
+    }
+    if (s->heap_pos[var] >= 0) {
+        heap_up(s, s->heap_pos[var]);
+    }
+}
+
+sat_t *sat_new(uint32_t n_vars) {
+    sat_t *s = zalloc(1, sizeof(sat_t));
+    s->n_vars = n_vars;
+    s->assign = zalloc(n_vars, sizeof(int8_t));
+    s->phase = zalloc(n_vars, sizeof(uint8_t));
+    s->level = zalloc(n_vars, sizeof(uint32_t));
+    s->reason = zalloc(n_vars, sizeof(uint32_t));
+    s->seen = zalloc(n_vars, sizeof(uint8_t));
+    s->watches = zalloc(2 * (size_t) n_vars, sizeof(vec_t));
+    s->trail = zalloc(n_vars, sizeof(uint32_t));
+    s->activity = zalloc(n_vars, sizeof(double));
+    s->heap = zalloc(n_vars, sizeof(uint32_t));
+    s->heap_pos = zalloc(n_vars, sizeof(int32_t));
+    s->var_inc = 1;
+    for (uint32_t v = 0; v < n_vars; v++) {
+        s->heap_pos[v] = -1;
+        heap_insert(s, v);
+    }
+    return s;
+}
+
+void sat_delete(sat_t *s) {
+    for (uint32_t l = 0; l < 2 * s->n_vars; l++) {
+        free(s->watches[l].data);
+    }
+    free(s->watches);
+    free(s->mem.data);
+    free(s->trail_lim.data);
+    free(s->learnt.data);
+    free(s->assign);
+    free(s->phase);
+    free(s->level);
+    free(s->reason);
+    free(s->seen);
+    free(s->trail);
+    free(s->activity);
+    free(s->heap);
+    free(s->heap_pos);
+    free(s);
+}
+
+static void enqueue(sat_t *s, sat_lit_t lit, uint32_t reason) {
+    uint32_t var = lit >> 1;
+    s->assign[var] = lit & 1 ? -1 : 1;
+    s->level[var] = s->trail_lim.n;
+    s->reason[var] = reason;
+    s->trail[s->n_trail++] = lit;
+}
+
+// propagate - Assign everything the trail implies. Returns the clause that
+// became false, or NO_REASON.
+static uint32_t propagate(sat_t *s) {
+    while (s->qhead < s->n_trail) {
+        sat_lit_t false_lit = sat_negate(s->trail[s->qhead++]);
+        vec_t *ws = &s->watches[false_lit];
+        uint32_t i = 0, j = 0;
+        while (i < ws->n) {
+            uint32_t cref = ws->data[i++];
+            uint32_t size = s->mem.data[cref];
+            sat_lit_t *c = &s->mem.data[cref + 1];
+            if (c[0] == false_lit) {
+                c[0] = c[1];
+                c[1] = false_lit;
+            }
+            if (lit_value(s, c[0]) == 1) {
+                ws->data[j++] = cref;
+                continue;
+            }
+
+            // Look for another literal to watch
+            int moved = 0;
+            for (uint32_t k = 2; k < size; k++) {
+                if (lit_value(s, c[k]) != -1) {
+                    c[1] = c[k];
+                    c[k] = false_lit;
+                    vec_push(&s->watches[c[1]], cref);
+                    moved = 1;
+                    break;
+                }
+            }
+            if (moved) {
+                continue;
+            }
+
+            ws->data[j++] = cref;
+            if (lit_value(s, c[0]) == -1) {
+                while (i < ws->n) {
+                    ws->data[j++] = ws->data[i++];
+                }
+                ws->n = j;
+                s->qhead = s->n_trail;
+                return cref;
+            }
+            enqueue(s, c[0], cref);
+        }
+        ws->n = j;
+    }
+    return NO_REASON;
+}
+
+// store_clause - Put a clause of two or more literals in the arena and watch
+// its first two
+static uint32_t store_clause(sat_t *s, const sat_lit_t *lits, unsigned n) {
+    uint32_t cref = s->mem.n;
+    vec_push(&s->mem, n);
+    for (unsigned i = 0; i < n; i++) {
+        vec_push(&s->mem, lits[i]);
+    }
+    vec_push(&s->watches[lits[0]], cref);
+    vec_push(&s->watches[lits[1]], cref);
+    return cref;
+}
+
+void sat_add_clause(sat_t *s, const sat_lit_t *lits, unsigned n) {
+    if (s->unsat) {
+        return;
+    }
+
+    // Drop duplicates and literals already false, and skip satisfied clauses
+    s->learnt.n = 0;
+    for (unsigned i = 0; i < n; i++) {
+        int value = lit_value(s, lits[i]);
+        if (value == 1) {
+            return;
+        }
+        if (value == -1) {
+            continue;
+        }
+        int dup = 0;
+        for (uint32_t j = 0; j < s->learnt.n; j++) {
+            if (s->learnt.data[j] == sat_negate(lits[i])) {
+                return;
+            }
+            dup |= s->learnt.data[j] == lits[i];
+        }
+        if (!dup) {
+            vec_push(&s->learnt, lits[i]);
+        }
+    }
+
+    if (s->learnt.n == 0) {
+        s->unsat = 1;
+    } else if (s->learnt.n == 1) {
+        enqueue(s, s->learnt.data[0], NO_REASON);
+        if (propagate(s) != NO_REASON) {
+            s->unsat = 1;
+        }
+    } else {
+        store_clause(s, s->learnt.data, s->learnt.n);
+    }
+}
+
+static void backtrack(sat_t *s, uint32_t level) {
+    if (s->trail_lim.n <= level) {
+        return;
+    }
+    uint32_t start = s->trail_lim.data[level];
+    for (uint32_t i = start; i < s->n_trail; i++) {
+        uint32_t var = s->trail[i] >> 1;
+        s->phase[var] = s->assign[var] == 1;
+        s->assign[var] = 0;
+        heap_insert(s, var);
+    }
+    s->n_trail = s->qhead = start;
+    s->trail_lim.n = level;
+}
+
+// analyze - Learn a first-UIP clause from a conflict, leaving it in s->learnt
+// with the asserting literal first. Returns the level to backtrack to.
+static uint32_t analyze(sat_t *s, uint32_t confl) {
+    uint32_t current = s->trail_lim.n;
+    uint32_t path = 0, index = s->n_trail;
+    sat_lit_t p = 0;
+    int have_p = 0;
+
+    s->learnt.n = 0;
+    vec_push(&s->learnt, 0);
+    do {
+        uint32_t size = s->mem.data[confl];
+        const sat_lit_t *c = &s->mem.data[confl + 1];
+        for (uint32_t k = have_p ? 1 : 0; k < size; k++) {
+            uint32_t var = c[k] >> 1;
+            if (s->seen[var] || s->level[var] == 0) {
+                continue;
+            }
+            bump(s, var);
+            s->seen[var] = 1;
+            if (s->level[var] >= current) {
+                path++;
+            } else {
+                vec_push(&s->learnt, c[k]);
+            }
+        }
+        while (!s->seen[s->trail[--index] >> 1]) {
+        }
+        p = s->trail[index];
+        have_p = 1;
+        confl = s->reason[p >> 1];
+        s->seen[p >> 1] = 0;
+        path--;
+    } while (path > 0);
+    s->learnt.data[0] = sat_negate(p);
+
+    // The literal from the highest remaining level is watched second
+    uint32_t back = 0, back_index = 1;
+    for (uint32_t i = 1; i < s->learnt.n; i++) {
+        uint32_t var = s->learnt.data[i] >> 1;
+        s->seen[var] = 0;
+        if (s->level[var] > back) {
+            back = s->level[var];
+            back_index = i;
+        }
+    }
+    if (s->learnt.n > 1) {
+        sat_lit_t t = s->learnt.data[1];
+        s->learnt.data[1] = s->learnt.data[back_index];
+        s->learnt.data[back_index] = t;
+    }
+    return back;
+}
+
+// luby - Element i of the Luby sequence 1, 1, 2, 1, 1, 2, 4, ...
+static uint64_t luby(uint64_t i) {
+    uint64_t size = 1, seq = 0;
+    while (size < i + 1) {
+        size = 2 * size + 1;
+        seq++;
+    }
+    while (size - 1 != i) {
+        size = (size - 1) / 2;
+        seq--;
+        i %= size;
+    }
+    return (uint64_t) 1 << seq;
+}
+
+enum sat_result sat_solve(sat_t *s, long conflict_limit) {
+    if (s->unsat || propagate(s) != NO_REASON) {
+        s->unsat = 1;
+        return SAT_UNSATISFIABLE;
+    }
+
+    long conflicts = 0;
+    uint64_t restarts = 0, restart_at = RESTART_UNIT * luby(0);
+    for (;;) {
+        uint32_t confl = propagate(s);
+        if (confl != NO_REASON) {
+            if (s->trail_lim.n == 0) {
+                s->unsat = 1;
+                return SAT_UNSATISFIABLE;
+            }
+            conflicts++;
+            uint32_t back = analyze(s, confl);
+            backtrack(s, back);
+            if (s->learnt.n == 1) {
+                enqueue(s, s->learnt.data[0], NO_REASON);
+            } else {
+                enqueue(s, s->learnt.data[0], store_clause(s, s->learnt.data, s->learnt.n));
+            }
+            s->var_inc /= VAR_DECAY;
+            continue;
+        }
+
+        if (conflict_limit >= 0 && conflicts > conflict_limit) {
+            backtrack(s, 0);
+            return SAT_UNKNOWN;
+        }
+        if (conflicts >= (long) restart_at) {
+            backtrack(s, 0);
+            restart_at = conflicts + RESTART_UNIT * luby(++restarts);
+        }
+
+        // Decide on the most active unassigned variable
+        uint32_t var = UINT32_MAX;
+        while (s->heap_n > 0) {
+            uint32_t v = heap_pop(s);
+            if (s->assign[v] == 0) {
+                var = v;
+                break;
+            }
+        }
+        if (var == UINT32_MAX) {
+            return SAT_SATISFIABLE;
+        }
+        vec_push(&s->trail_lim, s->n_trail);
+        enqueue(s, var * 2 + (s->phase[var] ? 0 : 1), NO_REASON);
+    }
+}
+
+int sat_value(const sat_t *s, uint32_t var) {
+    return s->assign[var] == 1;
+}
@@ -0,0 +1,33 @@
+#ifndef SAT_H
+#define SAT_H
+
+#include <stdint.h>
+
+// A small conflict-driven clause learning SAT solver: two watched literals,
+// first-UIP learning, VSIDS decisions with phase saving, and Luby restarts.
+// Enough for the circuits bitcheck builds, which have at most a few tens of
+// thousands of gates.
+
+// Variables are numbered from 0. A literal is a variable times two, plus one
+// if negated, the same encoding as aig_lit_t.
+typedef uint32_t sat_lit_t;
+
+#define sat_negate(lit) ((lit) ^ 1u)
+
+enum sat_result { SAT_UNKNOWN, SAT_SATISFIABLE, SAT_UNSATISFIABLE };
+
+typedef struct sat sat_t;
+
+sat_t *sat_new(uint32_t n_vars);
+void sat_delete(sat_t *s);
+
+// Add a clause, before solving. Duplicate literals are allowed.
+void sat_add_clause(sat_t *s, const sat_lit_t *lits, unsigned n);
+
+// Solve, giving up after conflict_limit conflicts (no limit if negative)
+enum sat_result sat_solve(sat_t *s, long conflict_limit);
+
+// Value of a variable in the model found by sat_solve()
+int sat_value(const sat_t *s, uint32_t var);
+
+#endif // SAT_H
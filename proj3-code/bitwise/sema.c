@@ -1,7 +1,9 @@
 #include <errno.h>
 #include <linux/futex.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "sema.h"
@@ -9,26 +11,133 @@
 // Note that this implementation is a binary semaphore
 // Internal value is always either 0 or 1
 
-int sema_wait(uint32_t *val) {
-    while (__atomic_exchange_n(val, 0, __ATOMIC_SEQ_CST) == 0) {
-        if (syscall(SYS_futex, val, FUTEX_WAIT, 0, NULL) == -1) {
-            if (errno != EAGAIN) {
-                return -1;
-            } else {
-                // Value is no longer 0, so caller should bring it back to 0
-                // and proceed
-                __atomic_store_n(val, 0, __ATOMIC_SEQ_CST);
-                return 0;
-            }
+// Bounds on the number of iterations sema_wait spins before sleeping
+#define MIN_SPIN 16
+#define MAX_SPIN 16384
+#define INITIAL_SPIN 1024
+
+static __thread sema_stats_t stats = { .spin_limit = INITIAL_SPIN };
+
+// Spinning only helps if the poster can run at the same time as us
+static int spinning_useful(void) {
+    static int n_cpus = 0;
+    if (n_cpus == 0) {
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return n_cpus > 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Record a wakeup from the kernel, measuring how long after the post we resumed
+static void note_wakeup(sema_t *sema) {
+    uint64_t posted = __atomic_load_n(&sema->posted_ns, __ATOMIC_ACQUIRE);
+    uint64_t now = now_ns();
+    if (posted != 0 && now > posted) {
+        uint64_t latency = now - posted;
+        stats.wake_latency_ns += latency;
+        if (latency > stats.max_wake_latency_ns) {
+            stats.max_wake_latency_ns = latency;
+        }
+    }
+}
+
+// Spin for up to spin_limit iterations before falling back to FUTEX_WAIT.
+// The budget adapts: a wait that succeeds while spinning pulls it toward twice
+// the iterations that wait needed, and a wait that has to sleep shrinks it.
+int sema_wait(sema_t *sema) {
+    stats.waits++;
+
+    uint32_t limit = spinning_useful() ? stats.spin_limit : 0;
+    for (uint32_t i = 0; i < limit; i++) {
+        if (__atomic_load_n(&sema->val, __ATOMIC_RELAXED) != 0 &&
+                __atomic_exchange_n(&sema->val, 0, __ATOMIC_SEQ_CST) != 0) {
+            int32_t target = 2 * (i + 1);
+            int32_t adjusted = (int32_t) stats.spin_limit + (target - (int32_t) stats.spin_limit) / 8;
+            stats.spin_limit = adjusted < MIN_SPIN ? MIN_SPIN : (adjusted > MAX_SPIN ? MAX_SPIN : adjusted);
+            stats.spin_hits++;
+            return 0;
+        }
+        cpu_relax();
+    }
+
+    int slept = 0;
+    while (__atomic_exchange_n(&sema->val, 0, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_add_fetch(&sema->waiters, 1, __ATOMIC_SEQ_CST);
+        long rc = syscall(SYS_futex, &sema->val, FUTEX_WAIT, 0, NULL);
+        __atomic_sub_fetch(&sema->waiters, 1, __ATOMIC_SEQ_CST);
+        if (rc == -1 && errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+        // Either woken by a post or the value was no longer 0,
+        // go around and try to bring it back to 0
+        slept = 1;
+    }
+
+    if (slept) {
+        stats.futex_sleeps++;
+        note_wakeup(sema);
+        if (limit > 0) {
+            uint32_t reduced = stats.spin_limit - stats.spin_limit / 4;
+            stats.spin_limit = reduced < MIN_SPIN ? MIN_SPIN : reduced;
         }
     }
     return 0;
 }
 
-int sema_post(uint32_t *val) {
-    __atomic_store_n(val, 1, __ATOMIC_SEQ_CST);
-    if (syscall(SYS_futex, val, FUTEX_WAKE, 1) == -1) {
+int sema_post(sema_t *sema) {
+    stats.posts++;
+    __atomic_store_n(&sema->posted_ns, now_ns(), __ATOMIC_RELEASE);
+    __atomic_store_n(&sema->val, 1, __ATOMIC_SEQ_CST);
+    // Skip the system call when nobody is asleep on the semaphore
+    if (__atomic_load_n(&sema->waiters, __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+    }
+    stats.futex_wakes++;
+    if (syscall(SYS_futex, &sema->val, FUTEX_WAKE, 1) == -1) {
         return -1;
     }
     return 0;
 }
+
+void sema_get_stats(sema_stats_t *out) {
+    *out = stats;
+    if (!spinning_useful()) {
+        out->spin_limit = 0;
+    }
+}
+
+void sema_add_stats(sema_stats_t *total, const sema_stats_t *s) {
+    total->waits += s->waits;
+    total->spin_hits += s->spin_hits;
+    total->futex_sleeps += s->futex_sleeps;
+    total->posts += s->posts;
+    total->futex_wakes += s->futex_wakes;
+    total->wake_latency_ns += s->wake_latency_ns;
+    if (s->max_wake_latency_ns > total->max_wake_latency_ns) {
+        total->max_wake_latency_ns = s->max_wake_latency_ns;
+    }
+    if (s->spin_limit > total->spin_limit) {
+        total->spin_limit = s->spin_limit;
+    }
+}
+
+void sema_print_stats(FILE *out, const char *who, const sema_stats_t *s) {
+    double avg_us = s->futex_sleeps ? s->wake_latency_ns / 1000.0 / s->futex_sleeps : 0.0;
+    fprintf(out, "%s: %llu waits (%llu spin hits, %llu futex sleeps), %llu posts "
+            "(%llu futex wakes), wakeup latency avg %.1f us max %.1f us, spin limit %u\n",
+            who, (unsigned long long) s->waits, (unsigned long long) s->spin_hits,
+            (unsigned long long) s->futex_sleeps, (unsigned long long) s->posts,
+            (unsigned long long) s->futex_wakes, avg_us, s->max_wake_latency_ns / 1000.0,
+            s->spin_limit);
+}
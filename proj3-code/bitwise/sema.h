@@ -2,9 +2,38 @@
 #define SEMA_H
 
 #include <stdint.h>
+#include <stdio.h>
 
-int sema_wait(uint32_t *val);
+// Binary semaphore shared between processes. Layout is identical in 32-bit
+// and 64-bit builds so the client and server can share it.
+typedef struct {
+    uint32_t val;           // Always either 0 or 1
+    uint32_t waiters;       // Number of waiters asleep (or about to sleep) in the kernel
+    uint64_t posted_ns __attribute__((aligned(8))); // Monotonic time of most recent post
+} sema_t;
 
-int sema_post(uint32_t *val);
+// Handoff counters, kept separately by each thread
+typedef struct {
+    uint64_t waits;             // Calls to sema_wait
+    uint64_t spin_hits;         // Waits satisfied while spinning
+    uint64_t futex_sleeps;      // Waits that had to sleep in the kernel
+    uint64_t posts;             // Calls to sema_post
+    uint64_t futex_wakes;       // Posts that had to wake a sleeper
+    uint64_t wake_latency_ns;   // Total time from post to sleeper resuming
+    uint64_t max_wake_latency_ns;
+    uint32_t spin_limit;        // Current adaptive spin budget, in iterations
+} sema_stats_t;
+
+int sema_wait(sema_t *sema);
+
+int sema_post(sema_t *sema);
+
+// Copy the calling thread's handoff counters into *stats
+void sema_get_stats(sema_stats_t *stats);
+
+// Add the counters in *stats to *total
+void sema_add_stats(sema_stats_t *total, const sema_stats_t *stats);
+
+void sema_print_stats(FILE *out, const char *who, const sema_stats_t *stats);
 
 #endif // SEMA_H
@@ -0,0 +1,721 @@
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits_test_batch.h"
+#include "golden.h"
+#include "rng.h"
+#include "testgen.h"
+#include "utils.h"
+
+/* Identifies the reference implementations, set by the Makefile from the
+   source checksum. Without it, golden files are rebuilt for every build. */
+#ifndef ORACLE_SOURCE_HASH
+#define ORACLE_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+// random_val - Return the i-th random integer value between min and max in a stream
+static int random_val(uint64_t stream, uint64_t i, int min, int max) {
+    return rng_range(stream, i, min, max);
+}
+
+/* Position in a value_gen_t's sequence */
+typedef struct {
+    const value_gen_t *gen;
+    unsigned i;                 /* group */
+    unsigned phase;             /* value within the group */
+} value_cursor_t;
+
+#define FLOAT_GROUP_SIZE 12
+#define FLOAT_SPECIALS 4
+#define SAMPLED_GROUP_SIZE 5
+
+static const unsigned float_specials[FLOAT_SPECIALS] = {
+    0x7f800000, /* inf */
+    0xff800000, /* -inf */
+    0x7fc00000, /* nan */
+    0xffc00000, /* -nan */
+};
+
+// clamp_interval - Restrict [lo, hi) to [0, limit), as unsigned bounds
+static void clamp_interval(int64_t lo, int64_t hi, unsigned limit, unsigned *lo_out, unsigned *hi_out) {
+    if (lo < 0) {
+        lo = 0;
+    }
+    if (hi > limit) {
+        hi = limit;
+    }
+    if (hi < lo) {
+        hi = lo;
+    }
+    *lo_out = lo;
+    *hi_out = hi;
+}
+
+// overlap - Number of i in [0, n) that are also in [lo, hi)
+static unsigned overlap(unsigned n, unsigned lo, unsigned hi) {
+    if (n <= lo) {
+        return 0;
+    }
+    return (n < hi ? n : hi) - lo;
+}
+
+// sampled_before - Number of values in GEN_SAMPLED groups 0 to i-1
+static uint64_t sampled_before(const value_gen_t *gen, unsigned i) {
+    return (uint64_t) 3 * i + overlap(i, gen->lo[0], gen->hi[0]) + overlap(i, gen->lo[1], gen->hi[1]);
+}
+
+// sampled_has - Does GEN_SAMPLED group i have a value in the given phase?
+static int sampled_has(const value_gen_t *gen, unsigned i, unsigned phase) {
+    if (phase == 2 || phase == 3) {
+        return i >= gen->lo[phase - 2] && i < gen->hi[phase - 2];
+    }
+    return 1;
+}
+
+// sampled_stream_id - Random values are drawn for a range rather than a
+// function, so that every function sampling the same range shares them
+static uint64_t sampled_stream_id(int min, int max, unsigned test_range) {
+    return rng_mix(((uint64_t) (uint32_t) min << 32 | (uint32_t) max) + test_range);
+}
+
+/* Stream of the pair strata, which every paired function shares */
+#define PAIR_STREAM_ID 0
+
+// init_gen - Set up the generator for a function's argument
+static void init_gen(value_gen_t *gen, int min, int max, int test_range, int arg_pos, int is_float,
+        const testgen_options_t *opts) {
+    *gen = (value_gen_t) {
+        .min = min,
+        .max = max,
+        .test_range = test_range,
+    };
+
+    /* Special case: If the user has specified a specific function
+       argument using the -1, -2, or -3 flags, then simply use this
+       argument */
+    if (opts->has_arg[arg_pos] != 0) {
+        gen->kind = GEN_FIXED;
+        gen->min = opts->argval[arg_pos];
+        gen->count = 1;
+        return;
+    }
+
+    /*
+     * Special case: Test floating point functions, where the input
+     * argument is an unsigned bit-level representation of a float,
+     * in the regions around zero, the smallest normalized and
+     * largest denormalized numbers, one, and the largest normalized
+     * number, as well as inf and nan. Test range should be at most
+     * 1/2 the range of one exponent value.
+     */
+    if (is_float) {
+        gen->kind = GEN_FLOAT;
+        if (gen->test_range > (1 << 23)) {
+            gen->test_range = 1 << 23;
+        }
+        gen->count = gen->test_range * FLOAT_GROUP_SIZE + FLOAT_SPECIALS;
+        return;
+    }
+
+    /* Normal case: integer functions. If the range is small enough,
+       then test it exhaustively */
+    if ((int64_t) max - MAX_TEST_VALS <= min) {
+        gen->kind = GEN_RANGE;
+        gen->count = (int64_t) max - min + 1;
+        return;
+    }
+
+    /* Otherwise, need to sample.  Do so near the boundaries, around
+       zero, and for some random cases. */
+    gen->kind = GEN_SAMPLED;
+    gen->stream = rng_stream(opts->seed, sampled_stream_id(min, max, gen->test_range));
+    clamp_interval(min, (int64_t) max + 1, gen->test_range, &gen->lo[0], &gen->hi[0]);
+    clamp_interval(-(int64_t) max, -(int64_t) min + 1, gen->test_range, &gen->lo[1], &gen->hi[1]);
+    gen->count = sampled_before(gen, gen->test_range);
+}
+
+// gen_seek - Point a cursor at the index-th value of a sequence
+static void gen_seek(value_cursor_t *cursor, const value_gen_t *gen, unsigned index) {
+    cursor->gen = gen;
+    switch (gen->kind) {
+        case GEN_FIXED:
+        case GEN_RANGE:
+            cursor->i = index;
+            cursor->phase = 0;
+            return;
+        case GEN_FLOAT:
+            cursor->i = index / FLOAT_GROUP_SIZE;
+            cursor->phase = index % FLOAT_GROUP_SIZE;
+            if (cursor->i >= gen->test_range) {
+                cursor->i = gen->test_range;
+                cursor->phase = index - gen->test_range * FLOAT_GROUP_SIZE;
+            }
+            return;
+        case GEN_SAMPLED: {
+            /* Groups have 3 to 5 values, find the last one starting at or before index */
+            unsigned lo = 0, hi = gen->test_range;
+            while (hi - lo > 1) {
+                unsigned mid = lo + (hi - lo) / 2;
+                if (sampled_before(gen, mid) <= index) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+            cursor->i = lo;
+            cursor->phase = 0;
+            for (uint64_t skip = index - sampled_before(gen, lo); ; cursor->phase++) {
+                if (sampled_has(gen, lo, cursor->phase) && skip-- == 0) {
+                    break;
+                }
+            }
+            return;
+        }
+    }
+}
+
+// gen_next - Return the value at the cursor and advance it
+static int gen_next(value_cursor_t *cursor) {
+    const value_gen_t *gen = cursor->gen;
+    unsigned i = cursor->i;
+    int value = 0;
+    switch (gen->kind) {
+        case GEN_FIXED:
+            cursor->i++;
+            return gen->min;
+
+        case GEN_RANGE:
+            cursor->i++;
+            return (int) ((int64_t) gen->min + i);
+
+        case GEN_FLOAT: {
+            unsigned smallest_norm = 0x00800000;
+            unsigned one = 0x3f800000;
+            unsigned largest_norm = 0x7f000000;
+            unsigned sign = 0x80000000;
+            if (i == gen->test_range) {
+                /* special vals */
+                value = float_specials[cursor->phase++];
+                return value;
+            }
+            switch (cursor->phase) {
+                /* Denorms around zero */
+                case 0: value = i; break;
+                case 1: value = sign | i; break;
+                /* Region around norm to denorm transition */
+                case 2: value = smallest_norm + i; break;
+                case 3: value = smallest_norm - i; break;
+                case 4: value = sign | (smallest_norm + i); break;
+                case 5: value = sign | (smallest_norm - i); break;
+                /* Region around one */
+                case 6: value = one + i; break;
+                case 7: value = one - i; break;
+                case 8: value = sign | (one + i); break;
+                case 9: value = sign | (one - i); break;
+                /* Region below largest norm */
+                case 10: value = largest_norm - i; break;
+                case 11: value = sign | (largest_norm - i); break;
+            }
+            if (++cursor->phase == FLOAT_GROUP_SIZE) {
+                cursor->i++;
+                cursor->phase = 0;
+            }
+            return value;
+        }
+
+        case GEN_SAMPLED:
+            switch (cursor->phase) {
+                /* Test around the boundaries */
+                case 0: value = gen->min + i; break;
+                case 1: value = gen->max - i; break;
+                /* Around zero, if zero falls between min and max */
+                case 2: value = i; break;
+                case 3: value = -i; break;
+                /* Random case between min and max */
+                case 4: value = random_val(gen->stream, i, gen->min, gen->max); break;
+            }
+            do {
+                if (++cursor->phase == SAMPLED_GROUP_SIZE) {
+                    cursor->i++;
+                    cursor->phase = 0;
+                }
+            } while (!sampled_has(gen, cursor->i, cursor->phase));
+            return value;
+    }
+    return value;
+}
+
+/* Share of the budget left after PAIRS_GRID that goes to each stratum */
+static const unsigned pair_weights[NUM_PAIR_STRATA] = {
+    [PAIRS_EQUAL] = 1,
+    [PAIRS_NEAR] = 2,
+    [PAIRS_EXTREMES] = 2,
+    [PAIRS_DIFF] = 2,
+    [PAIRS_BITS] = 2,
+    [PAIRS_SIGNS] = 3,
+    [PAIRS_RANDOM] = 4,
+};
+
+/* Values on either side of every boundary a bit-level implementation tends
+   to get wrong, filled in by init_pairs */
+#define MAX_SPECIAL_VALS 128
+static int special_vals[MAX_SPECIAL_VALS];
+static unsigned n_special_vals;
+
+// init_special_vals - Fill in special_vals, once
+static void init_special_vals(void) {
+    static const unsigned patterns[] = {
+        0, 1, 0xffffffff, 2, 0xfffffffe, 0x80000000, 0x80000001, 0x7fffffff, 0x7ffffffe,
+        0x55555555, 0xaaaaaaaa, 0x33333333, 0xcccccccc, 0x0f0f0f0f, 0xf0f0f0f0,
+        0x00ff00ff, 0xff00ff00, 0x0000ffff, 0xffff0000,
+    };
+    if (n_special_vals > 0) {
+        return;
+    }
+    for (unsigned i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        special_vals[n_special_vals++] = patterns[i];
+    }
+    for (unsigned b = 2; b < 31; b++) {
+        special_vals[n_special_vals++] = 1u << b;
+        special_vals[n_special_vals++] = -(1u << b);
+        special_vals[n_special_vals++] = (1u << b) - 1;
+    }
+    assert(n_special_vals <= MAX_SPECIAL_VALS);
+}
+
+// use_pairs - Should a two-argument function be tested with the pair strata?
+static int use_pairs(const value_gen_t gens[2]) {
+    for (int i = 0; i < 2; i++) {
+        if (gens[i].kind != GEN_SAMPLED || gens[i].min != INT_MIN || gens[i].max != INT_MAX) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// init_pairs - Split the pair budget of a function into strata
+static void init_pairs(pair_gen_t *pairs, uint64_t seed) {
+    init_special_vals();
+    pairs->stream = rng_stream(seed, PAIR_STREAM_ID);
+    unsigned grid = n_special_vals * n_special_vals;
+    unsigned rest = PAIR_BUDGET - grid;
+    unsigned total_weight = 0;
+    for (int s = 0; s < NUM_PAIR_STRATA; s++) {
+        total_weight += pair_weights[s];
+    }
+    pairs->start[0] = 0;
+    pairs->start[1] = grid;
+    for (int s = 1; s < NUM_PAIR_STRATA; s++) {
+        pairs->start[s + 1] = pairs->start[s] + (uint64_t) rest * pair_weights[s] / total_weight;
+    }
+}
+
+// weighted_val - An int drawn from r: a special value, one near INT_MIN,
+// INT_MAX or zero, or, half of the time, any int
+static int weighted_val(uint64_t r) {
+    unsigned low = r >> 32;
+    unsigned offset = low & 0xffff;
+    switch (r & 7) {
+        case 0:
+        case 1:
+            return special_vals[low % n_special_vals];
+        case 2: return INT_MIN + offset;
+        case 3: return INT_MAX - offset;
+        case 4: return offset;
+        case 5: return -offset;
+        default: return (int) low;
+    }
+}
+
+// pair_at - Write the arguments of case k
+static void pair_at(const pair_gen_t *pairs, uint64_t k, int *x_out, int *y_out) {
+    int s = 0;
+    while (k >= pairs->start[s + 1]) {
+        s++;
+    }
+    unsigned j = k - pairs->start[s];
+    if (s == PAIRS_GRID) {
+        *x_out = special_vals[j / n_special_vals];
+        *y_out = special_vals[j % n_special_vals];
+        return;
+    }
+
+    /* Three independent draws per case */
+    uint64_t r0 = rng_at(pairs->stream, k * 3);
+    uint64_t r1 = rng_at(pairs->stream, k * 3 + 1);
+    uint64_t r2 = rng_at(pairs->stream, k * 3 + 2);
+    unsigned x = weighted_val(r0), y = 0;
+    switch (s) {
+        case PAIRS_EQUAL:
+            y = x;
+            break;
+        case PAIRS_NEAR: {
+            unsigned d = (r1 & 3) + 1;
+            y = r1 & 4 ? x + d : x - d;
+            break;
+        }
+        case PAIRS_EXTREMES: {
+            unsigned a = r1 & 0xffff, b = (r1 >> 16) & 0xffff;
+            if (r1 & (1ull << 32)) {
+                x = INT_MIN + a;
+                y = INT_MAX - b;
+            } else {
+                x = -a - 1;
+                y = b;
+            }
+            break;
+        }
+        case PAIRS_DIFF: {
+            unsigned d = 1u << (r1 & 31);
+            switch ((r1 >> 5) % 3) {
+                case 0: break;
+                case 1: d -= 1; break;
+                case 2: d += 1; break;
+            }
+            y = r1 & (1u << 7) ? x + d : x - d;
+            break;
+        }
+        case PAIRS_BITS: {
+            unsigned mask = r2 >> 32;
+            switch (r1 & 3) {
+                case 0: y = ~x; break;
+                case 1: y = x ^ (1u << ((r1 >> 2) & 31)); break;
+                case 2: y = x & mask; break;
+                case 3: y = x | mask; break;
+            }
+            break;
+        }
+        case PAIRS_SIGNS:
+            x = (r1 & 0x7fffffff) | (j & 1 ? 0x80000000 : 0);
+            y = ((r1 >> 32) & 0x7fffffff) | (j & 2 ? 0x80000000 : 0);
+            break;
+        case PAIRS_RANDOM:
+            x = r1;
+            y = r1 >> 32;
+            break;
+    }
+    /* The strata are symmetric in x and y */
+    if (r2 & 1) {
+        unsigned t = x;
+        x = y;
+        y = t;
+    }
+    *x_out = x;
+    *y_out = y;
+}
+
+/* Argument vectors generated so far, kept for the life of the process. Most
+   puzzles share an argument range, so each distinct sequence is generated once
+   and then read by every function and thread that uses it. */
+#define MAX_CACHED_VECTORS 16
+
+typedef struct {
+    int kind, min, max;         /* key: the generator's parameters, seed included */
+    unsigned test_range;
+    uint64_t stream;
+    int *values;
+} cached_vector_t;
+
+static cached_vector_t vector_cache[MAX_CACHED_VECTORS];
+static unsigned n_cached_vectors;
+
+typedef struct {
+    uint64_t stream;            /* key: the pair strata only depend on the seed */
+    int *values;
+} cached_pairs_t;
+
+static cached_pairs_t pair_cache[MAX_CACHED_VECTORS];
+static unsigned n_cached_pairs;
+
+// cached_values - Every value of gen's sequence, generating it if no earlier
+// generator had the same parameters. Returns NULL if it isn't worth caching or
+// there's no room, in which case values are computed as they're needed.
+static const int *cached_values(const value_gen_t *gen) {
+    if (gen->kind == GEN_FIXED) {
+        return NULL;
+    }
+    for (unsigned i = 0; i < n_cached_vectors; i++) {
+        cached_vector_t *c = &vector_cache[i];
+        if (c->kind == gen->kind && c->min == gen->min && c->max == gen->max &&
+                c->test_range == gen->test_range && c->stream == gen->stream) {
+            return c->values;
+        }
+    }
+    if (n_cached_vectors == MAX_CACHED_VECTORS) {
+        return NULL;
+    }
+    int *values = malloc((size_t) gen->count * sizeof(int));
+    if (values == NULL) {
+        return NULL;
+    }
+    value_cursor_t cursor;
+    gen_seek(&cursor, gen, 0);
+    for (unsigned i = 0; i < gen->count; i++) {
+        values[i] = gen_next(&cursor);
+    }
+    vector_cache[n_cached_vectors++] = (cached_vector_t) {
+        .kind = gen->kind,
+        .min = gen->min,
+        .max = gen->max,
+        .test_range = gen->test_range,
+        .stream = gen->stream,
+        .values = values,
+    };
+    return values;
+}
+
+// cached_pairs - Both arguments of every case of the pair strata, x then y,
+// generated once per seed. Returns NULL under the same conditions as cached_values().
+static const int *cached_pairs(const pair_gen_t *pairs) {
+    for (unsigned i = 0; i < n_cached_pairs; i++) {
+        if (pair_cache[i].stream == pairs->stream) {
+            return pair_cache[i].values;
+        }
+    }
+    if (n_cached_pairs == MAX_CACHED_VECTORS) {
+        return NULL;
+    }
+    unsigned n = pairs->start[NUM_PAIR_STRATA];
+    int *values = malloc((size_t) n * 2 * sizeof(int));
+    if (values == NULL) {
+        return NULL;
+    }
+    for (unsigned k = 0; k < n; k++) {
+        pair_at(pairs, k, &values[2 * k], &values[2 * k + 1]);
+    }
+    pair_cache[n_cached_pairs++] = (cached_pairs_t) {
+        .stream = pairs->stream,
+        .values = values,
+    };
+    return values;
+}
+
+void testgen_init(test_vectors_t *vec, enum function_id func, const testgen_options_t *opts) {
+    *vec = (test_vectors_t) {
+        .func = func,
+        .num_args = getNumArgs(func),
+    };
+    unsigned num_args = vec->num_args;
+
+    int arg_test_range[2] = {}; /* test range for each argument */
+
+    /* Assign range of argument test vals so as to conserve the total
+       number of tests, independent of the number of arguments */
+    if (num_args == 0) {
+        arg_test_range[0] = 0;
+    } else if (num_args == 1) {
+        arg_test_range[0] = TEST_RANGE;
+    }
+    else {
+        assert(num_args == 2);
+        arg_test_range[0] = pow((double)TEST_RANGE, 0.5);  /* sqrt */
+        arg_test_range[1] = arg_test_range[0];
+    }
+
+    /* Sanity check on the ranges */
+    if (arg_test_range[0] < 1) {
+        arg_test_range[0] = 1;
+    }
+    if (arg_test_range[1] < 1) {
+        arg_test_range[1] = 1;
+    }
+
+    if (num_args == 0) {
+        vec->total_cases = 1;
+    } else if (opts->exhaustive && num_args == 1 && !opts->has_arg[0]) {
+        /* Exhaustive mode (-x) covers the entire input space of single-argument
+           functions, unless the user pinned the argument with -1 */
+        vec->exhaustive = 1;
+        vec->total_cases = EXHAUSTIVE_SPACE;
+    } else {
+        /* Set up the test values for each argument. Random values come from a stream
+           per range, so a function's tests are the same whichever functions run. */
+        for (int i = 0; i < num_args; i++) {
+            int is_float;
+            switch (func) {
+                case FLOAT_ABS_VAL:
+                case FLOAT_SCALE_4:
+                    is_float = 1;
+                    break;
+                default:
+                    is_float = 0;
+            }
+            init_gen(&vec->gens[i], getFuncMinArg(func, i+1), getFuncMaxArg(func, i+1),
+                    arg_test_range[i], i, is_float, opts);
+            vec->gens[i].values = cached_values(&vec->gens[i]);
+            vec->test_counts[i] = vec->gens[i].count;
+        }
+        vec->total_cases = vec->test_counts[0];
+        if (num_args == 2 && use_pairs(vec->gens)) {
+            /* Both arguments range over every int: a fixed budget of pairs
+               finds more than the product of the two sequences */
+            vec->paired = 1;
+            init_pairs(&vec->pairs, opts->seed);
+            vec->total_cases = vec->pairs.start[NUM_PAIR_STRATA];
+            vec->pairs.values = cached_pairs(&vec->pairs);
+        } else if (num_args == 2) {
+            vec->total_cases *= vec->test_counts[1];
+        }
+    }
+}
+
+void testgen_fill(const test_vectors_t *vec, int *elems, uint64_t start, unsigned count) {
+    // A cached function's vectors aren't set up, and its only batch is empty
+    if (count == 0) {
+        return;
+    }
+    unsigned num_args = vec->num_args;
+    // Each test case takes up num_args + 1 int slots in memory
+    unsigned stride = num_args + 1;
+    if (vec->exhaustive) {
+        for (unsigned i = 0; i < count; i++) {
+            elems[i * stride] = (int) (uint32_t) (start + i);
+        }
+    } else if (vec->paired && vec->pairs.values != NULL) {
+        const int *pair = &vec->pairs.values[2 * start];
+        for (unsigned i = 0; i < count; i++) {
+            elems[i * stride] = pair[2 * i];
+            elems[i * stride + 1] = pair[2 * i + 1];
+        }
+    } else if (vec->paired) {
+        for (unsigned i = 0; i < count; i++) {
+            pair_at(&vec->pairs, start + i, &elems[i * stride], &elems[i * stride + 1]);
+        }
+    } else if (num_args == 1 && vec->gens[0].values != NULL) {
+        const int *values = &vec->gens[0].values[start];
+        for (unsigned i = 0; i < count; i++) {
+            elems[i * stride] = values[i];
+        }
+    } else if (num_args == 1) {
+        value_cursor_t cursor;
+        gen_seek(&cursor, &vec->gens[0], start);
+        for (unsigned i = 0; i < count; i++) {
+            elems[i * stride] = gen_next(&cursor);
+        }
+    } else if (num_args == 2 && vec->gens[0].values != NULL && vec->gens[1].values != NULL) {
+        unsigned n1 = vec->test_counts[1];
+        unsigned x = start / n1, j = start % n1;
+        for (unsigned i = 0; i < count; i++, j++) {
+            if (j == n1) {
+                x++;
+                j = 0;
+            }
+            elems[i * stride] = vec->gens[0].values[x];
+            elems[i * stride + 1] = vec->gens[1].values[j];
+        }
+    } else if (num_args == 2) {
+        unsigned n1 = vec->test_counts[1];
+        unsigned j = start % n1;
+        value_cursor_t outer, inner;
+        gen_seek(&outer, &vec->gens[0], start / n1);
+        gen_seek(&inner, &vec->gens[1], j);
+        int x = gen_next(&outer);
+        for (unsigned i = 0; i < count; i++, j++) {
+            if (j == n1) {
+                x = gen_next(&outer);
+                gen_seek(&inner, &vec->gens[1], 0);
+                j = 0;
+            }
+            elems[i * stride] = x;
+            elems[i * stride + 1] = gen_next(&inner);
+        }
+    }
+}
+
+/* Batch reference implementations, by number of arguments. The float
+   versions take unsigned bit patterns, which have the same representation. */
+typedef void (*oracle0_t)(int *out, size_t len);
+typedef void (*oracle1_t)(const int *x, int *out, size_t len);
+typedef void (*oracle2_t)(const int *x, const int *y, int *out, size_t len);
+
+static void floatAbsVal_oracle(const int *uf, int *out, size_t len) {
+    test_floatAbsVal_batch((const unsigned *) uf, (unsigned *) out, len);
+}
+
+static void floatScale4_oracle(const int *uf, int *out, size_t len) {
+    test_floatScale4_batch((const unsigned *) uf, (unsigned *) out, len);
+}
+
+static const struct {
+    oracle0_t zero;
+    oracle1_t one;
+    oracle2_t two;
+} oracles[NUM_PUZZLES] = {
+    [BIT_MATCH] = { .two = test_bitMatch_batch },
+    [EVEN_BITS] = { .zero = test_evenBits_batch },
+    [ALL_ODD_BITS] = { .one = test_allOddBits_batch },
+    [FLOAT_ABS_VAL] = { .one = floatAbsVal_oracle },
+    [IMPLICATION] = { .two = test_implication_batch },
+    [IS_NEGATIVE] = { .one = test_isNegative_batch },
+    [SIGN] = { .one = test_sign_batch },
+    [IS_GREATER] = { .two = test_isGreater_batch },
+    [LOGICAL_SHIFT] = { .two = test_logicalShift_batch },
+    [ROTATE_RIGHT] = { .two = test_rotateRight_batch },
+    [FLOAT_SCALE_4] = { .one = floatScale4_oracle },
+    [GREATEST_BIT_POS] = { .one = test_greatestBitPos_batch },
+};
+
+void testgen_oracle(enum function_id func, unsigned num_args, const int *elems, unsigned len,
+        int *arg1, int *arg2, int *expected) {
+    switch (num_args) {
+        case 0:
+            oracles[func].zero(expected, len);
+            break;
+        case 1:
+            for (unsigned i = 0; i < len; i++) {
+                arg1[i] = elems[2 * i];
+            }
+            oracles[func].one(arg1, expected, len);
+            break;
+        case 2:
+            for (unsigned i = 0; i < len; i++) {
+                arg1[i] = elems[3 * i];
+                arg2[i] = elems[3 * i + 1];
+            }
+            oracles[func].two(arg1, arg2, expected, len);
+            break;
+    }
+}
+
+void testgen_expected(const test_vectors_t *vec, const int *elems, unsigned count, int *out) {
+    int arg1[VALIDATE_CHUNK];
+    int arg2[VALIDATE_CHUNK];
+    unsigned stride = vec->num_args + 1;
+    for (unsigned i = 0; i < count; i += VALIDATE_CHUNK) {
+        unsigned n = count - i < VALIDATE_CHUNK ? count - i : VALIDATE_CHUNK;
+        testgen_oracle(vec->func, vec->num_args, elems + i * stride, n, arg1, arg2, out + i);
+    }
+}
+
+void testgen_fill_golden(void *ctx, int *out, uint64_t start, unsigned count) {
+    const test_vectors_t *vec = ctx;
+    static int elems[MAX_BATCH_CASES * MAX_CASE_INTS];
+
+    for (unsigned base = 0; base < count; base += MAX_BATCH_CASES) {
+        unsigned len = count - base < MAX_BATCH_CASES ? count - base : MAX_BATCH_CASES;
+        testgen_fill(vec, elems, start + base, len);
+        testgen_expected(vec, elems, len, out + base);
+    }
+}
+
+// The vectors are fully determined by the generators' parameters and the code,
+// which ORACLE_SOURCE_HASH covers, so any change to how they are generated
+// forces a rebuild
+uint64_t testgen_golden_key(const test_vectors_t *vec) {
+    char params[256];
+    snprintf(params, sizeof(params), "%s|%d|%d|%u|%u|%u|%d|%d|%s", getFuncName(vec->func),
+            TEST_RANGE, MAX_TEST_VALS, vec->num_args, vec->test_counts[0], vec->test_counts[1],
+            vec->paired, PAIR_BUDGET, ORACLE_SOURCE_HASH);
+    uint64_t key = golden_hash(GOLDEN_HASH_INIT, params, strlen(params));
+    for (unsigned i = 0; i < vec->num_args; i++) {
+        const value_gen_t *gen = &vec->gens[i];
+        int64_t gen_params[] = {gen->kind, gen->min, gen->max, gen->test_range, gen->count,
+            (int64_t) gen->stream};
+        key = golden_hash(key, gen_params, sizeof(gen_params));
+    }
+    return key;
+}
@@ -0,0 +1,128 @@
+#ifndef TESTGEN_H
+#define TESTGEN_H
+
+#include <stdint.h>
+
+#include "dl_protocol.h"
+
+// Test vectors and expected outputs for each puzzle, shared by btest_server
+// and bgrade so that both test exactly the same cases. A function's cases are
+// numbered 0..total_cases-1, and any case is computed from its number alone.
+
+// For functions with a single argument, generate TEST_RANGE values above and
+// below the min and max test values, and above and below zero. Functions with
+// two args use the square root of this value, to avoid combinatorial explosion.
+#define TEST_RANGE 500000
+
+// Integer arguments whose range has at most this many values are tested on
+// every value rather than sampled
+#define MAX_TEST_VALS 13*TEST_RANGE
+
+// In exhaustive mode (-x), every input to a single-argument function is a case
+#define EXHAUSTIVE_SPACE (1ULL << 32)
+
+// Expected outputs are computed this many test cases at a time
+#define VALIDATE_CHUNK 1024
+
+// The test values for one argument. Each is computed from its position, so
+// any thread can start anywhere in the sequence. The values are produced in
+// groups, one for each i from 0 to test_range - 1, plus a final group of
+// special values for floats. Whole sequences are also generated once per
+// process and shared by every function whose generator has the same
+// parameters, so batches are usually copied from there instead.
+typedef struct {
+    enum {
+        GEN_FIXED,      // The single value given with -1 or -2
+        GEN_RANGE,      // Every value from min to max
+        GEN_FLOAT,      // Bit patterns around float boundaries
+        GEN_SAMPLED,    // Values around min, max and zero, plus random ones
+    } kind;
+    int min, max;
+    unsigned test_range;
+    unsigned count;             // Number of values in the sequence
+    uint64_t stream;            // Random values (GEN_SAMPLED)
+    // GEN_SAMPLED groups also hold i if lo[0] <= i < hi[0], and -i if
+    // lo[1] <= i < hi[1], so that both are between min and max
+    unsigned lo[2], hi[2];
+    const int *values;          // The whole sequence, or NULL if it wasn't cached
+} value_gen_t;
+
+// Two-argument puzzles over the whole int range (bitMatch, isGreater) are
+// tested on a fixed budget of pairs rather than the product of two sampled
+// sequences, most of which exercise nothing new. The budget is split into
+// strata that each aim at one relation between x and y, in order of how
+// likely they are to expose a bug, so that claiming batches in case order
+// spreads the strata across the workers.
+#define PAIR_BUDGET (4 * TEST_RANGE)
+
+enum pair_stratum {
+    PAIRS_GRID,         // Every pair of special values
+    PAIRS_EQUAL,        // x == y
+    PAIRS_NEAR,         // y = x +/- 1..4, wrapping around
+    PAIRS_EXTREMES,     // Opposite signs, near INT_MIN/INT_MAX or around zero
+    PAIRS_DIFF,         // y = x +/- 2^k, 2^k - 1 or 2^k + 1
+    PAIRS_BITS,         // y = ~x, x with one bit flipped, or x under a random mask
+    PAIRS_SIGNS,        // Random pairs, evenly over the four sign combinations
+    PAIRS_RANDOM,       // Uniformly random pairs
+    NUM_PAIR_STRATA
+};
+
+typedef struct {
+    uint64_t stream;
+    unsigned start[NUM_PAIR_STRATA + 1];    // First case of each stratum
+    const int *values;          // x and y of every case, or NULL if they weren't cached
+} pair_gen_t;
+
+// Options that change which cases a function is tested on
+typedef struct {
+    uint64_t seed;              // Seed for random test values (-s)
+    int exhaustive;             // Test single-argument functions on every input (-x)
+    int has_arg[2];             // Arguments pinned with -1 and -2
+    unsigned argval[2];
+} testgen_options_t;
+
+// Every test case of one function
+typedef struct {
+    enum function_id func;
+    unsigned num_args;
+    int exhaustive;             // Case k is the input k itself (-x)
+    value_gen_t gens[2];        // Test values for each arg
+    int paired;                 // Case k is from the pair strata
+    pair_gen_t pairs;
+    unsigned test_counts[2];    // Number of values for each arg
+    uint64_t total_cases;
+} test_vectors_t;
+
+// Set up the test cases of func, generating any argument vectors it doesn't
+// share with a function set up earlier. Not thread-safe, but the resulting
+// vectors can be read by any number of threads.
+void testgen_init(test_vectors_t *vec, enum function_id func, const testgen_options_t *opts);
+
+/*
+ * Write the arguments of cases start..start+count-1 laid out as in a batch,
+ * num_args + 1 ints per case. Case k of a two-argument function pairs value
+ * k / n1 of the first argument with value k % n1 of the second, where n1 is
+ * the second argument's count, unless the function uses the pair strata.
+ */
+void testgen_fill(const test_vectors_t *vec, int *elems, uint64_t start, unsigned count);
+
+// Identify the test vectors and reference implementations behind a function's
+// golden data (see golden.h)
+uint64_t testgen_golden_key(const test_vectors_t *vec);
+
+/*
+ * Run the batch reference implementation for func over len (at most
+ * VALIDATE_CHUNK) test cases laid out as in a batch. Leaves the arguments in
+ * arg1/arg2 and the expected outputs in expected.
+ */
+void testgen_oracle(enum function_id func, unsigned num_args, const int *elems, unsigned len,
+        int *arg1, int *arg2, int *expected);
+
+// Expected output of each of count cases laid out as in a batch
+void testgen_expected(const test_vectors_t *vec, const int *elems, unsigned count, int *out);
+
+// Compute expected outputs for golden data, a golden_fill_t with a
+// test_vectors_t as its context. Not reentrant.
+void testgen_fill_golden(void *ctx, int *out, uint64_t start, unsigned count);
+
+#endif // TESTGEN_H
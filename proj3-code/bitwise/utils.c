@@ -1,4 +1,5 @@
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "dl_protocol.h"
@@ -268,3 +269,99 @@ int getFuncMaxArg(enum function_id id, int arg_pos) {
             return -1;
     }
 }
+
+// Sign class of an integer argument: 0 negative, 1 zero, 2 positive
+static unsigned signClass(int x) {
+    return x < 0 ? 0 : (x == 0 ? 1 : 2);
+}
+
+// Exponent class of a float's bit pattern, split by sign:
+// zero, denormalized, normalized, infinity, NaN
+static unsigned floatClass(unsigned uf) {
+    unsigned exp = (uf >> 23) & 0xFF;
+    unsigned frac = uf & 0x7FFFFF;
+    unsigned kind;
+    if (exp == 0) {
+        kind = frac == 0 ? 0 : 1;
+    } else if (exp == 0xFF) {
+        kind = frac == 0 ? 3 : 4;
+    } else {
+        kind = 2;
+    }
+    return (uf >> 31) * 5 + kind;
+}
+
+unsigned getFailureClass(enum function_id id, int arg1, int arg2) {
+    switch (id) {
+        case FLOAT_ABS_VAL:
+        case FLOAT_SCALE_4:
+            return floatClass(arg1);
+
+        case LOGICAL_SHIFT:
+        case ROTATE_RIGHT:
+            // The shift amount
+            return arg2 & 31;
+
+        case GREATEST_BIT_POS:
+            // Position of the highest set bit, or 32 for 0
+            return arg1 == 0 ? 32 : 31 - __builtin_clz(arg1);
+
+        case BIT_MATCH:
+        case IMPLICATION:
+        case IS_GREATER:
+            return signClass(arg1) * 3 + signClass(arg2);
+
+        case ALL_ODD_BITS:
+        case IS_NEGATIVE:
+        case SIGN:
+            return signClass(arg1);
+
+        case EVEN_BITS:
+            return 0;
+    }
+
+    // Not reached
+    return 0;
+}
+
+void getFailureClassName(enum function_id id, unsigned failure_class, char *buf, size_t size) {
+    static const char *const signs[] = {"< 0", "= 0", "> 0"};
+    static const char *const floats[] = {"zero", "denormalized", "normalized", "infinity", "NaN"};
+
+    switch (id) {
+        case FLOAT_ABS_VAL:
+        case FLOAT_SCALE_4:
+            snprintf(buf, size, "%s %s", failure_class >= 5 ? "negative" : "positive",
+                    floats[failure_class % 5]);
+            return;
+
+        case LOGICAL_SHIFT:
+        case ROTATE_RIGHT:
+            snprintf(buf, size, "n = %u", failure_class);
+            return;
+
+        case GREATEST_BIT_POS:
+            if (failure_class == 32) {
+                snprintf(buf, size, "x = 0");
+            } else {
+                snprintf(buf, size, "highest set bit %u", failure_class);
+            }
+            return;
+
+        case BIT_MATCH:
+        case IMPLICATION:
+        case IS_GREATER:
+            snprintf(buf, size, "x %s, y %s", signs[failure_class / 3], signs[failure_class % 3]);
+            return;
+
+        case ALL_ODD_BITS:
+        case IS_NEGATIVE:
+        case SIGN:
+            snprintf(buf, size, "x %s", signs[failure_class]);
+            return;
+
+        case EVEN_BITS:
+            snprintf(buf, size, "no arguments");
+            return;
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+
 // Features code from Randy Bryant and Dave O'Halloran's original "Data Lab"
 
 /*
@@ -22,4 +24,11 @@ int getFuncMaxArg(enum function_id id, int arg_pos);
 
 enum function_id getFuncId(const char *name);
 
+// Failing inputs are grouped into classes that tend to share a cause: the
+// exponent class of a float, the signs of integer arguments, or the bit
+// position involved. Classes are numbered from 0 to MAX_FAILURE_CLASSES - 1.
+unsigned getFailureClass(enum function_id id, int arg1, int arg2);
+
+void getFailureClassName(enum function_id id, unsigned failure_class, char *buf, size_t size);
+
 #endif // UTILS_H
@@ -0,0 +1,728 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "x86_parse.h"
+
+#define MAX_LINE_LEN 512
+
+static const char *const reg_names[4][X86_NUM_REGS] = {
+    { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+      "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+    { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+      "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+    { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+      "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+    { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+      "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+static const char *const high8_names[4] = { "ah", "ch", "dh", "bh" };
+
+static const struct {
+    const char *name;
+    enum x86_cond cond;
+} cond_names[] = {
+    { "o", CC_O }, { "no", CC_NO },
+    { "b", CC_B }, { "c", CC_B }, { "nae", CC_B },
+    { "ae", CC_AE }, { "nb", CC_AE }, { "nc", CC_AE },
+    { "e", CC_E }, { "z", CC_E }, { "ne", CC_NE }, { "nz", CC_NE },
+    { "be", CC_BE }, { "na", CC_BE }, { "a", CC_A }, { "nbe", CC_A },
+    { "s", CC_S }, { "ns", CC_NS },
+    { "l", CC_L }, { "nge", CC_L }, { "ge", CC_GE }, { "nl", CC_GE },
+    { "le", CC_LE }, { "ng", CC_LE }, { "g", CC_G }, { "nle", CC_G },
+};
+
+// Mnemonics that take an optional b/w/l/q size suffix
+static const struct {
+    const char *name;
+    enum x86_op op;
+    unsigned n_operands;
+} sized_ops[] = {
+    { "mov", OP_MOV, 2 }, { "lea", OP_LEA, 2 },
+    { "add", OP_ADD, 2 }, { "sub", OP_SUB, 2 }, { "and", OP_AND, 2 }, { "or", OP_OR, 2 },
+    { "xor", OP_XOR, 2 }, { "cmp", OP_CMP, 2 }, { "test", OP_TEST, 2 },
+    { "not", OP_NOT, 1 }, { "neg", OP_NEG, 1 }, { "inc", OP_INC, 1 }, { "dec", OP_DEC, 1 },
+    { "shl", OP_SHL, 2 }, { "sal", OP_SHL, 2 }, { "shr", OP_SHR, 2 }, { "sar", OP_SAR, 2 },
+    { "rol", OP_ROL, 2 }, { "ror", OP_ROR, 2 }, { "bt", OP_BT, 2 },
+    { "imul", OP_IMUL, 2 }, { "xchg", OP_XCHG, 2 },
+    { "push", OP_PUSH, 1 }, { "pop", OP_POP, 1 },
+};
+
+// Sign extensions of %rax, whose size is part of the name. gas takes the
+// Intel names too.
+static const struct {
+    const char *name;
+    enum x86_op op;
+    int width;
+} extend_ops[] = {
+    { "cbtw", OP_CLTQ, 2 }, { "cwtl", OP_CLTQ, 4 }, { "cltq", OP_CLTQ, 8 },
+    { "cbw", OP_CLTQ, 2 }, { "cwde", OP_CLTQ, 4 }, { "cdqe", OP_CLTQ, 8 },
+    { "cwtd", OP_CLTD, 2 }, { "cltd", OP_CLTD, 4 }, { "cqto", OP_CLTD, 8 },
+    { "cwd", OP_CLTD, 2 }, { "cdq", OP_CLTD, 4 }, { "cqo", OP_CLTD, 8 },
+};
+
+// Prefixes the lenient parser skips over to reach the instruction
+static const char *const prefixes[] = {
+    "rep", "repe", "repz", "repne", "repnz", "lock", "notrack", "bnd", "data16",
+};
+
+const char *x86_reg_name(enum x86_reg reg, int width, int high8) {
+    if (reg < 0 || reg >= X86_NUM_REGS) {
+        return "?";
+    }
+    if (high8) {
+        return high8_names[reg];
+    }
+    switch (width) {
+        case 1: return reg_names[0][reg];
+        case 2: return reg_names[1][reg];
+        case 4: return reg_names[2][reg];
+        default: return reg_names[3][reg];
+    }
+}
+
+// suffix_width - Operand size given by a mnemonic suffix, 0 if c isn't one
+static int suffix_width(char c) {
+    switch (c) {
+        case 'b': return 1;
+        case 'w': return 2;
+        case 'l': return 4;
+        case 'q': return 8;
+    }
+    return 0;
+}
+
+// parse_cond - Look up a condition code suffix. Returns 0 on success.
+static int parse_cond(const char *s, enum x86_cond *cond) {
+    for (unsigned i = 0; i < sizeof(cond_names) / sizeof(cond_names[0]); i++) {
+        if (strcmp(s, cond_names[i].name) == 0) {
+            *cond = cond_names[i].cond;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// parse_cond_sized - A condition code, optionally followed by a size suffix
+static int parse_cond_sized(const char *s, enum x86_cond *cond, int *width) {
+    if (parse_cond(s, cond) == 0) {
+        return 0;
+    }
+    size_t len = strlen(s);
+    char cc[8];
+    if (len < 2 || len > sizeof(cc) || suffix_width(s[len - 1]) == 0) {
+        return -1;
+    }
+    memcpy(cc, s, len - 1);
+    cc[len - 1] = '\0';
+    *width = suffix_width(s[len - 1]);
+    return parse_cond(cc, cond);
+}
+
+// parse_mnemonic - Set the operation, condition and size of an instruction,
+// and the number of operands it expects. Returns 0 on success.
+static int parse_mnemonic(const char *m, x86_insn_t *insn, unsigned *n_operands) {
+    insn->width = 0;
+    if (strcmp(m, "ret") == 0 || strcmp(m, "retq") == 0) {
+        insn->op = OP_RET;
+        *n_operands = 0;
+        return 0;
+    }
+    if (strcmp(m, "nop") == 0) {
+        insn->op = OP_NOP;
+        *n_operands = 0;
+        return 0;
+    }
+    if (strcmp(m, "jmp") == 0 || strcmp(m, "jmpq") == 0) {
+        insn->op = OP_JMP;
+        *n_operands = 1;
+        return 0;
+    }
+    if (m[0] == 'j' && parse_cond(m + 1, &insn->cond) == 0) {
+        insn->op = OP_JCC;
+        *n_operands = 1;
+        return 0;
+    }
+    if (strncmp(m, "set", 3) == 0 && parse_cond_sized(m + 3, &insn->cond, &insn->width) == 0) {
+        insn->op = OP_SETCC;
+        insn->width = 1;
+        *n_operands = 1;
+        return 0;
+    }
+    if (strncmp(m, "cmov", 4) == 0 && parse_cond_sized(m + 4, &insn->cond, &insn->width) == 0) {
+        insn->op = OP_CMOVCC;
+        *n_operands = 2;
+        return 0;
+    }
+    for (unsigned i = 0; i < sizeof(extend_ops) / sizeof(extend_ops[0]); i++) {
+        if (strcmp(m, extend_ops[i].name) == 0) {
+            insn->op = extend_ops[i].op;
+            insn->width = extend_ops[i].width;
+            *n_operands = 0;
+            return 0;
+        }
+    }
+    if ((strncmp(m, "movz", 4) == 0 || strncmp(m, "movs", 4) == 0) && strlen(m) == 6) {
+        insn->src_width = suffix_width(m[4]);
+        insn->width = suffix_width(m[5]);
+        if (insn->src_width != 0 && insn->width > insn->src_width) {
+            insn->op = m[3] == 'z' ? OP_MOVZ : OP_MOVS;
+            *n_operands = 2;
+            return 0;
+        }
+    }
+    size_t len = strlen(m);
+    for (unsigned i = 0; i < sizeof(sized_ops) / sizeof(sized_ops[0]); i++) {
+        size_t name_len = strlen(sized_ops[i].name);
+        if (strncmp(m, sized_ops[i].name, name_len) != 0) {
+            continue;
+        }
+        if (len == name_len || (len == name_len + 1 && suffix_width(m[name_len]) != 0)) {
+            insn->op = sized_ops[i].op;
+            insn->width = len == name_len ? 0 : suffix_width(m[name_len]);
+            *n_operands = sized_ops[i].n_operands;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// parse_reg - Parse a register name without the %. Returns 0 on success.
+static int parse_reg(const char *s, x86_operand_t *opnd) {
+    for (int w = 0; w < 4; w++) {
+        for (int r = 0; r < X86_NUM_REGS; r++) {
+            if (strcmp(s, reg_names[w][r]) == 0) {
+                opnd->reg = r;
+                opnd->width = 1 << w;
+                opnd->high8 = 0;
+                return 0;
+            }
+        }
+    }
+    for (int r = 0; r < 4; r++) {
+        if (strcmp(s, high8_names[r]) == 0) {
+            opnd->reg = r;
+            opnd->width = 1;
+            opnd->high8 = 1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// parse_number - Parse a decimal or hex integer, which may be negative or
+// written as a large unsigned value. Returns 0 if all of s was used.
+static int parse_number(const char *s, int64_t *value) {
+    char *end;
+    if (*s == '\0') {
+        return -1;
+    }
+    if (*s == '-') {
+        *value = strtoll(s, &end, 0);
+    } else {
+        *value = (int64_t) strtoull(s, &end, 0);
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+// is_label_char - Can c appear in a label name?
+static int is_label_char(char c) {
+    return isalnum((unsigned char) c) || c == '_' || c == '.' || c == '$';
+}
+
+// is_symbol - Whether s is a label, possibly with an offset, as in .LC0+4
+static int is_symbol(const char *s) {
+    if (!is_label_char(*s)) {
+        return 0;
+    }
+    while (is_label_char(*s) || *s == '+' || *s == '-') {
+        s++;
+    }
+    return *s == '\0';
+}
+
+// parse_any_reg - Parse a register name without the %, leniently: one that
+// isn't a general purpose register, such as rip, xmm0 or st(1), is REG_NONE
+static int parse_any_reg(const char *s, x86_operand_t *opnd) {
+    if (parse_reg(s, opnd) == 0) {
+        return 0;
+    }
+    if (!isalpha((unsigned char) *s)) {
+        return -1;
+    }
+    for (const char *p = s; *p != '\0'; p++) {
+        if (!isalnum((unsigned char) *p) && *p != '(' && *p != ')') {
+            return -1;
+        }
+    }
+    opnd->reg = REG_NONE;
+    opnd->width = 0;
+    opnd->high8 = 0;
+    return 0;
+}
+
+// parse_mem - Parse disp(base,index,scale). Returns 0 on success.
+static int parse_mem(char *s, x86_operand_t *opnd, int lenient) {
+    char *open = strchr(s, '(');
+    char *close = strrchr(s, ')');
+    if (open == NULL || close == NULL || close[1] != '\0') {
+        return -1;
+    }
+    opnd->kind = OPND_MEM;
+    opnd->base = opnd->index = REG_NONE;
+    opnd->scale = 1;
+    opnd->imm = 0;
+    *open = *close = '\0';
+    if (*s != '\0' && parse_number(s, &opnd->imm) != 0 && !(lenient && is_symbol(s))) {
+        return -1;
+    }
+
+    char *parts[3] = {};
+    unsigned n_parts = 0;
+    for (char *p = open + 1; n_parts < 3; ) {
+        parts[n_parts++] = p;
+        p = strchr(p, ',');
+        if (p == NULL) {
+            break;
+        }
+        *p++ = '\0';
+    }
+    x86_operand_t reg;
+    for (unsigned i = 0; i < 2 && i < n_parts; i++) {
+        if (*parts[i] == '\0') {
+            continue;
+        }
+        if (parts[i][0] != '%') {
+            return -1;
+        }
+        if (lenient ? parse_any_reg(parts[i] + 1, &reg) != 0 :
+                parse_reg(parts[i] + 1, &reg) != 0 || reg.width < 4 || reg.high8) {
+            return -1;
+        }
+        *(i == 0 ? &opnd->base : &opnd->index) = reg.reg;
+    }
+    if (n_parts == 3) {
+        int64_t scale;
+        if (parse_number(parts[2], &scale) != 0 ||
+                (scale != 1 && scale != 2 && scale != 4 && scale != 8)) {
+            return -1;
+        }
+        opnd->scale = scale;
+    }
+    return 0;
+}
+
+// parse_operand - Parse one operand, already trimmed. Returns 0 on success.
+static int parse_operand(char *s, x86_operand_t *opnd, int lenient) {
+    memset(opnd, 0, sizeof(*opnd));
+    opnd->reg = opnd->base = opnd->index = REG_NONE;
+    opnd->target = -1;
+    if (lenient) {
+        // Indirect jumps and calls, and segment overrides such as %fs:40
+        if (s[0] == '*') {
+            s++;
+        }
+        if (s[0] == '%' && isalpha((unsigned char) s[1]) && s[2] == 's' && s[3] == ':') {
+            s += 4;
+        }
+    }
+    if (s[0] == '%') {
+        opnd->kind = OPND_REG;
+        return lenient ? parse_any_reg(s + 1, opnd) : parse_reg(s + 1, opnd);
+    }
+    if (s[0] == '$') {
+        opnd->kind = OPND_IMM;
+        return parse_number(s + 1, &opnd->imm);
+    }
+    if (strchr(s, '(') != NULL) {
+        return parse_mem(s, opnd, lenient);
+    }
+    if (isdigit((unsigned char) s[0]) || s[0] == '-') {
+        // An absolute address
+        opnd->kind = OPND_MEM;
+        opnd->scale = 1;
+        return parse_number(s, &opnd->imm);
+    }
+    for (const char *p = s; *p != '\0'; p++) {
+        if (!is_label_char(*p)) {
+            return -1;
+        }
+    }
+    if (strlen(s) >= X86_MAX_LABEL_LEN) {
+        return -1;
+    }
+    opnd->kind = OPND_LABEL;
+    strcpy(opnd->label, s);
+    return 0;
+}
+
+// trim - Strip leading and trailing whitespace in place
+static char *trim(char *s) {
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// is_shift - Whether an operation shifts or rotates by a count
+static int is_shift(enum x86_op op) {
+    return op == OP_SHL || op == OP_SHR || op == OP_SAR || op == OP_ROL || op == OP_ROR;
+}
+
+// check_operands - Reject operand combinations outside the subset
+static const char *check_operands(x86_insn_t *insn) {
+    x86_operand_t *src = &insn->operands[0];
+    x86_operand_t *dst = &insn->operands[insn->n_operands - 1];
+    switch (insn->op) {
+        case OP_JMP:
+        case OP_JCC:
+            return src->kind == OPND_LABEL ? NULL : "jump target must be a label";
+        case OP_RET:
+        case OP_NOP:
+        case OP_CLTQ:
+        case OP_CLTD:
+            return NULL;
+        default:
+            break;
+    }
+    for (unsigned i = 0; i < insn->n_operands; i++) {
+        if (insn->operands[i].kind == OPND_LABEL) {
+            return "labels can only be jump targets";
+        }
+    }
+    if (insn->op != OP_PUSH && dst->kind == OPND_IMM && insn->op != OP_CMP && insn->op != OP_TEST) {
+        return "destination cannot be an immediate";
+    }
+    if (insn->op == OP_LEA && src->kind != OPND_MEM) {
+        return "lea needs a memory operand";
+    }
+    if (insn->op == OP_CMOVCC && dst->kind != OPND_REG) {
+        return "cmov needs a register destination";
+    }
+    if (insn->op == OP_IMUL && dst->kind != OPND_REG) {
+        return "imul needs a register destination";
+    }
+    if (insn->op == OP_IMUL && insn->n_operands == 3 && src->kind != OPND_IMM) {
+        return "three-operand imul needs an immediate first";
+    }
+    if (insn->op == OP_XCHG && src->kind == OPND_IMM) {
+        return "xchg needs register or memory operands";
+    }
+    if (insn->op == OP_BT && dst->kind == OPND_MEM && src->kind == OPND_REG) {
+        // The bit index would reach beyond the operand
+        return "bt with a register bit index needs a register operand";
+    }
+
+    // The size comes from the suffix or, failing that, the registers
+    int width = insn->width;
+    for (unsigned i = 0; i < insn->n_operands; i++) {
+        x86_operand_t *opnd = &insn->operands[i];
+        int is_shift_count = i == 0 && insn->n_operands == 2 && is_shift(insn->op);
+        int is_movx_src = i == 0 && (insn->op == OP_MOVZ || insn->op == OP_MOVS);
+        if (opnd->kind != OPND_REG || is_shift_count || is_movx_src || insn->op == OP_LEA) {
+            continue;
+        }
+        if (width == 0) {
+            width = opnd->width;
+        } else if (width != opnd->width) {
+            return "operand size mismatch";
+        }
+    }
+    if (insn->op == OP_LEA && width == 0 && dst->kind == OPND_REG) {
+        width = dst->width;
+    }
+    if (width == 0) {
+        if (insn->op != OP_PUSH && insn->op != OP_POP) {
+            return "operand size is ambiguous";
+        }
+        width = 8;
+    }
+    if (width == 1 && (insn->op == OP_CMOVCC || insn->op == OP_LEA || insn->op == OP_IMUL ||
+            insn->op == OP_BT)) {
+        return "byte operands are not allowed";
+    }
+    if ((insn->op == OP_PUSH || insn->op == OP_POP) && width != 8) {
+        return "push and pop must be 64-bit";
+    }
+    insn->width = width;
+
+    for (unsigned i = 0; i < insn->n_operands; i++) {
+        x86_operand_t *opnd = &insn->operands[i];
+        if (opnd->kind == OPND_IMM || opnd->kind == OPND_MEM) {
+            opnd->width = width;
+        }
+    }
+    if (insn->op == OP_MOVZ || insn->op == OP_MOVS) {
+        if (src->kind == OPND_IMM) {
+            return "movz and movs need a register or memory source";
+        }
+        if (src->width != insn->src_width && src->kind == OPND_REG) {
+            return "operand size mismatch";
+        }
+        src->width = insn->src_width;
+    }
+    if (is_shift(insn->op) &&
+            !(src->kind == OPND_IMM || (src->kind == OPND_REG && src->reg == REG_RCX &&
+              src->width == 1 && !src->high8))) {
+        return "shift count must be an immediate or %cl";
+    }
+    return NULL;
+}
+
+// is_prefix - Whether a word is a prefix rather than an instruction
+static int is_prefix(const char *word) {
+    for (unsigned i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (strcmp(word, prefixes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// is_mnemonic - Whether a word could be the name of an instruction
+static int is_mnemonic(const char *word) {
+    if (!isalpha((unsigned char) *word) || strlen(word) >= X86_MAX_MNEMONIC_LEN) {
+        return 0;
+    }
+    for (; *word != '\0'; word++) {
+        if (!isalnum((unsigned char) *word)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// parse_statement - Parse one statement, after any labels. Returns 0 on success.
+static int parse_statement(char *s, const char *name, int line, x86_program_t *prog,
+        unsigned *cap, int lenient) {
+    char *mnemonic;
+    do {
+        s = trim(s);
+        mnemonic = s;
+        while (*s != '\0' && !isspace((unsigned char) *s)) {
+            *s = tolower((unsigned char) *s);
+            s++;
+        }
+        if (*s != '\0') {
+            *s++ = '\0';
+        }
+    } while (lenient && is_prefix(mnemonic) && *s != '\0');
+
+    x86_insn_t insn = { .line = line };
+    unsigned n_expected = 0;
+    if (parse_mnemonic(mnemonic, &insn, &n_expected) != 0) {
+        if (!lenient || !is_mnemonic(mnemonic)) {
+            fprintf(stderr, "%s:%d: unsupported instruction '%s'\n", name, line, mnemonic);
+            return -1;
+        }
+        insn.op = OP_OTHER;
+        strcpy(insn.mnemonic, mnemonic);
+    }
+
+    // Split the operands at commas outside parentheses
+    char *opnd_text[X86_MAX_OPERANDS + 1];
+    unsigned n = 0;
+    s = trim(s);
+    if (*s != '\0') {
+        int depth = 0;
+        opnd_text[n++] = s;
+        for (; *s != '\0'; s++) {
+            if (*s == '(') {
+                depth++;
+            } else if (*s == ')') {
+                depth--;
+            } else if (*s == ',' && depth == 0) {
+                *s = '\0';
+                if (n == X86_MAX_OPERANDS) {
+                    n++;
+                    break;
+                }
+                opnd_text[n++] = s + 1;
+            }
+        }
+    }
+
+    // Shifts by one can leave out the count, and imul can take an immediate
+    // as well as its source
+    int implicit_count = n == 1 && n_expected == 2 && is_shift(insn.op);
+    if (insn.op == OP_IMUL && n == 3) {
+        n_expected = 3;
+    }
+    if (insn.op == OP_OTHER) {
+        if (n > X86_MAX_OPERANDS) {
+            fprintf(stderr, "%s:%d: too many operands\n", name, line);
+            return -1;
+        }
+        n_expected = n;
+    }
+    if (n != n_expected && !implicit_count) {
+        fprintf(stderr, "%s:%d: '%s' takes %u operand%s\n", name, line, mnemonic, n_expected,
+                n_expected == 1 ? "" : "s");
+        return -1;
+    }
+    if (implicit_count) {
+        insn.operands[0] = (x86_operand_t) { .kind = OPND_IMM, .imm = 1, .reg = REG_NONE,
+            .base = REG_NONE, .index = REG_NONE, .target = -1 };
+        insn.n_operands = 1;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        if (parse_operand(trim(opnd_text[i]), &insn.operands[insn.n_operands++], lenient) != 0) {
+            fprintf(stderr, "%s:%d: cannot parse operand '%s'\n", name, line, trim(opnd_text[i]));
+            return -1;
+        }
+    }
+    const char *error = insn.op == OP_OTHER ? NULL : check_operands(&insn);
+    if (error != NULL) {
+        fprintf(stderr, "%s:%d: %s\n", name, line, error);
+        return -1;
+    }
+
+    if (prog->n_insns == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        prog->insns = realloc(prog->insns, *cap * sizeof(x86_insn_t));
+        if (prog->insns == NULL) {
+            perror("realloc");
+            return -1;
+        }
+    }
+    prog->insns[prog->n_insns++] = insn;
+    return 0;
+}
+
+int x86_find_label(const x86_program_t *prog, const char *name) {
+    for (unsigned i = 0; i < prog->n_labels; i++) {
+        if (strcmp(prog->labels[i].name, name) == 0) {
+            return prog->labels[i].insn;
+        }
+    }
+    return -1;
+}
+
+// parse_source - Parse assembly source, as x86_parse() or leniently
+static int parse_source(const char *source, const char *name, x86_program_t *prog, int lenient) {
+    unsigned insn_cap = 0, label_cap = 0;
+    *prog = (x86_program_t) {};
+
+    int line = 0;
+    for (const char *p = source; *p != '\0'; ) {
+        const char *eol = strchr(p, '\n');
+        size_t len = eol ? (size_t) (eol - p) : strlen(p);
+        char buf[MAX_LINE_LEN];
+        line++;
+        if (len >= sizeof(buf)) {
+            fprintf(stderr, "%s:%d: line too long\n", name, line);
+            x86_free(prog);
+            return -1;
+        }
+        memcpy(buf, p, len);
+        buf[len] = '\0';
+        p += len + (eol != NULL);
+
+        char *comment = strchr(buf, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        // Statements can be separated by semicolons as well as newlines
+        char *save;
+        for (char *stmt = strtok_r(buf, ";", &save); stmt != NULL; stmt = strtok_r(NULL, ";", &save)) {
+            char *s = trim(stmt);
+
+            // Labels, possibly several, before any instruction
+            for (;;) {
+                char *q = s;
+                while (is_label_char(*q)) {
+                    q++;
+                }
+                if (q == s || *q != ':') {
+                    break;
+                }
+                if (q - s >= X86_MAX_LABEL_LEN) {
+                    fprintf(stderr, "%s:%d: label too long\n", name, line);
+                    x86_free(prog);
+                    return -1;
+                }
+                if (prog->n_labels == label_cap) {
+                    label_cap = label_cap ? label_cap * 2 : 32;
+                    prog->labels = realloc(prog->labels, label_cap * sizeof(x86_label_t));
+                    if (prog->labels == NULL) {
+                        perror("realloc");
+                        return -1;
+                    }
+                }
+                x86_label_t *label = &prog->labels[prog->n_labels++];
+                memcpy(label->name, s, q - s);
+                label->name[q - s] = '\0';
+                label->insn = prog->n_insns;
+                s = trim(q + 1);
+            }
+
+            if (*s == '\0' || *s == '.') {
+                continue;
+            }
+            if (parse_statement(s, name, line, prog, &insn_cap, lenient) != 0) {
+                x86_free(prog);
+                return -1;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < prog->n_insns; i++) {
+        x86_insn_t *insn = &prog->insns[i];
+        if (insn->op == OP_JMP || insn->op == OP_JCC) {
+            insn->operands[0].target = x86_find_label(prog, insn->operands[0].label);
+        }
+    }
+    return 0;
+}
+
+int x86_parse(const char *source, const char *name, x86_program_t *prog) {
+    return parse_source(source, name, prog, 0);
+}
+
+// parse_file - Read and parse a file, as x86_parse_file() or leniently
+static int parse_file(const char *path, x86_program_t *prog, int lenient) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t size = 0, cap = 4096;
+    char *source = malloc(cap);
+    for (size_t n; source != NULL && (n = fread(source + size, 1, cap - size - 1, f)) > 0; ) {
+        size += n;
+        if (size == cap - 1) {
+            cap *= 2;
+            source = realloc(source, cap);
+        }
+    }
+    fclose(f);
+    if (source == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    source[size] = '\0';
+    int ret = parse_source(source, path, prog, lenient);
+    free(source);
+    return ret;
+}
+
+int x86_parse_file(const char *path, x86_program_t *prog) {
+    return parse_file(path, prog, 0);
+}
+
+int x86_parse_file_lenient(const char *path, x86_program_t *prog) {
+    return parse_file(path, prog, 1);
+}
+
+void x86_free(x86_program_t *prog) {
+    free(prog->insns);
+    free(prog->labels);
+    *prog = (x86_program_t) {};
+}
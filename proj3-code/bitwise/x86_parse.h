@@ -0,0 +1,107 @@
+#ifndef X86_PARSE_H
+#define X86_PARSE_H
+
+#include <stdint.h>
+
+// Parser for the subset of x86-64 AT&T assembly that bits.s solutions use:
+// register moves and arithmetic, imul, shifts and rotates, compares and bt,
+// setcc, cmov, jumps, push/pop, xchg, lea, and sign extension within %rax
+// and into %rdx (cltq, cltd and their other sizes). Shared by every tool that interprets bits.s without
+// running it. Memory operands other than lea's address are parsed but left
+// for the interpreter to reject. cc_check, which only follows registers and
+// the stack, parses leniently and takes any other instruction as OP_OTHER.
+
+#define X86_MAX_OPERANDS 3
+#define X86_MAX_LABEL_LEN 64
+#define X86_MAX_MNEMONIC_LEN 16
+
+// Registers, numbered the way the hardware encodes them
+enum x86_reg {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+    X86_NUM_REGS,
+    REG_NONE = -1
+};
+
+enum x86_op {
+    OP_MOV, OP_MOVZ, OP_MOVS, OP_LEA,
+    OP_ADD, OP_SUB, OP_AND, OP_OR, OP_XOR, OP_CMP, OP_TEST,
+    OP_NOT, OP_NEG, OP_INC, OP_DEC, OP_IMUL,
+    OP_SHL, OP_SHR, OP_SAR, OP_ROL, OP_ROR, OP_BT,
+    OP_SETCC, OP_CMOVCC, OP_JCC, OP_JMP,
+    OP_PUSH, OP_POP, OP_RET, OP_NOP, OP_XCHG,
+    OP_CLTQ,                // cbtw, cwtl, cltq: sign extend the lower half of %rax
+    OP_CLTD,                // cwtd, cltd, cqto: fill %rdx with the sign of %rax
+    OP_OTHER,               // Outside the subset: only from the lenient parser
+};
+
+// Condition codes of setcc, cmovcc and jcc
+enum x86_cond {
+    CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+    CC_S, CC_NS, CC_L, CC_GE, CC_LE, CC_G,
+};
+
+typedef struct {
+    enum { OPND_REG, OPND_IMM, OPND_MEM, OPND_LABEL } kind;
+    int width;              // Bytes accessed: 1, 2, 4 or 8 (0 if not known)
+    enum x86_reg reg;       // OPND_REG, REG_NONE for others (lenient only)
+    int high8;              // %ah, %ch, %dh or %bh
+    int64_t imm;            // OPND_IMM, or the displacement of OPND_MEM
+    enum x86_reg base, index;   // OPND_MEM, REG_NONE if absent
+    int scale;
+    int target;             // OPND_LABEL: instruction index, -1 if undefined
+    char label[X86_MAX_LABEL_LEN];
+} x86_operand_t;
+
+typedef struct {
+    enum x86_op op;
+    enum x86_cond cond;
+    int width;              // Operand size in bytes
+    int src_width;          // Source size of movz and movs
+    unsigned n_operands;
+    x86_operand_t operands[X86_MAX_OPERANDS];  // In AT&T order: source first
+                                            // (three only for imul $imm, src, dst)
+    int line;
+    char mnemonic[X86_MAX_MNEMONIC_LEN];    // OP_OTHER, without any prefix
+} x86_insn_t;
+
+typedef struct {
+    char name[X86_MAX_LABEL_LEN];
+    int insn;               // Index of the instruction the label is on
+} x86_label_t;
+
+typedef struct {
+    x86_insn_t *insns;
+    unsigned n_insns;
+    x86_label_t *labels;
+    unsigned n_labels;
+} x86_program_t;
+
+/*
+ * Parse assembly source. Directives are skipped. Returns 0 on success, or -1
+ * after printing "name:line: message" to stderr for the first instruction
+ * outside the subset.
+ */
+int x86_parse(const char *source, const char *name, x86_program_t *prog);
+
+// Read and parse a file, as x86_parse()
+int x86_parse_file(const char *path, x86_program_t *prog);
+
+/*
+ * Parse a file as x86_parse_file(), but take any other instruction whose
+ * operands can be read as OP_OTHER, with its operands unchecked. Prefixes
+ * such as rep and lock are dropped, and registers outside the general
+ * purpose ones, %rip among them, are kept as REG_NONE. Only fails on text
+ * that can't be read as an instruction at all.
+ */
+int x86_parse_file_lenient(const char *path, x86_program_t *prog);
+
+void x86_free(x86_program_t *prog);
+
+// Index of the instruction at label, or -1 if it isn't defined
+int x86_find_label(const x86_program_t *prog, const char *name);
+
+// AT&T name of a register accessed with the given width
+const char *x86_reg_name(enum x86_reg reg, int width, int high8);
+
+#endif // X86_PARSE_H
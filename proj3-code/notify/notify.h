@@ -0,0 +1,27 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stdlib.h>
+
+// Defaults shared by the notification shim, the flusher, the stand-in server
+// and the load generator. Each can be changed with an option, or for the shim,
+// which has no command line, with the environment variable named beside it.
+
+#define NOTIFY_SOCKET_DEFAULT "notifyd.sock"        // Stand-in server's Unix socket
+#define NOTIFY_SPOOL_DEFAULT "notify.spool"         // NOTIFY_SPOOL: Queued notifications
+#define NOTIFY_LOG_DEFAULT "notifyd.log"            // Notifications the server received
+#define NOTIFY_HOST_DEFAULT "csel-remote-lnx-01"    // BOMB_HOSTNAME: A host the bomb accepts
+
+// While a spool is being sent, it's renamed to its path with this suffix
+#define SENDING_SUFFIX ".sending"
+
+// Longest request line, the same as the driver's MAXLINE
+#define MAX_REQUEST 8192
+
+// notify_env - An environment variable's value, or fallback if it's unset or empty
+static inline const char *notify_env(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return value != NULL && value[0] != '\0' ? value : fallback;
+}
+
+#endif // NOTIFY_H
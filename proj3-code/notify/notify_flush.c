@@ -0,0 +1,404 @@
+/*
+ * notify_flush - Send the notifications notify_shim queued to notifyd, in the
+ * background, so bombs never wait on the server.
+ *
+ * Each pass takes the whole spool by renaming it, so bombs start a new one,
+ * and sends its requests over a single connection in pipelined batches.
+ * Whatever the server didn't answer stays in the renamed spool and is sent
+ * first on the next pass. Requests the server rejects are reported and
+ * dropped, since sending them again won't help.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+#define INTERVAL_MS_DEFAULT 100
+
+/* Requests sent before reading their replies. Small enough that a batch of
+ * replies fits in the socket's buffer, so the server never blocks writing. */
+#define BATCH_DEFAULT 256
+#define MAX_BATCH 1024
+
+static const char keep_alive[] = "\r\nConnection: keep-alive\r\n\r\n";
+
+/* Replies are read a buffer at a time */
+typedef struct {
+    int fd;
+    size_t pos;
+    size_t len;
+    char buf[8192];
+} reader_t;
+
+/* Set by SIGINT or SIGTERM: send what's queued and exit */
+static volatile sig_atomic_t stopping;
+
+static unsigned long n_sent;
+static unsigned long n_rejected;
+
+static void handle_stop(int signo) {
+    stopping = 1;
+}
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-1h] [-b <batch>] [-i <ms>] [-q <spool>] [-s <socket>]\n", cmd);
+    printf("  -1           Send what's queued once and exit\n");
+    printf("  -b <batch>   Requests to send before waiting for replies (default %d, max %d)\n",
+        BATCH_DEFAULT, MAX_BATCH);
+    printf("  -h           Print this message\n");
+    printf("  -i <ms>      Check the spool this often (default %d)\n", INTERVAL_MS_DEFAULT);
+    printf("  -q <spool>   Notifications queued by notify_shim (default $NOTIFY_SPOOL or %s)\n",
+        NOTIFY_SPOOL_DEFAULT);
+    printf("  -s <socket>  notifyd's socket (default %s)\n", NOTIFY_SOCKET_DEFAULT);
+    exit(1);
+}
+
+// write_all - Write all of buf, returning 0 on success or -1 on error
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// reader_fill - Read more of the reply. Returns 0 on success, or -1 at EOF or on error.
+static int reader_fill(reader_t *r) {
+    for (;;) {
+        ssize_t n = read(r->fd, r->buf, sizeof(r->buf));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        r->pos = 0;
+        r->len = n;
+        return 0;
+    }
+}
+
+// read_line - Read a line of the reply into line, without its line ending.
+// Returns 0 on success, or -1 at EOF, on error or if it doesn't fit.
+static int read_line(reader_t *r, char *line, size_t size) {
+    size_t n = 0;
+    for (;;) {
+        if (r->pos == r->len && reader_fill(r) == -1) {
+            return -1;
+        }
+        char c = r->buf[r->pos++];
+        if (c == '\n') {
+            if (n > 0 && line[n - 1] == '\r') {
+                n--;
+            }
+            line[n] = '\0';
+            return 0;
+        }
+        if (n + 1 >= size) {
+            return -1;
+        }
+        line[n++] = c;
+    }
+}
+
+// read_reply - Read one reply, putting its body in body.
+// Returns its status code, or -1 if the connection failed.
+static int read_reply(reader_t *r, char *body, size_t size) {
+    char line[512];
+    int status;
+    if (read_line(r, line, sizeof(line)) == -1 || sscanf(line, "HTTP/1.%*d %d", &status) != 1) {
+        return -1;
+    }
+    size_t length = 0;
+    int has_length = 0;
+    do {
+        if (read_line(r, line, sizeof(line)) == -1) {
+            return -1;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            length = strtoul(line + 15, NULL, 10);
+            has_length = 1;
+        }
+    } while (line[0] != '\0');
+
+    /* Without a length the connection can't carry another reply */
+    if (!has_length || length >= size) {
+        return -1;
+    }
+    for (size_t n = 0; n < length; n++) {
+        if (r->pos == r->len && reader_fill(r) == -1) {
+            return -1;
+        }
+        body[n] = r->buf[r->pos++];
+    }
+    body[length] = '\0';
+    return status;
+}
+
+// connect_server - Connect to notifyd's Unix socket, returning the fd or -1.
+// While the server is down, only the first failure is reported.
+static int connect_server(const char *path) {
+    static int reported;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "notify_flush: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        if (!reported) {
+            perror(path);
+            reported = 1;
+        }
+        close(fd);
+        return -1;
+    }
+    reported = 0;
+    return fd;
+}
+
+// send_requests - Send the request lines in data to the server, batch at a time.
+// Returns how many bytes of data were answered (accepted or rejected).
+static size_t send_requests(int conn, const char *data, size_t len, unsigned batch) {
+    static reader_t reader;
+    static char out[MAX_BATCH * (MAX_REQUEST + sizeof(keep_alive))];
+    reader.fd = conn;
+    reader.pos = reader.len = 0;
+
+    size_t done = 0;
+    while (done < len) {
+        /* Write a batch of requests, noting where each ends in data */
+        const char *ends[MAX_BATCH];
+        size_t out_len = 0;
+        unsigned n = 0;
+        const char *p = data + done;
+        while (n < batch && p < data + len) {
+            const char *nl = memchr(p, '\n', data + len - p);
+            const char *end = nl != NULL ? nl + 1 : data + len;
+            size_t line_len = end - p - (nl != NULL);
+            if (line_len > 0 && line_len < MAX_REQUEST) {
+                memcpy(out + out_len, p, line_len);
+                memcpy(out + out_len + line_len, keep_alive, sizeof(keep_alive) - 1);
+                out_len += line_len + sizeof(keep_alive) - 1;
+                ends[n++] = end;
+            } else if (line_len > 0) {
+                fprintf(stderr, "notify_flush: Dropping request too long to send\n");
+            }
+            p = end;
+        }
+        if (n == 0) {
+            return len;
+        }
+        if (write_all(conn, out, out_len) == -1) {
+            perror("write");
+            return done;
+        }
+
+        /* Each reply answers the next request in the batch */
+        for (unsigned i = 0; i < n; i++) {
+            char body[512];
+            int status = read_reply(&reader, body, sizeof(body));
+            if (status == -1) {
+                fprintf(stderr, "notify_flush: Connection to server failed\n");
+                return done;
+            }
+            const char *start = data + done;
+            if (status == 200 && strcmp(body, "OK") == 0) {
+                n_sent++;
+            } else {
+                n_rejected++;
+                fprintf(stderr, "notify_flush: Server rejected request (%d %s): %.*s\n", status,
+                    body, (int) strcspn(start, "\n"), start);
+            }
+            done = ends[i] - data;
+        }
+        /* Blank or oversized lines after the last request are done too */
+        done = p - data;
+    }
+    return done;
+}
+
+// read_file - Read all of an open file into a malloc'd buffer, setting *len
+static char *read_file(int fd, size_t *len) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return NULL;
+    }
+    char *data = malloc(st.st_size + 1);
+    if (data == NULL) {
+        return NULL;
+    }
+    size_t have = 0;
+    while (have < (size_t) st.st_size) {
+        ssize_t n = read(fd, data + have, st.st_size - have);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(data);
+            return NULL;
+        }
+        have += n;
+    }
+    *len = have;
+    return data;
+}
+
+// keep_unsent - Replace the renamed spool with the requests that weren't answered
+static int keep_unsent(const char *sending, const char *data, size_t len) {
+    char tmp[4096 + sizeof(".tmp")];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", sending);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1 || write_all(fd, data, len) == -1 || close(fd) == -1 ||
+            rename(tmp, sending) == -1) {
+        perror(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// flush_spool - Send everything queued in the spool to the server.
+// Returns 0 if it was all answered, or -1 if some is left for the next pass.
+static int flush_spool(const char *spool, const char *socket_path, unsigned batch) {
+    char sending[4096];
+    if (snprintf(sending, sizeof(sending), "%s%s", spool, SENDING_SUFFIX) >= (int) sizeof(sending)) {
+        fprintf(stderr, "notify_flush: Spool path too long: %s\n", spool);
+        return -1;
+    }
+
+    /* Requests left from a failed pass go first, then take the current spool */
+    if (access(sending, F_OK) == -1 && rename(spool, sending) == -1) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror(spool);
+        return -1;
+    }
+    int fd = open(sending, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(sending);
+        return -1;
+    }
+    /* Wait for bombs that opened the spool before it was renamed to finish writing */
+    size_t len;
+    char *data = NULL;
+    if (flock(fd, LOCK_EX) == -1 || (data = read_file(fd, &len)) == NULL) {
+        perror(sending);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    int conn = connect_server(socket_path);
+    if (conn == -1) {
+        free(data);
+        return -1;
+    }
+    size_t done = send_requests(conn, data, len, batch);
+    close(conn);
+
+    int status = 0;
+    if (done == len) {
+        if (unlink(sending) == -1) {
+            perror(sending);
+            status = -1;
+        }
+    } else {
+        keep_unsent(sending, data + done, len - done);
+        status = -1;
+    }
+    free(data);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    const char *spool = notify_env("NOTIFY_SPOOL", NOTIFY_SPOOL_DEFAULT);
+    const char *socket_path = NOTIFY_SOCKET_DEFAULT;
+    int interval_ms = INTERVAL_MS_DEFAULT;
+    int batch = BATCH_DEFAULT;
+    int once = 0;
+
+    char c;
+    while ((c = getopt(argc, argv, "1hb:i:q:s:")) != -1) {
+        switch (c) {
+            case '1':
+                once = 1;
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                if (batch < 1 || batch > MAX_BATCH) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'i':
+                interval_ms = atoi(optarg);
+                if (interval_ms < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'q':
+                spool = optarg;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+    }
+
+    if (once) {
+        /* The first pass may only have sent what a failed pass left */
+        int status = flush_spool(spool, socket_path, batch);
+        if (status == 0 && access(spool, F_OK) == 0) {
+            status = flush_spool(spool, socket_path, batch);
+        }
+        fprintf(stderr, "notify_flush: %lu notifications sent, %lu rejected\n", n_sent, n_rejected);
+        return status == 0 ? 0 : 1;
+    }
+
+    // Without SA_RESTART, a signal also cuts short the wait between passes
+    struct sigaction sigact = { .sa_handler = handle_stop };
+    sigemptyset(&sigact.sa_mask);
+    if (sigaction(SIGINT, &sigact, NULL) == -1 || sigaction(SIGTERM, &sigact, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct timespec interval = { interval_ms / 1000, (interval_ms % 1000) * 1000000L };
+    while (!stopping) {
+        flush_spool(spool, socket_path, batch);
+        nanosleep(&interval, NULL);
+    }
+    int status = flush_spool(spool, socket_path, batch);
+    fprintf(stderr, "notify_flush: %lu notifications sent, %lu rejected\n", n_sent, n_rejected);
+    return status == 0 ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+/*
+ * notify_load - Measure how many bomb runs per second the offline
+ * notification pipeline can record.
+ *
+ * Starts notifyd and notify_flush in a scratch directory, runs the bomb many
+ * times, several at once, with notify_shim preloaded, then waits until every
+ * queued notification has reached notifyd's log. It reports how fast the
+ * bombs ran (each only appends to the spool) and how fast their
+ * notifications were recorded end to end.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+#define RUNS_DEFAULT 200
+#define DRAIN_TIMEOUT_MS 30000
+
+/* Exit codes of a bomb that was defused, and one that exploded */
+#define BOMB_DEFUSED 0
+#define BOMB_EXPLODED 8
+
+/* Phase 1 never accepts this, so a bomb given it explodes */
+static const char explode_input[] = "This is not the answer.\n";
+
+/* Paths in the scratch directory */
+static char dir[] = "/tmp/notify_load.XXXXXX";
+static char socket_path[64];
+static char spool_path[64];
+static char sending_path[64];
+static char log_path[64];
+static char explode_path[64];
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-ehk] [-b <bomb>] [-i <input>] [-n <runs>] [-p <parallel>]\n", cmd);
+    printf("  -b <bomb>      Bomb to run (default ../bomb*/bomb)\n");
+    printf("  -e             Make every other run explode\n");
+    printf("  -h             Print this message\n");
+    printf("  -i <input>     Input the bomb reads (default input.txt beside the bomb)\n");
+    printf("  -k             Keep the scratch directory with the server's log\n");
+    printf("  -n <runs>      Run the bomb this many times (default %d)\n", RUNS_DEFAULT);
+    printf("  -p <parallel>  Run this many bombs at once (default: one per core)\n");
+    exit(1);
+}
+
+// monotonic_ns - Wall clock time for measuring throughput
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// sleep_ms - Sleep for ms milliseconds
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// spawn - Start a program with its output discarded, returning its pid or -1
+static pid_t spawn(char *const argv[], int quiet) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        if (quiet) {
+            dup2(null, STDERR_FILENO);
+        }
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+// stop - Stop a helper with SIGTERM and wait for it
+static void stop(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+// count_lines - Lines in a file, or 0 if it can't be read
+static unsigned long count_lines(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    unsigned long lines = 0;
+    int c;
+    while ((c = getc(f)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(f);
+    return lines;
+}
+
+// find_bomb - The bomb in the first bomb* directory beside the one this program is in
+static int find_bomb(const char *tools, char *bomb, size_t size) {
+    char pattern[PATH_MAX];
+    glob_t found;
+    snprintf(pattern, sizeof(pattern), "%s/../bomb*/bomb", tools);
+    if (glob(pattern, 0, NULL, &found) != 0) {
+        return -1;
+    }
+    snprintf(bomb, size, "%s", found.gl_pathv[0]);
+    globfree(&found);
+    return 0;
+}
+
+// make_scratch - Create the scratch directory and the exploding input in it
+static int make_scratch(void) {
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return -1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/%s", dir, NOTIFY_SOCKET_DEFAULT);
+    snprintf(spool_path, sizeof(spool_path), "%s/%s", dir, NOTIFY_SPOOL_DEFAULT);
+    snprintf(sending_path, sizeof(sending_path), "%s/%s%s", dir, NOTIFY_SPOOL_DEFAULT, SENDING_SUFFIX);
+    snprintf(log_path, sizeof(log_path), "%s/%s", dir, NOTIFY_LOG_DEFAULT);
+    snprintf(explode_path, sizeof(explode_path), "%s/explode.txt", dir);
+
+    FILE *f = fopen(explode_path, "w");
+    if (f == NULL || fputs(explode_input, f) == EOF || fclose(f) == EOF) {
+        perror(explode_path);
+        return -1;
+    }
+    return 0;
+}
+
+// remove_scratch - Remove the scratch directory and everything in it
+static void remove_scratch(void) {
+    const char *files[] = { socket_path, spool_path, sending_path, log_path, explode_path };
+    for (unsigned i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        unlink(files[i]);
+    }
+    if (rmdir(dir) == -1) {
+        perror(dir);
+    }
+}
+
+// wait_for_server - Wait for notifyd to create its socket. Returns 0 or -1 on timeout.
+static int wait_for_server(void) {
+    for (int ms = 0; ms < 5000; ms++) {
+        if (access(socket_path, F_OK) == 0) {
+            return 0;
+        }
+        sleep_ms(1);
+    }
+    fprintf(stderr, "notify_load: notifyd didn't start\n");
+    return -1;
+}
+
+// wait_for_drain - Wait until notify_flush has sent everything queued.
+// Returns 0, or -1 on timeout.
+static int wait_for_drain(void) {
+    for (int ms = 0; ms < DRAIN_TIMEOUT_MS; ms++) {
+        if (access(spool_path, F_OK) == -1 && access(sending_path, F_OK) == -1) {
+            return 0;
+        }
+        sleep_ms(1);
+    }
+    fprintf(stderr, "notify_load: Notifications still queued after %d s\n", DRAIN_TIMEOUT_MS / 1000);
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    char tools[PATH_MAX], bomb_buf[PATH_MAX], input_buf[PATH_MAX];
+    const char *bomb = NULL, *input = NULL;
+    int runs = RUNS_DEFAULT, explode = 0, keep = 0;
+    long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int parallel = n_cores > 0 ? n_cores : 1;
+
+    char c;
+    while ((c = getopt(argc, argv, "ehkb:i:n:p:")) != -1) {
+        switch (c) {
+            case 'b':
+                bomb = optarg;
+                break;
+            case 'e':
+                explode = 1;
+                break;
+            case 'i':
+                input = optarg;
+                break;
+            case 'k':
+                keep = 1;
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                if (runs < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'p':
+                parallel = atoi(optarg);
+                if (parallel < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+    }
+
+    // notifyd, notify_flush and notify_shim.so are built beside this program
+    ssize_t len = readlink("/proc/self/exe", tools, sizeof(tools) - 1);
+    if (len == -1) {
+        perror("/proc/self/exe");
+        return 1;
+    }
+    tools[len] = '\0';
+    *strrchr(tools, '/') = '\0';
+
+    if (bomb == NULL) {
+        if (find_bomb(tools, bomb_buf, sizeof(bomb_buf)) == -1) {
+            fprintf(stderr, "notify_load: No bomb found; give one with -b\n");
+            return 1;
+        }
+        bomb = bomb_buf;
+    }
+    if (input == NULL) {
+        const char *slash = strrchr(bomb, '/');
+        int dir_len = slash != NULL ? slash - bomb : 1;
+        snprintf(input_buf, sizeof(input_buf), "%.*s/input.txt", dir_len, slash != NULL ? bomb : ".");
+        input = input_buf;
+    }
+    if (access(bomb, X_OK) == -1 || access(input, R_OK) == -1) {
+        perror(access(bomb, X_OK) == -1 ? bomb : input);
+        return 1;
+    }
+
+    char notifyd[PATH_MAX + 32], flush[PATH_MAX + 32], preload[PATH_MAX + 32], spool_env[96];
+    snprintf(notifyd, sizeof(notifyd), "%s/notifyd", tools);
+    snprintf(flush, sizeof(flush), "%s/notify_flush", tools);
+    snprintf(preload, sizeof(preload), "LD_PRELOAD=%s/notify_shim.so", tools);
+    if (make_scratch() == -1) {
+        return 1;
+    }
+    snprintf(spool_env, sizeof(spool_env), "NOTIFY_SPOOL=%s", spool_path);
+
+    char *notifyd_argv[] = { notifyd, "-s", socket_path, "-l", log_path, NULL };
+    pid_t server = spawn(notifyd_argv, 1);
+    if (server == -1 || wait_for_server() == -1) {
+        stop(server);
+        remove_scratch();
+        return 1;
+    }
+    char *flush_argv[] = { flush, "-i", "1", "-q", spool_path, "-s", socket_path, NULL };
+    pid_t flusher = spawn(flush_argv, 0);
+
+    // Bombs get the shim through their environment; nothing else changes
+    putenv(preload);
+    putenv(spool_env);
+
+    int started = 0, running = 0, defused = 0, exploded = 0, failed = 0;
+    uint64_t start_ns = monotonic_ns();
+    while (started < runs || running > 0) {
+        if (started < runs && running < parallel) {
+            char *bomb_argv[] = { (char *) bomb,
+                (char *) (explode && started % 2 == 1 ? explode_path : input), NULL };
+            if (spawn(bomb_argv, 0) == -1) {
+                break;
+            }
+            started++;
+            running++;
+            continue;
+        }
+        int status;
+        if (wait(&status) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("wait");
+            break;
+        }
+        running--;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == BOMB_DEFUSED) {
+            defused++;
+        } else if (WIFEXITED(status) && WEXITSTATUS(status) == BOMB_EXPLODED) {
+            exploded++;
+        } else {
+            failed++;
+        }
+    }
+    uint64_t bombs_ns = monotonic_ns() - start_ns;
+    unsetenv("LD_PRELOAD");
+    int drained = wait_for_drain();
+    uint64_t total_ns = monotonic_ns() - start_ns;
+
+    stop(flusher);
+    stop(server);
+    unsigned long recorded = count_lines(log_path);
+
+    printf("Runs:           %d (%d defused, %d exploded, %d failed)\n", started, defused,
+        exploded, failed);
+    printf("Notifications:  %lu recorded\n", recorded);
+    printf("Bombs done:     %8.3f s  %10.1f runs/s\n", bombs_ns / 1e9, started / (bombs_ns / 1e9));
+    printf("All recorded:   %8.3f s  %10.1f runs/s  %10.1f notifications/s\n", total_ns / 1e9,
+        started / (total_ns / 1e9), recorded / (total_ns / 1e9));
+
+    if (keep) {
+        printf("Server log:     %s\n", log_path);
+    } else {
+        remove_scratch();
+    }
+    return drained == 0 && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+/*
+ * notifyd - Stand-in for the grading server the bomb notifies, listening on
+ * a Unix socket so nothing touches the network.
+ *
+ * It takes the same requests the bomb's driver sends,
+ *   GET /<course>/submitr.pl/?userid=..&userpwd=..&lab=..&result=..&submit=submit HTTP/1.0
+ * checks them, logs one line per notification (time, course, userid, lab,
+ * result) and answers "OK" the way the driver expects. A request with a
+ * "Connection: keep-alive" header leaves the connection open for the next,
+ * so notify_flush can pipeline a batch of them over one connection; without
+ * it the server closes after replying, as the driver needs.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+/* Requests read at once, and replies written at once */
+#define IN_BUF_SIZE (64 * 1024)
+#define OUT_BUF_SIZE (16 * 1024)
+
+/* Longest reply, so one always fits when the buffer is written out below this */
+#define MAX_REPLY 256
+
+typedef struct {
+    char course[64];
+    char userid[64];
+    char lab[64];
+    char result[MAX_REQUEST];
+} notification_t;
+
+/* Set by SIGINT or SIGTERM: finish the current connection and exit */
+static volatile sig_atomic_t stopping;
+
+static FILE *log_file;
+static unsigned long n_received;
+static unsigned long n_rejected;
+
+static void handle_stop(int signo) {
+    stopping = 1;
+}
+
+static void usage(char *cmd) {
+    printf("Usage: %s [-h] [-l <log>] [-s <socket>]\n", cmd);
+    printf("  -h           Print this message\n");
+    printf("  -l <log>     Append notifications to log (default %s, - for standard output)\n",
+        NOTIFY_LOG_DEFAULT);
+    printf("  -s <socket>  Listen on this Unix socket (default %s)\n", NOTIFY_SOCKET_DEFAULT);
+    exit(1);
+}
+
+// hex_value - Value of a hex digit, or -1
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// url_decode - Decode len bytes of a query parameter into out, which holds size bytes.
+// Returns 0 on success, or -1 if it's malformed or doesn't fit.
+static int url_decode(char *out, size_t size, const char *in, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = in[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%') {
+            if (i + 2 >= len) {
+                return -1;
+            }
+            int hi = hex_value(in[i + 1]), lo = hex_value(in[i + 2]);
+            if (hi < 0 || lo < 0) {
+                return -1;
+            }
+            c = hi * 16 + lo;
+            i += 2;
+        }
+        if (n + 1 >= size || c == '\0' || c == '\n' || c == '\r') {
+            return -1;
+        }
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+// parse_request - Check a request line and decode its notification.
+// Returns NULL on success, or why the request is bad.
+static const char *parse_request(const char *line, size_t len, notification_t *note) {
+    static const char script[] = "/submitr.pl/?";
+    static const char version[] = " HTTP/1.";
+
+    if (len < 5 || strncmp(line, "GET /", 5) != 0) {
+        return "Only GET is supported";
+    }
+    const char *path = line + 4;
+    const char *end = line + len;
+    const char *query = memmem(path, end - path, script, sizeof(script) - 1);
+    const char *query_end = memmem(path, end - path, version, sizeof(version) - 1);
+    if (query == NULL || query_end == NULL || query_end < query) {
+        return "Not a submitr.pl request";
+    }
+    if (url_decode(note->course, sizeof(note->course), path + 1, query - (path + 1)) == -1) {
+        return "Bad course";
+    }
+    query += sizeof(script) - 1;
+
+    note->userid[0] = note->lab[0] = note->result[0] = '\0';
+    int has_password = 0;
+    while (query < query_end) {
+        const char *amp = memchr(query, '&', query_end - query);
+        const char *param_end = amp != NULL ? amp : query_end;
+        const char *eq = memchr(query, '=', param_end - query);
+        if (eq == NULL) {
+            return "Malformed query";
+        }
+        size_t name_len = eq - query;
+        char *out = NULL;
+        size_t size = 0;
+        if (name_len == 6 && strncmp(query, "userid", 6) == 0) {
+            out = note->userid, size = sizeof(note->userid);
+        } else if (name_len == 3 && strncmp(query, "lab", 3) == 0) {
+            out = note->lab, size = sizeof(note->lab);
+        } else if (name_len == 6 && strncmp(query, "result", 6) == 0) {
+            out = note->result, size = sizeof(note->result);
+        } else if (name_len == 7 && strncmp(query, "userpwd", 7) == 0) {
+            /* Checked for, but never logged */
+            has_password = 1;
+        }
+        if (out != NULL && url_decode(out, size, eq + 1, param_end - (eq + 1)) == -1) {
+            return "Malformed query";
+        }
+        query = param_end + 1;
+    }
+    if (note->userid[0] == '\0' || note->lab[0] == '\0' || note->result[0] == '\0' ||
+            !has_password) {
+        return "Missing userid, userpwd, lab or result";
+    }
+    return NULL;
+}
+
+// has_keep_alive - Whether a request's headers ask to keep the connection open
+static int has_keep_alive(const char *headers, size_t len) {
+    static const char header[] = "\nConnection: keep-alive";
+    const char *end = headers + len;
+    for (const char *p = headers; p + sizeof(header) - 1 <= end; p++) {
+        if (strncasecmp(p, header, sizeof(header) - 1) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// handle_request - Log one request and append its reply to out.
+// Returns how many bytes were appended.
+static size_t handle_request(const char *request, size_t len, int keep_alive, char *out) {
+    notification_t note;
+    size_t line_len = strcspn(request, "\r\n");
+    const char *error = parse_request(request, line_len, &note);
+    const char *connection = keep_alive ? "Connection: keep-alive\r\n" : "";
+    if (error != NULL) {
+        n_rejected++;
+        fprintf(stderr, "notifyd: %s: %.*s\n", error, (int) (line_len < 200 ? line_len : 200),
+            request);
+        return snprintf(out, MAX_REPLY, "HTTP/1.0 400 Bad Request\r\n%sContent-Length: %zu\r\n\r\n%s",
+            connection, strlen(error), error);
+    }
+    n_received++;
+    fprintf(log_file, "%ld\t%s\t%s\t%s\t%s\n", (long) time(NULL), note.course, note.userid,
+        note.lab, note.result);
+    return snprintf(out, MAX_REPLY, "HTTP/1.0 200 OK\r\n%sContent-Length: 2\r\n\r\nOK", connection);
+}
+
+// write_all - Write all of buf, returning 0 on success or -1 on error
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// find_request_end - End of the first complete request (after its blank line), or NULL
+static char *find_request_end(char *buf, size_t len) {
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (buf[i] == '\n' && buf[i + 1] == '\n') {
+            return buf + i + 2;
+        }
+        if (buf[i] == '\n' && buf[i + 1] == '\r' && i + 2 < len && buf[i + 2] == '\n') {
+            return buf + i + 3;
+        }
+    }
+    return NULL;
+}
+
+// serve_connection - Answer requests on a connection until the client is done
+static void serve_connection(int conn) {
+    static char in[IN_BUF_SIZE];
+    static char out[OUT_BUF_SIZE];
+    size_t have = 0, out_len = 0;
+    int keep_alive = 1;
+
+    while (keep_alive) {
+        ssize_t n = read(conn, in + have, sizeof(in) - have);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == -1) {
+                perror("read");
+            }
+            break;
+        }
+        have += n;
+
+        /* Answer every complete request in the buffer, then send the replies at once */
+        char *start = in, *end;
+        while (keep_alive && (end = find_request_end(start, in + have - start)) != NULL) {
+            keep_alive = has_keep_alive(start, end - start);
+            out_len += handle_request(start, end - start, keep_alive, out + out_len);
+            start = end;
+            if (out_len > sizeof(out) - MAX_REPLY) {
+                fflush(log_file);
+                if (write_all(conn, out, out_len) == -1) {
+                    perror("write");
+                    return;
+                }
+                out_len = 0;
+            }
+        }
+        have -= start - in;
+        memmove(in, start, have);
+        if (have == sizeof(in)) {
+            fprintf(stderr, "notifyd: Request too long\n");
+            keep_alive = 0;
+        }
+
+        /* Only reply once the notifications are in the log */
+        fflush(log_file);
+        if (write_all(conn, out, out_len) == -1) {
+            perror("write");
+            return;
+        }
+        out_len = 0;
+    }
+}
+
+// open_listener - Listen on a Unix socket at path, replacing any stale one
+static int open_listener(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "notifyd: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(fd, 64) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = NOTIFY_SOCKET_DEFAULT;
+    const char *log_path = NOTIFY_LOG_DEFAULT;
+
+    char c;
+    while ((c = getopt(argc, argv, "hl:s:")) != -1) {
+        switch (c) {
+            case 'l':
+                log_path = optarg;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+    }
+
+    log_file = strcmp(log_path, "-") == 0 ? stdout : fopen(log_path, "a");
+    if (log_file == NULL) {
+        perror(log_path);
+        return 1;
+    }
+
+    // Without SA_RESTART, a signal also interrupts waiting for a connection
+    struct sigaction sigact = { .sa_handler = handle_stop };
+    sigemptyset(&sigact.sa_mask);
+    if (sigaction(SIGINT, &sigact, NULL) == -1 || sigaction(SIGTERM, &sigact, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = open_listener(socket_path);
+    if (listener == -1) {
+        return 1;
+    }
+    while (!stopping) {
+        int conn = accept(listener, NULL, NULL);
+        if (conn == -1) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        serve_connection(conn);
+        close(conn);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    fclose(log_file);
+    fprintf(stderr, "notifyd: %lu notifications received, %lu rejected\n", n_received, n_rejected);
+    return 0;
+}